@@ -0,0 +1,84 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DriverModel.h"
+
+void FDriverModelBatch::reset() {
+	speeds.Reset();
+	desiredSpeeds.Reset();
+	gaps.Reset();
+	closingSpeeds.Reset();
+	timeHeadways.Reset();
+	minimumGaps.Reset();
+	maxAccelerations.Reset();
+	comfortDecelerations.Reset();
+	accelerations.Reset();
+}
+
+int FDriverModelBatch::add(float speed, float desiredSpeed, float gap, float closingSpeed, const FDriverModelParams &params) {
+	// inputs come in engine units (km/h, cm), the model works in SI units
+	speeds.Add(FMath::Max(0.0f, speed) / 3.6f);
+	desiredSpeeds.Add(FMath::Max(0.1f, desiredSpeed / 3.6f));
+	gaps.Add(FMath::Max(0.1f, gap * 0.01f));
+	closingSpeeds.Add(closingSpeed / 3.6f);
+	timeHeadways.Add(params.TimeHeadway);
+	minimumGaps.Add(params.MinimumGap * 0.01f);
+	maxAccelerations.Add(params.MaxAcceleration);
+	comfortDecelerations.Add(params.ComfortDeceleration);
+	return accelerations.Add(0);
+}
+
+/* Intelligent Driver Model acceleration in SI units, shared by the batch and single vehicles. */
+static FORCEINLINE float computeDriverAcceleration(float v, float v0, float s, float dv, float T, float s0, float a, float b) {
+	float ratio = v / v0;
+	float ratio2 = ratio * ratio;
+	float dynamicGap = v * T + v * dv / (2 * FMath::Sqrt(a * b));
+	float desiredGap = s0 + FMath::Max(0.0f, dynamicGap);
+	float gapRatio = desiredGap / s;
+	return a * (1 - ratio2 * ratio2 - gapRatio * gapRatio);
+}
+
+void FDriverModelBatch::compute() {
+	const int count = speeds.Num();
+	const float* v = speeds.GetData();
+	const float* v0 = desiredSpeeds.GetData();
+	const float* s = gaps.GetData();
+	const float* dv = closingSpeeds.GetData();
+	const float* T = timeHeadways.GetData();
+	const float* s0 = minimumGaps.GetData();
+	const float* a = maxAccelerations.GetData();
+	const float* b = comfortDecelerations.GetData();
+	float* out = accelerations.GetData();
+	// plain loop without branches, the model is inlined, so compilers can vectorize it
+	for (int i = 0; i < count; i++) {
+		out[i] = computeDriverAcceleration(v[i], v0[i], s[i], dv[i], T[i], s0[i], a[i], b[i]);
+	}
+}
+
+float FDriverModelBatch::computeSingle(float speed, float desiredSpeed, float gap, float closingSpeed, const FDriverModelParams &params) {
+	// same conversions as add
+	return computeDriverAcceleration(FMath::Max(0.0f, speed) / 3.6f, FMath::Max(0.1f, desiredSpeed / 3.6f),
+		FMath::Max(0.1f, gap * 0.01f), closingSpeed / 3.6f, params.TimeHeadway, params.MinimumGap * 0.01f,
+		params.MaxAcceleration, params.ComfortDeceleration);
+}
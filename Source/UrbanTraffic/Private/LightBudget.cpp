@@ -0,0 +1,211 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "LightBudget.h"
+#include "Components/LightComponent.h"
+#include "Components/PrimitiveComponent.h"
+
+/* Largest promote ring, bounds cells visited when the camera moves. */
+static const int LIGHT_MAX_PROMOTE_RING = 8;
+
+FLightBudget::FLightBudget(float gridCellSize) : cellSize(FMath::Max(gridCellSize, 100.0f)) {}
+
+void FLightBudget::addLight(USceneComponent* container, bool isMoving) {
+	if (!container || slots.Contains(container)) {
+		return;
+	}
+	int index;
+	if (freeSlots.Num()) {
+		index = freeSlots.Pop(false);
+	}
+	else {
+		index = lights.AddDefaulted();
+	}
+	FBudgetLight &light = lights[index];
+	light.container = container;
+	light.lightComponents.Reset();
+	light.meshComponents.Reset();
+	TArray<USceneComponent*> components;
+	container->GetChildrenComponents(true, components);
+	components.Add(container);
+	for (USceneComponent* component : components) {
+		if (ULightComponent* lightComponent = Cast<ULightComponent>(component)) {
+			light.lightComponents.Add(lightComponent);
+		}
+		else if (UPrimitiveComponent* mesh = Cast<UPrimitiveComponent>(component)) {
+			light.meshComponents.Add(mesh);
+		}
+	}
+	light.cell = getCell(container->GetComponentLocation());
+	light.isMoving = isMoving;
+	// demoted until the camera is known, the ring check then decides
+	light.isReal = true;
+	numReal++;
+	setReal(light, false);
+	if (hasView) {
+		refreshLight(light);
+	}
+	slots.Add(container, index);
+	cells.FindOrAdd(light.cell).Add(index);
+	if (isMoving) {
+		movingLights.Add(index);
+	}
+}
+
+void FLightBudget::removeLight(USceneComponent* container) {
+	int index;
+	if (!slots.RemoveAndCopyValue(container, index)) {
+		return;
+	}
+	FBudgetLight &light = lights[index];
+	if (TArray<int>* cell = cells.Find(light.cell)) {
+		cell->RemoveSwap(index);
+		if (!cell->Num()) {
+			cells.Remove(light.cell);
+		}
+	}
+	if (light.isMoving) {
+		movingLights.RemoveSwap(index);
+	}
+	numReal -= light.isReal ? 1 : 0;
+	light.container = nullptr;
+	light.lightComponents.Reset();
+	light.meshComponents.Reset();
+	freeSlots.Add(index);
+}
+
+void FLightBudget::update(FVector viewLocation) {
+	int oldRing = promoteRing;
+	FIntPoint oldCell = viewCell;
+	// one ring per update, shrink when over budget, grow when the next ring fits
+	if (numReal > maxRealLights) {
+		promoteRing = FMath::Max(0, promoteRing - 1);
+	}
+	else if (hasView && promoteRing < LIGHT_MAX_PROMOTE_RING) {
+		int nextCount = 0;
+		int nextRing = promoteRing + 1;
+		for (int x = -nextRing; x <= nextRing; x++) {
+			for (int y = -nextRing; y <= nextRing; y++) {
+				if (FMath::Max(FMath::Abs(x), FMath::Abs(y)) == nextRing) {
+					if (const TArray<int>* cell = cells.Find(viewCell + FIntPoint(x, y))) {
+						for (int index : *cell) {
+							nextCount += lights[index].isReal ? 0 : 1;
+						}
+					}
+				}
+			}
+		}
+		if (numReal + nextCount <= maxRealLights) {
+			promoteRing = nextRing;
+		}
+	}
+	viewCell = getCell(viewLocation);
+	if (!hasView) {
+		// first view, every cell around it is new
+		hasView = true;
+		refreshCells(viewCell, promoteRing, [](FIntPoint) { return true; });
+	}
+	else if (viewCell != oldCell || promoteRing != oldRing) {
+		// promote cells which were not sure to be real, demote real cells which left the hysteresis ring
+		auto oldRingOf = [&](FIntPoint cell) {
+			return FMath::Max(FMath::Abs(cell.X - oldCell.X), FMath::Abs(cell.Y - oldCell.Y));
+		};
+		refreshCells(viewCell, promoteRing, [&](FIntPoint cell) { return oldRingOf(cell) > oldRing; });
+		refreshCells(oldCell, oldRing + 1, [&](FIntPoint cell) { return getRing(cell) > promoteRing + 1; });
+	}
+	// vehicles move between cells
+	for (int index : movingLights) {
+		FBudgetLight &light = lights[index];
+		FIntPoint cell = getCell(light.container->GetComponentLocation());
+		if (cell != light.cell) {
+			TArray<int> &oldLights = cells.FindChecked(light.cell);
+			oldLights.RemoveSwap(index);
+			if (!oldLights.Num()) {
+				cells.Remove(light.cell);
+			}
+			light.cell = cell;
+			cells.FindOrAdd(cell).Add(index);
+			refreshLight(light);
+		}
+	}
+}
+
+void FLightBudget::empty() {
+	lights.Reset();
+	freeSlots.Reset();
+	slots.Reset();
+	cells.Reset();
+	movingLights.Reset();
+	hasView = false;
+	numReal = 0;
+}
+
+FIntPoint FLightBudget::getCell(FVector location) const {
+	return FIntPoint(FMath::FloorToInt(location.X / cellSize), FMath::FloorToInt(location.Y / cellSize));
+}
+
+int FLightBudget::getRing(FIntPoint cell) const {
+	return FMath::Max(FMath::Abs(cell.X - viewCell.X), FMath::Abs(cell.Y - viewCell.Y));
+}
+
+void FLightBudget::refreshLight(FBudgetLight &light) {
+	int ring = getRing(light.cell);
+	if (ring <= promoteRing) {
+		setReal(light, true);
+	}
+	else if (ring > promoteRing + 1) {
+		setReal(light, false);
+	}
+}
+
+void FLightBudget::refreshCells(FIntPoint center, int radius, TFunctionRef<bool(FIntPoint)> filter) {
+	for (int x = center.X - radius; x <= center.X + radius; x++) {
+		for (int y = center.Y - radius; y <= center.Y + radius; y++) {
+			FIntPoint cell(x, y);
+			TArray<int>* cellLights = filter(cell) ? cells.Find(cell) : nullptr;
+			if (cellLights) {
+				for (int index : *cellLights) {
+					refreshLight(lights[index]);
+				}
+			}
+		}
+	}
+}
+
+void FLightBudget::setReal(FBudgetLight &light, bool isReal) {
+	if (light.isReal == isReal) {
+		return;
+	}
+	light.isReal = isReal;
+	numReal += isReal ? 1 : -1;
+	// hidden in game, so day and night visibility stays with the owners
+	for (ULightComponent* lightComponent : light.lightComponents) {
+		lightComponent->SetHiddenInGame(!isReal);
+	}
+	if (proxyParameter != NAME_None) {
+		for (UPrimitiveComponent* mesh : light.meshComponents) {
+			mesh->SetScalarParameterValueOnMaterials(proxyParameter, isReal ? 0 : 1);
+		}
+	}
+}
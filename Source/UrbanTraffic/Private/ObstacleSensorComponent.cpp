@@ -23,9 +23,19 @@
  */
 
 #include "ObstacleSensorComponent.h"
+#include "UrbanTraffic.h"
+#include "TrafficStats.h"
 #include "Engine/World.h"
+#include "CoreGlobals.h"
 #include "GameFramework/Actor.h"
-#include "Kismet/KismetSystemLibrary.h"
+#include "Components/LineBatchComponent.h"
+
+DECLARE_CYCLE_STAT(TEXT("Sensor Trace"), STAT_UrbanTrafficSensorTrace, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Sensor Async Submit"), STAT_UrbanTrafficSensorSubmit, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Sensor Async Consume"), STAT_UrbanTrafficSensorConsume, STATGROUP_UrbanTraffic);
+
+/* Half height of sweep shapes, in centimeters. */
+static const float SWEEP_HALF_HEIGHT = 20;
 
 UObstacleSensorComponent::UObstacleSensorComponent() {
 	PrimaryComponentTick.bCanEverTick = true;
@@ -37,65 +47,387 @@ UObstacleSensorComponent::UObstacleSensorComponent() {
 
 void UObstacleSensorComponent::OnRegister() {
 	Super::OnRegister();
-	// create hit result array
-	hitResults.Empty();
-	for (int i = 0; i < RayQuantity; i++) {
-		hitResults.Add(FHitResult());
+	allocateResults();
+}
+
+void UObstacleSensorComponent::OnUnregister() {
+	releaseResults();
+	Super::OnUnregister();
+}
+
+void UObstacleSensorComponent::allocateResults() {
+	releaseResults();
+	if (trafficManager.IsValid()) {
+		results = &trafficManager->getSensorResults();
+	}
+	else {
+		results = &localResults;
+	}
+	resultOffset = results->allocate(RayQuantity);
+}
+
+void UObstacleSensorComponent::releaseResults() {
+	if (results != &localResults) {
+		// the buffer dies with its manager
+		if (trafficManager.IsValid()) {
+			results->release(resultOffset, RayQuantity);
+		}
+	}
+	else {
+		localResults.empty();
+	}
+	results = &localResults;
+	resultOffset = 0;
+}
+
+AActor* UObstacleSensorComponent::getHitActor(int ray) {
+	int index = resultOffset + ray;
+	return ray >= 0 && ray < RayQuantity && results->blocking[index] ? results->actors[index].Get() : nullptr;
+}
+
+bool UObstacleSensorComponent::findNearestHit(TFunctionRef<bool(AActor*)> filter, float &distance) {
+	bool found = false;
+	distance = TraceLength.Y;
+	for (int i = 0; i < getQueryCount(); i++) {
+		int index = resultOffset + i;
+		if (results->blocking[index] && results->distances[index] < distance && filter(results->actors[index].Get())) {
+			distance = results->distances[index];
+			found = true;
+		}
 	}
+	return found;
 }
 
 void UObstacleSensorComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) {
 	if (IsActive()) {
-		DoCollisionTest();
+		if (!scheduled) {
+			updateTraces();
+		}
+		else if (AsyncTrace && submitFrame + 1 == GFrameCounter) {
+			// scheduled rays come back, next ones are submitted by the scheduler
+			consumeAsyncTraces();
+		}
 	}
 	if (bVisible) {
-		UWorld* world = GetWorld();
-		for (FHitResult hit : hitResults) {
-			FVector end = hit.bBlockingHit ? hit.Location : hit.TraceEnd;
-			FLinearColor color = hit.bBlockingHit ? FLinearColor::Red : FLinearColor::Green;
-			UKismetSystemLibrary::DrawDebugLine(world, hit.TraceStart, end, color);
+		drawRays();
+	}
+}
+
+void UObstacleSensorComponent::drawRays() {
+	UWorld* world = GetWorld();
+	if (!world || !world->LineBatcher) {
+		return;
+	}
+	debugLines.Reset();
+	for (int i = 0; i < rayStarts.Num(); i++) {
+		int index = resultOffset + i;
+		const FVector &start = rayStarts[i];
+		if (results->blocking[index]) {
+			FVector end = start + (rayEnds[i] - start).GetSafeNormal() * results->distances[index];
+			debugLines.Add(FBatchedLine(start, end, FLinearColor::Red, 0, 0, SDPG_World));
+		}
+		else {
+			debugLines.Add(FBatchedLine(start, rayEnds[i], FLinearColor::Green, 0, 0, SDPG_World));
 		}
 	}
+	world->LineBatcher->DrawLines(debugLines);
 }
 
 bool UObstacleSensorComponent::DoCollisionTest() {
 	obstacleDetected = DoCustomCollisionTest(TraceLength.Y, nearestDistance);
+	resultTime = GetWorld()->GetTimeSeconds();
+	storeCoherentHit();
 	return obstacleDetected;
 }
 
-bool UObstacleSensorComponent::DoCustomCollisionTest(float CustomTraceLength, float &ObstacleDistance) {
-	float hitOffset, hitStep, angleOffset, angleStep;
-	if (hitResults.Num() > 1) {
-		int numSpaces = hitResults.Num() - 1;
-		hitOffset = TraceWidth * -0.5f;
-		hitStep = (TraceWidth / numSpaces);
-		angleOffset = TraceAngle * -0.5f;
-		angleStep = (TraceAngle / numSpaces);
+void UObstacleSensorComponent::updateTraces() {
+	if (AsyncTrace) {
+		// keep last results until first rays come back
+		if (submitFrame != GFrameCounter) {
+			cycleAsyncTraces();
+		}
+	}
+	else if (!updateCoherentHit()) {
+		DoCollisionTest();
+	}
+}
+
+bool UObstacleSensorComponent::cycleAsyncTraces() {
+	bool known = consumeAsyncTraces() || updateCoherentHit();
+	if (!isCoherenceKept()) {
+		// rays come back before extrapolation runs out
+		submitAsyncTraces();
+	}
+	return known;
+}
+
+void UObstacleSensorComponent::storeCoherentHit() {
+	coherentActor = nullptr;
+	if (!CoherenceFrames || !obstacleDetected) {
+		return;
+	}
+	float distance = TraceLength.Y;
+	int nearest = results->findNearest(resultOffset, rayStarts.Num(), distance);
+	AActor* actor = nearest != INDEX_NONE ? results->actors[nearest].Get() : nullptr;
+	if (actor) {
+		coherentActor = actor;
+		coherentPose = actor->GetActorTransform().GetRelativeTransform(GetComponentTransform());
+		coherentDistance = nearestDistance;
+		coherentTime = resultTime;
+		coherentUpdates = 0;
+		coherentRevision = getSceneRevision();
+	}
+}
+
+bool UObstacleSensorComponent::updateCoherentHit() {
+	AActor* actor = coherentActor.Get();
+	if (!actor || coherentUpdates >= CoherenceFrames || coherentRevision != getSceneRevision()) {
+		coherentActor = nullptr;
+		return false;
+	}
+	// the hit stays valid while the actor keeps its place relative to the sensor
+	FTransform pose = actor->GetActorTransform().GetRelativeTransform(GetComponentTransform());
+	if (FVector::DistSquared(pose.GetLocation(), coherentPose.GetLocation()) > CoherenceTolerance * CoherenceTolerance
+		|| FMath::RadiansToDegrees(pose.GetRotation().AngularDistance(coherentPose.GetRotation())) > CoherenceAngle) {
+		coherentActor = nullptr;
+		return false;
+	}
+	float now = GetWorld()->GetTimeSeconds();
+	AActor* owner = GetOwner();
+	FVector relativeVelocity = actor->GetVelocity() - (owner ? owner->GetVelocity() : FVector::ZeroVector);
+	float distance = coherentDistance + FVector::DotProduct(relativeVelocity, GetForwardVector()) * (now - coherentTime);
+	if (distance > TraceLength.Y) {
+		coherentActor = nullptr;
+		return false;
+	}
+	obstacleDetected = true;
+	nearestDistance = FMath::Max(distance, 0.0f);
+	resultTime = now;
+	coherentUpdates++;
+	INC_DWORD_STAT(STAT_UrbanTrafficCoherentUpdates);
+	return true;
+}
+
+bool UObstacleSensorComponent::isCoherenceKept() {
+	return coherentActor.IsValid() && coherentUpdates + 1 < CoherenceFrames;
+}
+
+uint32 UObstacleSensorComponent::getSceneRevision() {
+	return trafficManager.IsValid() ? trafficManager->getSceneRevision() : 0;
+}
+
+void UObstacleSensorComponent::setScheduled(bool isScheduled) {
+	scheduled = isScheduled;
+}
+
+float UObstacleSensorComponent::GetResultAge() {
+	return GetWorld()->GetTimeSeconds() - resultTime;
+}
+
+void UObstacleSensorComponent::computeRay(int index, float length, FVector &start, FVector &end) {
+	float hitOffset = 0, angleOffset = 0;
+	if (RayQuantity > 1) {
+		float alpha = (float)index / (RayQuantity - 1) - 0.5f;
+		hitOffset = TraceWidth * alpha;
+		angleOffset = TraceAngle * alpha;
+	}
+	start = GetComponentLocation() + (GetRightVector() * hitOffset);
+	end = GetForwardVector().RotateAngleAxis(angleOffset, FVector::UpVector) * length + start;
+}
+
+void UObstacleSensorComponent::prepareRays(float length) {
+	if (Shape == SensorShapeType::RayFan) {
+		rayStarts.SetNum(RayQuantity);
+		rayEnds.SetNum(RayQuantity);
+		for (int i = 0; i < RayQuantity; i++) {
+			computeRay(i, length, rayStarts[i], rayEnds[i]);
+		}
 	}
 	else {
-		hitOffset = hitStep = 0;
-		angleOffset = angleStep = 0;
+		// one sweep along the sensor direction, which already follows steering
+		rayStarts.SetNum(1);
+		rayEnds.SetNum(1);
+		rayStarts[0] = GetComponentLocation();
+		rayEnds[0] = GetForwardVector() * length + rayStarts[0];
+	}
+}
+
+FCollisionShape UObstacleSensorComponent::getSweepShape() {
+	float halfWidth = TraceWidth * 0.5f;
+	return Shape == SensorShapeType::BoxSweep ?
+		FCollisionShape::MakeBox(FVector(1, halfWidth, SWEEP_HALF_HEIGHT)) :
+		FCollisionShape::MakeCapsule(halfWidth, FMath::Max(halfWidth, SWEEP_HALF_HEIGHT));
+}
+
+bool UObstacleSensorComponent::traceQuery(int index, bool staticOnly, const FCollisionQueryParams &query) {
+	UWorld* world = GetWorld();
+	FHitResult hit;
+	bool blocking;
+	FCollisionObjectQueryParams objects(ECC_WorldStatic);
+	if (Shape == SensorShapeType::RayFan) {
+		blocking = staticOnly ?
+			world->LineTraceSingleByObjectType(hit, rayStarts[index], rayEnds[index], objects, query) :
+			world->LineTraceSingleByChannel(hit, rayStarts[index], rayEnds[index], CollisionChannel, query);
+	}
+	else {
+		FQuat rotation = GetComponentQuat();
+		blocking = staticOnly ?
+			world->SweepSingleByObjectType(hit, rayStarts[index], rayEnds[index], rotation, objects, getSweepShape(), query) :
+			world->SweepSingleByChannel(hit, rayStarts[index], rayEnds[index], rotation, CollisionChannel, getSweepShape(), query);
+	}
+	if (blocking) {
+		results->setHit(resultOffset + index, hit.Distance, hit.GetActor());
+	}
+	else {
+		results->clearHit(resultOffset + index);
+	}
+	return blocking;
+}
+
+FTraceHandle UObstacleSensorComponent::submitQuery(int index, bool staticOnly, const FCollisionQueryParams &query) {
+	UWorld* world = GetWorld();
+	FCollisionObjectQueryParams objects(ECC_WorldStatic);
+	if (Shape == SensorShapeType::RayFan) {
+		return staticOnly ?
+			world->AsyncLineTraceByObjectType(EAsyncTraceType::Single, rayStarts[index], rayEnds[index], objects, query) :
+			world->AsyncLineTraceByChannel(EAsyncTraceType::Single, rayStarts[index], rayEnds[index], CollisionChannel, query);
+	}
+	FQuat rotation = GetComponentQuat();
+	return staticOnly ?
+		world->AsyncSweepByObjectType(EAsyncTraceType::Single, rayStarts[index], rayEnds[index], rotation, objects, getSweepShape(), query) :
+		world->AsyncSweepByChannel(EAsyncTraceType::Single, rayStarts[index], rayEnds[index], rotation, CollisionChannel, getSweepShape(), query);
+}
+
+bool UObstacleSensorComponent::isPhysicsRequired() {
+	return Backend == SensorBackendType::Physics || !trafficManager.IsValid()
+		|| trafficManager->isPhysicsSensorRequired(GetComponentLocation());
+}
+
+void UObstacleSensorComponent::mergeVirtualHits() {
+	float padding = Shape == SensorShapeType::RayFan ? 0 : TraceWidth * 0.5f;
+	if (trafficManager->traceVirtualRays(rayStarts, rayEnds, GetOwner(), virtualDistances, virtualActors, padding)) {
+		for (int i = 0; i < rayStarts.Num(); i++) {
+			int index = resultOffset + i;
+			float distance = virtualDistances[i];
+			if (virtualActors[i] && (!results->blocking[index] || distance < results->distances[index])) {
+				results->setHit(index, distance, virtualActors[i]);
+			}
+		}
 	}
-	bool detected = false;
-	ObstacleDistance = CustomTraceLength;
+}
+
+bool UObstacleSensorComponent::collectHits(float length, float &distance) {
+	distance = length;
+	return results->findNearest(resultOffset, rayStarts.Num(), distance) != INDEX_NONE;
+}
+
+bool UObstacleSensorComponent::DoCustomCollisionTest(float CustomTraceLength, float &ObstacleDistance) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSensorTrace);
 	FCollisionQueryParams query(TEXT("Sensor_Trace"), false, GetOwner());
 	//FCollisionQueryParams query;
 	//query.AddIgnoredActor(GetOwner());
+	bool fullPhysics = isPhysicsRequired();
+	prepareRays(CustomTraceLength);
+	for (int i = 0; i < rayStarts.Num(); i++) {
+		if (fullPhysics || Backend == SensorBackendType::Hybrid) {
+			// hybrid takes only static world geometry from physics
+			traceQuery(i, !fullPhysics, query);
+			INC_DWORD_STAT(STAT_UrbanTrafficPhysicsQueries);
+		}
+		else {
+			results->clearHit(resultOffset + i);
+		}
+	}
+	if (!fullPhysics) {
+		mergeVirtualHits();
+	}
+	return collectHits(CustomTraceLength, ObstacleDistance);
+}
+
+bool UObstacleSensorComponent::RequestCollisionTest() {
+	if (!AsyncTrace) {
+		return updateCoherentHit() ? obstacleDetected : DoCollisionTest();
+	}
+	if (scheduled && IsActive()) {
+		// the scheduler keeps results fresh enough, their age is known
+		return obstacleDetected;
+	}
+	if (submitFrame != GFrameCounter && !cycleAsyncTraces()) {
+		// nothing known about this space yet, such as the first request after a pause, trace it now
+		DoCollisionTest();
+	}
+	return obstacleDetected;
+}
+
+void UObstacleSensorComponent::submitAsyncTraces() {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSensorSubmit);
+	FCollisionQueryParams query(TEXT("Sensor_Trace"), false, GetOwner());
 	UWorld* world = GetWorld();
-	for (int i = 0; i < hitResults.Num(); i++) {
-		FHitResult* hit = &hitResults[i];
-		FVector start = GetComponentLocation() + (GetRightVector() * hitOffset);
-		FVector end = GetForwardVector().RotateAngleAxis(angleOffset, FVector::UpVector) * CustomTraceLength + start;
-		hitOffset += hitStep;
-		angleOffset += angleStep;
-		if (world->LineTraceSingleByChannel(*hit, start, end, CollisionChannel, query)) {
-			detected = true;
-			if (hit->Distance < ObstacleDistance) {
-				ObstacleDistance = hit->Distance;
-			}
+	traceHandles.Reset();
+	prepareRays(TraceLength.Y);
+	submittedPhysics = isPhysicsRequired();
+	if (submittedPhysics || Backend == SensorBackendType::Hybrid) {
+		for (int i = 0; i < rayStarts.Num(); i++) {
+			traceHandles.Add(submitQuery(i, !submittedPhysics, query));
+		}
+		INC_DWORD_STAT_BY(STAT_UrbanTrafficPhysicsQueries, rayStarts.Num());
+	}
+	// virtual rays are evaluated when consumed, so all backends share the one frame latency
+	pendingTraces = true;
+	submitFrame = GFrameCounter;
+	submitTime = world->GetTimeSeconds();
+}
+
+bool UObstacleSensorComponent::consumeAsyncTraces() {
+	// results are only kept for one frame
+	if (!pendingTraces || submitFrame + 1 != GFrameCounter) {
+		pendingTraces = false;
+		traceHandles.Reset();
+		return false;
+	}
+	pendingTraces = false;
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSensorConsume);
+	UWorld* world = GetWorld();
+	FTraceDatum datum;
+	for (int i = 0; i < rayStarts.Num(); i++) {
+		int index = resultOffset + i;
+		if (!traceHandles.IsValidIndex(i)) {
+			results->clearHit(index);
+		}
+		else if (!world->QueryTraceData(traceHandles[i], datum)) {
+			traceHandles.Reset();
+			return false;
+		}
+		else if (datum.OutHits.Num() && datum.OutHits[0].bBlockingHit) {
+			const FHitResult &hit = datum.OutHits[0];
+			results->setHit(index, hit.Distance, hit.GetActor());
+		}
+		else {
+			results->clearHit(index);
+		}
+	}
+	traceHandles.Reset();
+	if (!submittedPhysics) {
+		mergeVirtualHits();
+	}
+	obstacleDetected = collectHits(TraceLength.Y, nearestDistance);
+	resultTime = submitTime;
+	storeCoherentHit();
+	return true;
+}
+
+int UObstacleSensorComponent::getQueryCount() {
+	return Shape == SensorShapeType::RayFan ? RayQuantity : 1;
+}
+
+void UObstacleSensorComponent::setTrafficManager(AUrbanTraffic* manager) {
+	if (trafficManager.Get() != manager) {
+		releaseResults();
+		trafficManager = manager;
+		if (IsRegistered()) {
+			allocateResults();
 		}
 	}
-	return detected;
 }
 
 void UObstacleSensorComponent::SetActive(bool bNewActive, bool bReset) {
@@ -105,6 +437,7 @@ void UObstacleSensorComponent::SetActive(bool bNewActive, bool bReset) {
 	else */if (!bNewActive) {
 		obstacleDetected = false;
 		nearestDistance = TraceLength.Y;
+		coherentActor = nullptr;
 	}
 	Super::SetActive(bNewActive, bReset);
 }
@@ -34,12 +34,20 @@ URoadNodeCross::URoadNodeCross(URoadSegment* segment, int nextIndex, FVector pos
 URoadNodeCross::~URoadNodeCross() {
 	URoadNode::~URoadNode();
 	portTurns.Empty();
+	zoneTurns.Empty();
+	turnIndices.Empty();
+	turnConflicts.Empty();
+	reservations.Empty();
 }
 
 void URoadNodeCross::compileData() {
 	URoadNode::compileData();
 	// delete previous turn data
 	portTurns.Empty();
+	zoneTurns.Empty();
+	turnIndices.Empty();
+	turnConflicts.Empty();
+	reservations.Empty();
 	// collect all ports
 	TArray<URoadNodePort*> ports;
 	for (URoadNode* node : segment->collectNodes(false)) {
@@ -57,6 +65,34 @@ void URoadNodeCross::compileData() {
 		}
 		portTurns.Add(a, aTurns);
 	}
+	// build conflict matrix
+	TArray<URoadTurn*> turns;
+	TArray<TArray<FVector>> paths;
+	for (TPair<URoadNodePort*, TArray<URoadTurn*>> pair : portTurns) {
+		for (URoadTurn* turn : pair.Value) {
+			turnIndices.Add(turn, turns.Num());
+			turns.Add(turn);
+			paths.Add(turn->collectPathPoints());
+		}
+	}
+	turnConflicts.Init(TBitArray<>(false, turns.Num()), turns.Num());
+	for (int i = 0; i < turns.Num(); i++) {
+		for (int j = i + 1; j < turns.Num(); j++) {
+			bool conflicted = false;
+			if (turns[i]->getStartPort() != turns[j]->getStartPort()) {
+				// merge into same port, or paths cross each other
+				conflicted = turns[i]->getEndPort() == turns[j]->getEndPort();
+				FVector point;
+				for (int a = 0; !conflicted && a < paths[i].Num() - 1; a++) {
+					for (int b = 0; !conflicted && b < paths[j].Num() - 1; b++) {
+						conflicted = FMath::SegmentIntersection2D(paths[i][a], paths[i][a + 1], paths[j][b], paths[j][b + 1], point);
+					}
+				}
+			}
+			turnConflicts[i][j] = conflicted;
+			turnConflicts[j][i] = conflicted;
+		}
+	}
 }
 
 void URoadNodeCross::drawDebug(UWorld* world, uint8 debugFlags) {
@@ -76,4 +112,86 @@ void URoadNodeCross::drawDebug(UWorld* world, uint8 debugFlags) {
 TArray<URoadTurn*> URoadNodeCross::getPortTurns(URoadNodePort* port) {
 	return portTurns.Contains(port) ?
 		portTurns[port] : TArray<URoadTurn*>();
-}
\ No newline at end of file
+}
+
+TrafficLightState URoadNodeCross::getSignalState(URoadNodePort* port, RoadTurnType turnType) {
+	const TArray<URoadTurn*>* turns = portTurns.Find(port);
+	if (turns) {
+		for (URoadTurn* turn : *turns) {
+			if (turn->getTurnType() == turnType) {
+				return turn->getSignalState();
+			}
+		}
+	}
+	return TrafficLightState::Green;
+}
+
+bool URoadNodeCross::isSignalized() {
+	for (const TPair<URoadNodePort*, TArray<URoadTurn*>> &pair : portTurns) {
+		for (URoadTurn* turn : pair.Value) {
+			if (turn->getSignal()) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void URoadNodeCross::setZoneTurns(URoadNodePort* port, TArray<uint8> &&turnIndices) {
+	zoneTurns.Add(port, MoveTemp(turnIndices));
+}
+
+URoadTurn* URoadNodeCross::getZoneTurn(URoadNodePort* port, int zone) {
+	const TArray<uint8>* table = zoneTurns.Find(port);
+	if (!table || !table->IsValidIndex(zone) || (*table)[zone] == ZONE_TURN_NONE) {
+		return nullptr;
+	}
+	const TArray<URoadTurn*>* turns = portTurns.Find(port);
+	return turns && turns->IsValidIndex((*table)[zone]) ? (*turns)[(*table)[zone]] : nullptr;
+}
+
+/* Safety gap between two conflicting slots, in seconds. */
+static const float RESERVATION_CLEARANCE = 0.5f;
+
+bool URoadNodeCross::isConflicted(URoadTurn* a, URoadTurn* b) {
+	const int* aIndex = turnIndices.Find(a);
+	const int* bIndex = turnIndices.Find(b);
+	return aIndex && bIndex && turnConflicts[*aIndex][*bIndex];
+}
+
+bool URoadNodeCross::requestReservation(URoadTurn* turn, AVehicleBase* owner, float now, float enterTime, float exitTime) {
+	const int* turnIndex = turnIndices.Find(turn);
+	if (!turnIndex) {
+		return false;
+	}
+	// drop expired slots and previous slot of the owner
+	reservations.RemoveAllSwap([now, owner](const FRoadReservation &slot) {
+		return slot.exitTime < now || slot.owner == owner;
+	});
+	const TBitArray<> &conflicts = turnConflicts[*turnIndex];
+	for (const FRoadReservation &slot : reservations) {
+		if (conflicts[slot.turnIndex]
+			&& enterTime < slot.exitTime + RESERVATION_CLEARANCE
+			&& slot.enterTime < exitTime + RESERVATION_CLEARANCE) {
+			return false;
+		}
+	}
+	reservations.Add({ owner, *turnIndex, enterTime, exitTime });
+	return true;
+}
+
+bool URoadNodeCross::refreshReservation(AVehicleBase* owner, float exitTime) {
+	for (FRoadReservation &slot : reservations) {
+		if (slot.owner == owner) {
+			slot.exitTime = exitTime;
+			return true;
+		}
+	}
+	return false;
+}
+
+void URoadNodeCross::releaseReservation(AVehicleBase* owner) {
+	reservations.RemoveAllSwap([owner](const FRoadReservation &slot) {
+		return slot.owner == owner;
+	});
+}
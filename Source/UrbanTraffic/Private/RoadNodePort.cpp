@@ -92,27 +92,30 @@ FVector URoadNodePort::computeTarget(int lane, bool invert) {
 	return armVector * laneFactor + position;
 }
 
-RoadTurnType URoadNodePort::appendRoadNodes(TArray<URoadNode*> &roadNodes) {
+RoadTurnType URoadNodePort::appendRoadNodes(TArray<URoadNode*> &roadNodes, FRandomStream &stream, URoadTurn* &turn) {
 	URoadNodeCross* crossNode = segment->getCrossNode();
 	if (crossNode) {
-		TArray<URoadTurn*> turns = crossNode->getPortTurns(this);
-		int rand = FMath::RandRange(0, turns.Num() - 1);
-		URoadTurn* turnData = turns[rand];
-		roadNodes.Append(turnData->collectNodes());
-		return turnData->getTurnType();
+		if (!turn || turn->getStartPort() != this) {
+			TArray<URoadTurn*> turns = crossNode->getPortTurns(this);
+			int rand = stream.RandRange(0, turns.Num() - 1);
+			turn = turns[rand];
+		}
+		roadNodes.Append(turn->collectNodes());
+		return turn->getTurnType();
 	}
 	else {
+		turn = nullptr;
 		bool invert = nextIndex < 0;
 		roadNodes.Append(segment->collectNodes(invert));
 		return RoadTurnType::None;
 	}
 }
 
-int URoadNodePort::randomRightLane(int vehicleLane) {
+int URoadNodePort::randomRightLane(int vehicleLane, FRandomStream &stream) {
 	if (vehicleLane < minRight || vehicleLane > maxRight) {
 		// try maintain current lane
 		// or random new lane when enter narrower segment
-		vehicleLane = FMath::RandRange(minRight, maxRight);
+		vehicleLane = stream.RandRange(minRight, maxRight);
 	}
 	return vehicleLane;
 }
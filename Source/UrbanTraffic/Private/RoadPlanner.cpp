@@ -0,0 +1,217 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "RoadPlanner.h"
+#include "RoadSegment.h"
+#include "RoadTurn.h"
+#include "TrafficStats.h"
+#include "Algo/Reverse.h"
+
+DECLARE_CYCLE_STAT(TEXT("Find Route"), STAT_UrbanTrafficFindRoute, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Build Zone Tables"), STAT_UrbanTrafficZoneTables, STATGROUP_UrbanTraffic);
+
+void URoadPlanner::collectEdges(URoadNodePort* entryPort, TArray<FRoadPlanEdge> &edges) {
+	URoadSegment* segment = entryPort->getSegment();
+	URoadNodeCross* crossNode = segment->getCrossNode();
+	if (crossNode) {
+		// crossing segment, one link per turn
+		for (URoadTurn* turn : crossNode->getPortTurns(entryPort)) {
+			URoadNodePort* nextPort = turn->getEndPort()->getConnectedPort();
+			if (nextPort && nextPort->numRights) {
+				edges.Add({ nextPort, turn, turn->getTravelCost() });
+			}
+		}
+	}
+	else {
+		// straight segment, leave from the opposite port
+		URoadNodePort* exitPort = segment->getExitPort(entryPort->nextIndex < 0);
+		URoadNodePort* nextPort = exitPort ? exitPort->getConnectedPort() : nullptr;
+		if (nextPort && nextPort->numRights) {
+			edges.Add({ nextPort, nullptr, segment->getTravelCost() });
+		}
+	}
+}
+
+/* Open item of the search, ordered by estimated total cost. */
+struct FRoadPlanOpenItem
+{
+	URoadNodePort* port;
+	float estimate;
+
+	bool operator<(const FRoadPlanOpenItem &other) const {
+		return estimate < other.estimate;
+	}
+};
+
+bool URoadPlanner::findRoute(URoadNodePort* startPort, URoadSegment* goalSegment, TArray<URoadTurn*> &turns) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficFindRoute);
+	turns.Reset();
+	if (!startPort || !goalSegment) {
+		return false;
+	}
+	// heuristic: straight distance to the goal never exceeds the travel cost,
+	// since travel cost is length divided by speed limit (<= 1)
+	FVector goalPosition = goalSegment->getNode(0)->position;
+	float goalRadius = goalSegment->getSegmentLength();
+	auto heuristic = [&](URoadNodePort* port) {
+		return FMath::Max(0.0f, FVector::Dist(port->position, goalPosition) - goalRadius);
+	};
+
+	TMap<URoadNodePort*, float> costs;
+	TMap<URoadNodePort*, TPair<URoadNodePort*, URoadTurn*>> parents;
+	TArray<FRoadPlanOpenItem> open;
+	TArray<FRoadPlanEdge> edges;
+	costs.Add(startPort, 0);
+	open.HeapPush({ startPort, heuristic(startPort) });
+	while (open.Num()) {
+		FRoadPlanOpenItem item;
+		open.HeapPop(item);
+		URoadNodePort* port = item.port;
+		float cost = costs[port];
+		if (item.estimate > cost + heuristic(port) + KINDA_SMALL_NUMBER) {
+			continue; // outdated item
+		}
+		INC_DWORD_STAT(STAT_UrbanTrafficRouteNodes);
+		if (port->getSegment() == goalSegment) {
+			// walk back and collect turns
+			while (port != startPort) {
+				const TPair<URoadNodePort*, URoadTurn*> &parent = parents[port];
+				if (parent.Value) {
+					turns.Add(parent.Value);
+				}
+				port = parent.Key;
+			}
+			Algo::Reverse(turns);
+			return true;
+		}
+		edges.Reset();
+		collectEdges(port, edges);
+		for (const FRoadPlanEdge &edge : edges) {
+			float nextCost = cost + edge.cost;
+			float* prevCost = costs.Find(edge.nextPort);
+			if (!prevCost || nextCost < *prevCost) {
+				costs.Add(edge.nextPort, nextCost);
+				parents.Add(edge.nextPort, TPair<URoadNodePort*, URoadTurn*>(port, edge.turn));
+				open.HeapPush({ edge.nextPort, nextCost + heuristic(edge.nextPort) });
+			}
+		}
+	}
+	return false;
+}
+
+/* Reversed link of the port graph, stored at the port it leads to. */
+struct FRoadZoneLink
+{
+	int fromIndex;
+	uint8 turnIndex;
+	float cost;
+};
+
+/* Open item of the zone search, ordered by cost to the zone. */
+struct FRoadZoneOpenItem
+{
+	int index;
+	float cost;
+
+	bool operator<(const FRoadZoneOpenItem &other) const {
+		return cost < other.cost;
+	}
+};
+
+int URoadPlanner::buildZoneTables(const TArray<URoadNodePort*> &ports, const TMap<URoadSegment*, int> &segmentZones, int numZones) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficZoneTables);
+	int numPorts = ports.Num();
+	TMap<URoadNodePort*, int> portIndices;
+	TArray<int> portZones;
+	for (int i = 0; i < numPorts; i++) {
+		portIndices.Add(ports[i], i);
+		const int* zone = segmentZones.Find(ports[i]->getSegment());
+		portZones.Add(zone ? *zone : -1);
+	}
+
+	// collect reversed links, and allocate tables for crossing entry ports
+	TArray<TArray<FRoadZoneLink>> incomings;
+	TArray<TArray<uint8>> tables;
+	incomings.SetNum(numPorts);
+	tables.SetNum(numPorts);
+	TArray<FRoadPlanEdge> edges;
+	for (int i = 0; i < numPorts; i++) {
+		URoadNodeCross* crossNode = ports[i]->getSegment()->getCrossNode();
+		TArray<URoadTurn*> turns;
+		if (crossNode) {
+			turns = crossNode->getPortTurns(ports[i]);
+			tables[i].Init(ZONE_TURN_NONE, numZones);
+		}
+		edges.Reset();
+		collectEdges(ports[i], edges);
+		for (const FRoadPlanEdge &edge : edges) {
+			const int* nextIndex = portIndices.Find(edge.nextPort);
+			int turnIndex = edge.turn ? turns.IndexOfByKey(edge.turn) : ZONE_TURN_NONE;
+			if (nextIndex && turnIndex != INDEX_NONE && turnIndex <= ZONE_TURN_NONE) {
+				incomings[*nextIndex].Add({ i, (uint8)turnIndex, edge.cost });
+			}
+		}
+	}
+
+	// search backward from all entry ports of each zone
+	TArray<float> costs;
+	TArray<FRoadZoneOpenItem> open;
+	for (int zone = 0; zone < numZones; zone++) {
+		costs.Init(MAX_FLT, numPorts);
+		open.Reset();
+		for (int i = 0; i < numPorts; i++) {
+			if (portZones[i] == zone) {
+				costs[i] = 0;
+				open.HeapPush({ i, 0 });
+			}
+		}
+		while (open.Num()) {
+			FRoadZoneOpenItem item;
+			open.HeapPop(item);
+			if (item.cost > costs[item.index]) {
+				continue; // outdated item
+			}
+			for (const FRoadZoneLink &link : incomings[item.index]) {
+				float cost = item.cost + link.cost;
+				if (cost < costs[link.fromIndex]) {
+					costs[link.fromIndex] = cost;
+					if (tables[link.fromIndex].Num()) {
+						tables[link.fromIndex][zone] = link.turnIndex;
+					}
+					open.HeapPush({ link.fromIndex, cost });
+				}
+			}
+		}
+	}
+
+	// store tables on crossings
+	int bytes = 0;
+	for (int i = 0; i < numPorts; i++) {
+		if (tables[i].Num()) {
+			bytes += tables[i].GetAllocatedSize();
+			ports[i]->getSegment()->getCrossNode()->setZoneTurns(ports[i], MoveTemp(tables[i]));
+		}
+	}
+	return bytes;
+}
@@ -36,6 +36,7 @@ URoadSegment::~URoadSegment() {
 	ports.Reset();
 	nodes.Empty();
 	segmentLength = 0;
+	travelCost = 0;
 }
 
 void URoadSegment::compileData(TArray<URoadNode*> newNodes) {
@@ -104,6 +105,11 @@ void URoadSegment::compileData(TArray<URoadNode*> newNodes) {
 		node->distanceToEnd = segmentLength - lengthFromStart;
 		lengthFromStart += node->getNodeLength(false);
 	}
+
+	// calculate travel cost, slower nodes cost more
+	for (URoadNode* node : nodes) {
+		travelCost += node->getNodeLength(false) / FMath::Max(node->speedLimit, 0.1f);
+	}
 }
 
 void URoadSegment::drawDebug(UWorld* world, uint8 debugFlags) {
@@ -151,6 +157,10 @@ float URoadSegment::getSegmentLength() {
 	return segmentLength;
 }
 
+float URoadSegment::getTravelCost() {
+	return travelCost;
+}
+
 URoadNodeCross* URoadSegment::getCrossNode() {
 	return crossNode;
 }
@@ -181,6 +191,13 @@ TArray<URoadNodePort*> URoadSegment::collectEntryPorts() {
 	return rs;
 }
 
+URoadNodePort* URoadSegment::getExitPort(bool invert) {
+	if (ports.Num()) {
+		return invert ? ports[0] : ports.Last();
+	}
+	return nullptr;
+}
+
 int URoadSegment::computeMaxVehicles(int laneDensity) {
 	int totalLanes = 0;
 	for (URoadNodePort* port : ports) {
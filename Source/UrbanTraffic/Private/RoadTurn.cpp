@@ -81,6 +81,15 @@ URoadTurn::URoadTurn(URoadNodePort* startPort, URoadNodeCross* crossNode, URoadN
 		// no turn
 		turnType = RoadTurnType::None;
 	}
+
+	// precomp path length and speed limit
+	FVector prevPosition = startPort->position;
+	for (URoadNodeGuide* node : guideNodes) {
+		turnLength += FVector::Dist(prevPosition, node->position);
+		turnSpeedLimit = FMath::Min(turnSpeedLimit, node->speedLimit);
+		prevPosition = node->position;
+	}
+	turnLength += FVector::Dist(prevPosition, endPort->position);
 }
 
 URoadTurn::~URoadTurn() {
@@ -89,24 +98,11 @@ URoadTurn::~URoadTurn() {
 
 void URoadTurn::drawDebug(UWorld* world, uint8 debugFlags) {
 	if (turnType != RoadTurnType::None) {
-		bool turnRight = (turnType == RoadTurnType::Right);
 		FColor colors[] = { FColor::Black, FColor::Red, FColor::Green };
 		FColor color = colors[(int)turnType];
-		int aLane = turnRight ? startPort->getMaxRight() : startPort->getMinRight();
-		int bLane = turnRight ? endPort->getMaxLeft() : endPort->getMinLeft();
-		FVector startPoint = startPort->computeTarget(aLane, false);
-		FVector endPoint = endPort->computeTarget(bLane, true);
-		if (guideNodes.Num()) {
-			DrawDebugLine(world, startPoint, guideNodes[0]->computeTarget(aLane, false), color, true);
-			for (int i = 0; i < guideNodes.Num() - 1; i++) {
-				FVector from = guideNodes[i]->computeTarget(aLane, false);
-				FVector to = guideNodes[i + 1]->computeTarget(aLane, false);
-				DrawDebugLine(world, from, to, color, true);
-			}
-			DrawDebugLine(world, guideNodes.Last()->computeTarget(aLane, false), endPoint, color, true);
-		}
-		else {
-			DrawDebugLine(world, startPoint, endPoint, color, true);
+		TArray<FVector> points = collectPathPoints();
+		for (int i = 0; i < points.Num() - 1; i++) {
+			DrawDebugLine(world, points[i], points[i + 1], color, true);
 		}
 	}
 }
@@ -130,4 +126,48 @@ URoadNodePort* URoadTurn::getStartPort() {
 
 URoadNodePort* URoadTurn::getEndPort() {
 	return endPort;
-}
\ No newline at end of file
+}
+
+URoadNodeCross* URoadTurn::getCrossNode() {
+	return crossNode;
+}
+
+float URoadTurn::getTurnLength() {
+	return turnLength;
+}
+
+float URoadTurn::getTravelCost() {
+	return turnLength / turnSpeedLimit;
+}
+
+float URoadTurn::getSpeedLimit() {
+	return turnSpeedLimit;
+}
+
+TArray<FVector> URoadTurn::collectPathPoints() {
+	// right turn keeps the outer lane, left turn and straight keep the inner lane
+	bool turnRight = (turnType == RoadTurnType::Right);
+	int aLane = turnRight ? startPort->getMaxRight() : startPort->getMinRight();
+	int bLane = turnRight ? endPort->getMaxLeft() : endPort->getMinLeft();
+	TArray<FVector> points;
+	points.Reserve(guideNodes.Num() + 2);
+	points.Add(startPort->computeTarget(aLane, false));
+	for (URoadNodeGuide* node : guideNodes) {
+		points.Add(node->computeTarget(aLane, false));
+	}
+	points.Add(endPort->computeTarget(bLane, true));
+	return points;
+}
+
+void URoadTurn::setSignal(ATrafficLight* light) {
+	signal = light;
+}
+
+ATrafficLight* URoadTurn::getSignal() {
+	return signal.Get();
+}
+
+TrafficLightState URoadTurn::getSignalState() {
+	ATrafficLight* light = signal.Get();
+	return light ? light->getLightState() : TrafficLightState::Green;
+}
@@ -76,8 +76,8 @@ void ASceneLoader::EndOverlap(UPrimitiveComponent* OverlappedComponent,
 }
 
 void ASceneLoader::setLevelLoaded(bool load) {
-	FString funcName = "RebuildLightSystem";
-	FLatentActionInfo latent(0, 1, *funcName, TrafficManager);
+	// street lamps of the level register to the traffic manager themselves
+	FLatentActionInfo latent;
 	FString lodName = "LOD_" + LevelName.ToString();
 	if (load) {
 		UGameplayStatics::LoadStreamLevel(this, LevelName, true, false, latent);
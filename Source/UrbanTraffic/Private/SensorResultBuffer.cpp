@@ -0,0 +1,78 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SensorResultBuffer.h"
+
+int FSensorResultBuffer::allocate(int count) {
+	int offset;
+	TArray<int>* released = freeRanges.Find(count);
+	if (released && released->Num()) {
+		offset = released->Pop(false);
+	}
+	else {
+		offset = distances.Num();
+		distances.AddZeroed(count);
+		blocking.Add(false, count);
+		actors.AddDefaulted(count);
+	}
+	for (int i = offset; i < offset + count; i++) {
+		clearHit(i);
+	}
+	return offset;
+}
+
+void FSensorResultBuffer::release(int offset, int count) {
+	if (offset + count == distances.Num()) {
+		// the last range shrinks the buffer instead
+		distances.SetNum(offset, false);
+		blocking.RemoveAt(offset, count);
+		actors.SetNum(offset, false);
+	}
+	else {
+		for (int i = offset; i < offset + count; i++) {
+			clearHit(i);
+		}
+		freeRanges.FindOrAdd(count).Add(offset);
+	}
+}
+
+void FSensorResultBuffer::empty() {
+	distances.Empty();
+	blocking.Empty();
+	actors.Empty();
+	freeRanges.Empty();
+}
+
+int FSensorResultBuffer::findNearest(int offset, int count, float &distance) const {
+	int nearest = INDEX_NONE;
+	for (int i = offset; i < offset + count; i++) {
+		if (blocking[i] && (nearest == INDEX_NONE || distances[i] < distances[nearest])) {
+			nearest = i;
+		}
+	}
+	if (nearest != INDEX_NONE) {
+		distance = FMath::Min(distance, distances[nearest]);
+	}
+	return nearest;
+}
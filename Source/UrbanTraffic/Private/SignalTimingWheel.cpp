@@ -0,0 +1,81 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SignalTimingWheel.h"
+#include "TrafficLight.h"
+
+FSignalTimingWheel::FSignalTimingWheel(float slotSeconds, int numSlots) : resolution(slotSeconds) {
+	slots.SetNum(FMath::Max(1, numSlots));
+}
+
+void FSignalTimingWheel::schedule(ATrafficLight* light, float delay) {
+	// due in the next slot at the earliest, time already elapsed in the current slot counts
+	int ticks = FMath::Max(1, FMath::RoundToInt((delay + elapsed) / resolution));
+	FSignalWheelEntry entry;
+	entry.light = light;
+	entry.rounds = (ticks - 1) / slots.Num();
+	slots[(cursor + ticks) % slots.Num()].Add(entry);
+	numEntries++;
+}
+
+void FSignalTimingWheel::remove(ATrafficLight* light) {
+	for (TArray<FSignalWheelEntry> &slot : slots) {
+		for (int i = slot.Num() - 1; i >= 0; i--) {
+			if (slot[i].light.Get() == light) {
+				slot.RemoveAtSwap(i, 1, false);
+				numEntries--;
+			}
+		}
+	}
+}
+
+void FSignalTimingWheel::advance(float deltaSeconds, TArray<ATrafficLight*> &dueLights) {
+	elapsed += deltaSeconds;
+	while (elapsed >= resolution) {
+		elapsed -= resolution;
+		cursor = (cursor + 1) % slots.Num();
+		TArray<FSignalWheelEntry> &slot = slots[cursor];
+		for (int i = slot.Num() - 1; i >= 0; i--) {
+			FSignalWheelEntry &entry = slot[i];
+			if (entry.rounds > 0) {
+				entry.rounds--;
+				continue;
+			}
+			if (ATrafficLight* light = entry.light.Get()) {
+				dueLights.Add(light);
+			}
+			slot.RemoveAtSwap(i, 1, false);
+			numEntries--;
+		}
+	}
+}
+
+void FSignalTimingWheel::empty() {
+	for (TArray<FSignalWheelEntry> &slot : slots) {
+		slot.Reset();
+	}
+	cursor = 0;
+	elapsed = 0;
+	numEntries = 0;
+}
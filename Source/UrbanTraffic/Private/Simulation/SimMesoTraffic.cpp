@@ -0,0 +1,289 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SimMesoTraffic.h"
+
+#include <algorithm>
+#include <cmath>
+
+/* Attempts to find a link with room when spawning. */
+static const int MESO_SPAWN_ATTEMPTS = 16;
+
+/* Left entries a queue keeps before it is compacted. */
+static const int MESO_COMPACT_THRESHOLD = 32;
+
+FSimMesoTraffic::FSimMesoTraffic(const FSimRoadGraph &roadGraph, uint32_t seed) :
+	FSimTrafficModel(roadGraph), spawnState(seed * 2654435761u + 0x9E3779B9u)
+{
+	if (!spawnState) {
+		spawnState = 0x9E3779B9u;
+	}
+	int maxLanes = 1;
+	for (const FSimLink &link : graph.links) {
+		maxLanes = std::max(maxLanes, link.numLanes);
+	}
+	queues.resize(graph.links.size());
+	queueHeads.resize(graph.links.size(), 0);
+	occupiedSpaces.resize(graph.links.size(), 0);
+	dischargeCredits.resize(graph.links.size(), 0);
+	laneBacks.resize(maxLanes);
+}
+
+int FSimMesoTraffic::addVehicle(int link, int lane, float position, float speed, const FSimDriverParams &params) {
+	int id;
+	if (freeIds.size()) {
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else {
+		id = (int)alive.size();
+		alive.push_back(0);
+		links.push_back(0);
+		lanes.push_back(0);
+		nextLinks.push_back(-1);
+		entryTimes.push_back(0);
+		exitTimes.push_back(0);
+		spaces.push_back(0);
+		speedFactors.push_back(1);
+		positions.push_back(0);
+		speeds.push_back(0);
+		randomStates.push_back(0);
+	}
+	const FSimLink &simLink = graph.links[link];
+	alive[id] = 1;
+	spaces[id] = params.length + params.minimumGap;
+	speedFactors[id] = params.speedFactor;
+	nextRandom(spawnState);
+	randomStates[id] = spawnState | 1;
+	position = std::min(std::max(position, 0.0f), simLink.length);
+	enterLink(id, link, lane, position / simLink.length);
+	// keep the given state until the next step derives it
+	positions[id] = position;
+	speeds[id] = std::max(0.0f, speed);
+	numVehicles++;
+	return id;
+}
+
+int FSimMesoTraffic::addRandomVehicle(const FSimDriverParams &params) {
+	for (int attempt = 0; attempt < MESO_SPAWN_ATTEMPTS; attempt++) {
+		int link = randomStraightLink();
+		if (link < 0) {
+			return -1;
+		}
+		if (hasRoom(link, params.length + params.minimumGap)) {
+			const FSimLink &simLink = graph.links[link];
+			int lane = std::min((int)(nextRandom(spawnState) * simLink.numLanes), simLink.numLanes - 1);
+			float position = nextRandom(spawnState) * simLink.length;
+			return addVehicle(link, lane, position, simLink.speedLimit * params.speedFactor, params);
+		}
+	}
+	return -1;
+}
+
+void FSimMesoTraffic::removeVehicle(int id) {
+	if (isAlive(id)) {
+		leaveLink(id);
+		alive[id] = 0;
+		freeIds.push_back(id);
+		numVehicles--;
+	}
+}
+
+void FSimMesoTraffic::clear() {
+	alive.clear();
+	links.clear();
+	lanes.clear();
+	nextLinks.clear();
+	entryTimes.clear();
+	exitTimes.clear();
+	spaces.clear();
+	speedFactors.clear();
+	positions.clear();
+	speeds.clear();
+	randomStates.clear();
+	freeIds.clear();
+	for (std::vector<int> &queue : queues) {
+		queue.clear();
+	}
+	std::fill(queueHeads.begin(), queueHeads.end(), 0);
+	std::fill(occupiedSpaces.begin(), occupiedSpaces.end(), 0.0f);
+	std::fill(dischargeCredits.begin(), dischargeCredits.end(), 0.0f);
+	numVehicles = 0;
+	time = 0;
+	numExited = 0;
+}
+
+void FSimMesoTraffic::step(float deltaSeconds) {
+	if (deltaSeconds <= 0) {
+		return;
+	}
+	time += deltaSeconds;
+	for (int link = 0; link < (int)graph.links.size(); link++) {
+		const FSimLink &simLink = graph.links[link];
+		float &credit = dischargeCredits[link];
+		credit = std::min(credit + deltaSeconds * simLink.numLanes * saturationFlow, (float)simLink.numLanes);
+		std::vector<int> &queue = queues[link];
+		int &head = queueHeads[link];
+		// only the front of the queue may leave, the rest waits behind it
+		while (head < (int)queue.size() && credit >= 1) {
+			int id = queue[head];
+			if (exitTimes[id] > time) {
+				break;
+			}
+			int next = nextLinks[id];
+			if (next >= 0) {
+				int signal = graph.links[next].signal;
+				if (signal >= 0 && graph.signals[signal].getState(time) != 0) {
+					break;
+				}
+				if (!hasRoom(next, spaces[id])) {
+					break;
+				}
+			}
+			head++;
+			credit -= 1;
+			occupiedSpaces[link] -= spaces[id];
+			if (next >= 0) {
+				enterLink(id, next, lanes[id], 0);
+			}
+			else {
+				// dead end
+				numExited++;
+				if (!respawnExited || !respawn(id)) {
+					alive[id] = 0;
+					freeIds.push_back(id);
+					numVehicles--;
+				}
+			}
+		}
+		if (head > MESO_COMPACT_THRESHOLD && head * 2 > (int)queue.size()) {
+			queue.erase(queue.begin(), queue.begin() + head);
+			head = 0;
+		}
+	}
+	updatePositions();
+}
+
+float FSimMesoTraffic::getTravelTime(int link) const {
+	const FSimLink &simLink = graph.links[link];
+	float freeTime = simLink.length / std::max(0.1f, simLink.speedLimit);
+	return freeTime * (1 + bprAlpha * std::pow(getOccupancy(link), bprBeta));
+}
+
+float FSimMesoTraffic::getOccupancy(int link) const {
+	const FSimLink &simLink = graph.links[link];
+	return occupiedSpaces[link] / (simLink.length * simLink.numLanes);
+}
+
+void FSimMesoTraffic::enterLink(int id, int link, int lane, float progress) {
+	const FSimLink &simLink = graph.links[link];
+	float travelTime = getTravelTime(link) / std::max(0.1f, speedFactors[id]);
+	links[id] = link;
+	lanes[id] = std::min(std::max(lane, 0), simLink.numLanes - 1);
+	entryTimes[id] = time - progress * travelTime;
+	exitTimes[id] = entryTimes[id] + travelTime;
+	nextLinks[id] = chooseNextLink(id, link);
+	occupiedSpaces[link] += spaces[id];
+	// vehicles entering mid-link may overtake queued ones, keep the queue ordered by exit time
+	std::vector<int> &queue = queues[link];
+	int index = (int)queue.size();
+	while (index > queueHeads[link] && exitTimes[queue[index - 1]] > exitTimes[id]) {
+		index--;
+	}
+	queue.insert(queue.begin() + index, id);
+}
+
+void FSimMesoTraffic::leaveLink(int id) {
+	int link = links[id];
+	std::vector<int> &queue = queues[link];
+	auto it = std::find(queue.begin() + queueHeads[link], queue.end(), id);
+	if (it != queue.end()) {
+		queue.erase(it);
+		occupiedSpaces[link] -= spaces[id];
+	}
+}
+
+void FSimMesoTraffic::updatePositions() {
+	for (int link = 0; link < (int)graph.links.size(); link++) {
+		const FSimLink &simLink = graph.links[link];
+		const std::vector<int> &queue = queues[link];
+		std::fill(laneBacks.begin(), laneBacks.begin() + simLink.numLanes, simLink.length);
+		for (int i = queueHeads[link]; i < (int)queue.size(); i++) {
+			int id = queue[i];
+			double travelTime = std::max(0.001, exitTimes[id] - entryTimes[id]);
+			float progress = (float)std::min(1.0, (time - entryTimes[id]) / travelTime);
+			float freePosition = progress * simLink.length;
+			// stand behind the vehicle ahead on the same lane
+			float &laneBack = laneBacks[lanes[id]];
+			float position = std::max(0.0f, std::min(freePosition, laneBack));
+			bool moving = progress < 1 && position >= freePosition;
+			positions[id] = position;
+			speeds[id] = moving ? (float)(simLink.length / travelTime) : 0;
+			laneBack = position - spaces[id];
+		}
+	}
+}
+
+bool FSimMesoTraffic::respawn(int id) {
+	for (int attempt = 0; attempt < MESO_SPAWN_ATTEMPTS; attempt++) {
+		int link = randomStraightLink();
+		if (link < 0) {
+			return false;
+		}
+		if (hasRoom(link, spaces[id])) {
+			const FSimLink &simLink = graph.links[link];
+			int lane = std::min((int)(nextRandom(spawnState) * simLink.numLanes), simLink.numLanes - 1);
+			enterLink(id, link, lane, 0);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FSimMesoTraffic::hasRoom(int link, float space) const {
+	const FSimLink &simLink = graph.links[link];
+	return occupiedSpaces[link] + space <= simLink.length * simLink.numLanes;
+}
+
+int FSimMesoTraffic::chooseNextLink(int id, int link) {
+	const FSimLink &simLink = graph.links[link];
+	if (!simLink.numNext) {
+		return -1;
+	}
+	int choice = std::min((int)(nextRandom(randomStates[id]) * simLink.numNext), simLink.numNext - 1);
+	return graph.nextLinks[simLink.firstNext + choice];
+}
+
+int FSimMesoTraffic::randomStraightLink() {
+	if (graph.links.empty()) {
+		return -1;
+	}
+	for (int attempt = 0; attempt < MESO_SPAWN_ATTEMPTS; attempt++) {
+		int link = std::min((int)(nextRandom(spawnState) * graph.links.size()), (int)graph.links.size() - 1);
+		if (!graph.links[link].isTurn) {
+			return link;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,142 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SimRoadGraph.h"
+
+#include <algorithm>
+#include <cmath>
+
+int FSimSignal::getState(double time) const {
+	double phase = std::fmod(time - offset, (double)cycle);
+	if (phase < 0) {
+		phase += cycle;
+	}
+	if (phase < green) {
+		return 0;
+	}
+	return phase < green + yellow ? 1 : 2;
+}
+
+int FSimRoadGraph::addLink(const float* points, int numPoints, int laneCount, float laneWidth, float speedLimit, bool isTurn, int signal) {
+	FSimLink link;
+	link.numLanes = std::max(1, laneCount);
+	link.laneWidth = laneWidth;
+	link.speedLimit = speedLimit;
+	link.isTurn = isTurn;
+	link.signal = signal;
+	link.firstPoint = (int)pointX.size();
+	link.numPoints = numPoints;
+	float length = 0;
+	for (int i = 0; i < numPoints; i++) {
+		const float* p = points + i * 3;
+		if (i > 0) {
+			float dx = p[0] - pointX.back(), dy = p[1] - pointY.back(), dz = p[2] - pointZ.back();
+			length += std::sqrt(dx * dx + dy * dy + dz * dz);
+		}
+		pointX.push_back(p[0]);
+		pointY.push_back(p[1]);
+		pointZ.push_back(p[2]);
+		pointDistance.push_back(length);
+	}
+	// keep a positive length, vehicles would never leave an empty link
+	link.length = std::max(length, 0.1f);
+	links.push_back(link);
+	return (int)links.size() - 1;
+}
+
+int FSimRoadGraph::addSignal(const FSimSignal &signal) {
+	signals.push_back(signal);
+	return (int)signals.size() - 1;
+}
+
+void FSimRoadGraph::connect(int fromLink, int toLink) {
+	connections.emplace_back(fromLink, toLink);
+}
+
+void FSimRoadGraph::finalize() {
+	// group successors by their source link
+	std::sort(connections.begin(), connections.end());
+	connections.erase(std::unique(connections.begin(), connections.end()), connections.end());
+	nextLinks.clear();
+	nextLinks.reserve(connections.size());
+	for (FSimLink &link : links) {
+		link.numNext = 0;
+	}
+	for (const std::pair<int, int> &connection : connections) {
+		FSimLink &link = links[connection.first];
+		if (!link.numNext) {
+			link.firstNext = (int)nextLinks.size();
+		}
+		link.numNext++;
+		nextLinks.push_back(connection.second);
+	}
+	connections.clear();
+	// lay out lanes of all links in one range
+	numLanes = 0;
+	for (FSimLink &link : links) {
+		link.firstLane = numLanes;
+		numLanes += link.numLanes;
+	}
+}
+
+void FSimRoadGraph::clear() {
+	links.clear();
+	nextLinks.clear();
+	signals.clear();
+	pointX.clear();
+	pointY.clear();
+	pointZ.clear();
+	pointDistance.clear();
+	connections.clear();
+	numLanes = 0;
+}
+
+void FSimRoadGraph::locate(int linkIndex, int lane, float distance, float &x, float &y, float &z, float &heading) const {
+	const FSimLink &link = links[linkIndex];
+	int first = link.firstPoint;
+	int last = first + link.numPoints - 1;
+	if (link.numPoints < 2) {
+		x = pointX[first];
+		y = pointY[first];
+		z = pointZ[first];
+		heading = 0;
+		return;
+	}
+	// find the polyline piece holding the distance
+	const float* begin = pointDistance.data() + first + 1;
+	const float* end = pointDistance.data() + last;
+	int a = first + (int)(std::lower_bound(begin, end, distance) - begin);
+	int b = a + 1;
+	float pieceLength = pointDistance[b] - pointDistance[a];
+	float alpha = pieceLength > 0 ? (distance - pointDistance[a]) / pieceLength : 0;
+	alpha = std::min(1.0f, std::max(0.0f, alpha));
+	float dx = pointX[b] - pointX[a], dy = pointY[b] - pointY[a];
+	float planar = std::sqrt(dx * dx + dy * dy);
+	float offset = (lane + link.laneOffset + 0.5f) * link.laneWidth;
+	float rightX = planar > 0 ? -dy / planar : 0, rightY = planar > 0 ? dx / planar : 0;
+	x = pointX[a] + dx * alpha + rightX * offset;
+	y = pointY[a] + dy * alpha + rightY * offset;
+	z = pointZ[a] + (pointZ[b] - pointZ[a]) * alpha;
+	heading = std::atan2(dy, dx);
+}
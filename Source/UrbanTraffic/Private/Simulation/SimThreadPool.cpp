@@ -0,0 +1,101 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SimThreadPool.h"
+
+#include <algorithm>
+
+FSimThreadPool::FSimThreadPool(int numThreads) {
+	if (numThreads <= 0) {
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	for (int i = 1; i < numThreads; i++) {
+		workers.emplace_back(&FSimThreadPool::workerMain, this);
+	}
+}
+
+FSimThreadPool::~FSimThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeup.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+void FSimThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)> &body) {
+	if (count <= 0) {
+		return;
+	}
+	grain = std::max(1, grain);
+	if (workers.empty() || count <= grain) {
+		// not worth waking workers
+		body(0, count);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		loopBody = &body;
+		loopCount = count;
+		loopGrain = grain;
+		nextChunk = 0;
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+	wakeup.notify_all();
+	runChunks();
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busyWorkers == 0; });
+	loopBody = nullptr;
+}
+
+void FSimThreadPool::runChunks() {
+	while (true) {
+		int begin = nextChunk.fetch_add(loopGrain);
+		if (begin >= loopCount) {
+			break;
+		}
+		(*loopBody)(begin, std::min(begin + loopGrain, loopCount));
+	}
+}
+
+void FSimThreadPool::workerMain() {
+	uint64_t seenGeneration = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wakeup.wait(lock, [&] { return stopping || generation != seenGeneration; });
+		if (stopping) {
+			return;
+		}
+		seenGeneration = generation;
+		lock.unlock();
+		runChunks();
+		lock.lock();
+		if (--busyWorkers == 0) {
+			finished.notify_one();
+		}
+	}
+}
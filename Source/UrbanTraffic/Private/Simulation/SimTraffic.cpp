@@ -0,0 +1,423 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SimTraffic.h"
+
+#include <algorithm>
+#include <cmath>
+
+/* Gap reported when nothing is ahead, in meters. */
+static const float SIM_FREE_GAP = 1000;
+
+/* Strongest braking a vehicle can apply, in m/s^2. */
+static const float SIM_MAX_BRAKING = 9;
+
+/* Braking a lane change may force on the new follower, in m/s^2. */
+static const float SIM_SAFE_BRAKING = 4;
+
+/* Interval between lane change evaluations of a vehicle, in seconds. */
+static const float SIM_LANE_CHANGE_INTERVAL = 1;
+
+/* Distance before the end of a link where the speed limit of the next link applies, in meters. */
+static const float SIM_SLOW_ZONE = 40;
+
+/* Lanes and vehicles handled by one task of a parallel loop. */
+static const int SIM_LANE_GRAIN = 64;
+static const int SIM_VEHICLE_GRAIN = 1024;
+
+/* Attempts to find a free lane position when spawning. */
+static const int SIM_SPAWN_ATTEMPTS = 16;
+
+FSimTraffic::FSimTraffic(const FSimRoadGraph &roadGraph, int numThreads, uint32_t seed) :
+	FSimTrafficModel(roadGraph), pool(numThreads), spawnState(seed * 2654435761u + 0x9E3779B9u)
+{
+	if (!spawnState) {
+		spawnState = 0x9E3779B9u;
+	}
+	laneVehicles.resize(graph.numLanes);
+}
+
+int FSimTraffic::addVehicle(int link, int lane, float position, float speed, const FSimDriverParams &driverParams) {
+	int id;
+	if (freeIds.size()) {
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else {
+		id = (int)alive.size();
+		alive.push_back(0);
+		links.push_back(0);
+		lanes.push_back(0);
+		nextLinks.push_back(-1);
+		positions.push_back(0);
+		speeds.push_back(0);
+		accelerations.push_back(0);
+		params.push_back(driverParams);
+		laneChanges.push_back(0);
+		laneChangeTimers.push_back(0);
+		randomStates.push_back(0);
+	}
+	const FSimLink &simLink = graph.links[link];
+	alive[id] = 1;
+	links[id] = link;
+	lanes[id] = std::min(std::max(lane, 0), simLink.numLanes - 1);
+	positions[id] = position;
+	speeds[id] = std::max(0.0f, speed);
+	accelerations[id] = 0;
+	params[id] = driverParams;
+	laneChanges[id] = 0;
+	// each vehicle draws from its own stream, so results do not depend on the thread count
+	nextRandom(spawnState);
+	randomStates[id] = spawnState | 1;
+	// stagger lane change evaluations
+	laneChangeTimers[id] = randomFloat(id) * SIM_LANE_CHANGE_INTERVAL;
+	nextLinks[id] = chooseNextLink(id, link);
+	insertIntoLane(id);
+	numVehicles++;
+	return id;
+}
+
+int FSimTraffic::addRandomVehicle(const FSimDriverParams &driverParams) {
+	if (graph.links.empty()) {
+		return -1;
+	}
+	for (int attempt = 0; attempt < SIM_SPAWN_ATTEMPTS; attempt++) {
+		int link = std::min((int)(nextRandom(spawnState) * graph.links.size()), (int)graph.links.size() - 1);
+		const FSimLink &simLink = graph.links[link];
+		if (simLink.isTurn || simLink.length < driverParams.length * 2) {
+			continue;
+		}
+		int lane = std::min((int)(nextRandom(spawnState) * simLink.numLanes), simLink.numLanes - 1);
+		float position = driverParams.length + nextRandom(spawnState) * (simLink.length - driverParams.length);
+		if (hasRoom(link, lane, position, driverParams.length)) {
+			return addVehicle(link, lane, position, simLink.speedLimit * driverParams.speedFactor * 0.5f, driverParams);
+		}
+	}
+	return -1;
+}
+
+void FSimTraffic::removeVehicle(int id) {
+	if (isAlive(id)) {
+		removeFromLane(id);
+		alive[id] = 0;
+		freeIds.push_back(id);
+		numVehicles--;
+	}
+}
+
+void FSimTraffic::clear() {
+	alive.clear();
+	links.clear();
+	lanes.clear();
+	nextLinks.clear();
+	positions.clear();
+	speeds.clear();
+	accelerations.clear();
+	params.clear();
+	laneChanges.clear();
+	laneChangeTimers.clear();
+	randomStates.clear();
+	freeIds.clear();
+	for (std::vector<int> &vehicles : laneVehicles) {
+		vehicles.clear();
+	}
+	numVehicles = 0;
+	numExited = 0;
+}
+
+void FSimTraffic::step(float deltaSeconds) {
+	if (deltaSeconds <= 0) {
+		return;
+	}
+	stepSeconds = deltaSeconds;
+	// lanes only read each other, every vehicle is written by the task of its own lane
+	pool.parallelFor(graph.numLanes, SIM_LANE_GRAIN, [this](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			updateLane(i);
+		}
+	});
+	// integrate with constant acceleration, vehicles stop instead of rolling backward
+	pool.parallelFor(getCapacity(), SIM_VEHICLE_GRAIN, [this, deltaSeconds](int begin, int end) {
+		for (int id = begin; id < end; id++) {
+			if (!alive[id]) {
+				continue;
+			}
+			float v = speeds[id];
+			float a = accelerations[id];
+			float newSpeed = v + a * deltaSeconds;
+			if (newSpeed < 0) {
+				positions[id] += a < 0 ? -v * v / (2 * a) : 0;
+				speeds[id] = 0;
+			}
+			else {
+				positions[id] += (v + newSpeed) * 0.5f * deltaSeconds;
+				speeds[id] = newSpeed;
+			}
+		}
+	});
+	time += deltaSeconds;
+	applyTransitions();
+}
+
+bool FSimTraffic::hasRoom(int link, int lane, float position, float length) const {
+	int leader, follower;
+	findNeighbours(graph.links[link].firstLane + lane, position, leader, follower);
+	if (leader >= 0 && positions[leader] - params[leader].length - position < params[leader].minimumGap * 0.5f) {
+		return false;
+	}
+	if (follower >= 0 && position - length - positions[follower] < params[follower].minimumGap * 0.5f) {
+		return false;
+	}
+	return true;
+}
+
+void FSimTraffic::updateLane(int laneIndex) {
+	const std::vector<int> &vehicles = laneVehicles[laneIndex];
+	for (int i = 0; i < (int)vehicles.size(); i++) {
+		int id = vehicles[i];
+		const FSimLink &link = graph.links[links[id]];
+		float desiredSpeed = getDesiredSpeed(id);
+		float gap, leaderSpeed;
+		if (i > 0) {
+			int leader = vehicles[i - 1];
+			gap = positions[leader] - params[leader].length - positions[id];
+			leaderSpeed = speeds[leader];
+		}
+		else {
+			findObstacleAhead(id, lanes[id], gap, leaderSpeed);
+		}
+		float acceleration = computeAcceleration(id, desiredSpeed, gap, leaderSpeed);
+		accelerations[id] = acceleration;
+		laneChanges[id] = 0;
+
+		// evaluate lane changes now and then, not on turns or right before the end of the link
+		laneChangeTimers[id] -= stepSeconds;
+		if (laneChangeTimers[id] > 0 || link.numLanes < 2 || link.isTurn ||
+			link.length - positions[id] < SIM_SLOW_ZONE) {
+			continue;
+		}
+		laneChangeTimers[id] += SIM_LANE_CHANGE_INTERVAL;
+		const FSimDriverParams &own = params[id];
+		float bestAdvantage = own.laneChangeThreshold;
+		for (int direction = -1; direction <= 1; direction += 2) {
+			int lane = lanes[id] + direction;
+			if (lane < 0 || lane >= link.numLanes) {
+				continue;
+			}
+			int newLeader, newFollower;
+			findNeighbours(link.firstLane + lane, positions[id], newLeader, newFollower);
+			float newGap, newLeaderSpeed;
+			if (newLeader >= 0) {
+				newGap = positions[newLeader] - params[newLeader].length - positions[id];
+				newLeaderSpeed = speeds[newLeader];
+			}
+			else {
+				findObstacleAhead(id, lane, newGap, newLeaderSpeed);
+			}
+			if (newGap < own.minimumGap) {
+				continue;
+			}
+			if (newFollower >= 0) {
+				// the new follower must not brake hard because of us
+				float backGap = positions[id] - own.length - positions[newFollower];
+				if (backGap < params[newFollower].minimumGap) {
+					continue;
+				}
+				float followerAcceleration = computeAcceleration(newFollower, getDesiredSpeed(newFollower), backGap, speeds[id]);
+				if (followerAcceleration < -SIM_SAFE_BRAKING) {
+					continue;
+				}
+			}
+			float advantage = computeAcceleration(id, desiredSpeed, newGap, newLeaderSpeed) - acceleration;
+			if (advantage > bestAdvantage) {
+				bestAdvantage = advantage;
+				laneChanges[id] = (int8_t)direction;
+			}
+		}
+	}
+}
+
+float FSimTraffic::computeAcceleration(int id, float desiredSpeed, float gap, float leaderSpeed) const {
+	const FSimDriverParams &p = params[id];
+	float v = speeds[id];
+	float ratio = v / std::max(0.1f, desiredSpeed);
+	float ratio2 = ratio * ratio;
+	float dynamicGap = v * p.timeHeadway + v * (v - leaderSpeed) / (2 * std::sqrt(p.maxAcceleration * p.comfortDeceleration));
+	float desiredGap = p.minimumGap + std::max(0.0f, dynamicGap);
+	float gapRatio = desiredGap / std::max(0.1f, gap);
+	return std::max(-SIM_MAX_BRAKING, p.maxAcceleration * (1 - ratio2 * ratio2 - gapRatio * gapRatio));
+}
+
+float FSimTraffic::getDesiredSpeed(int id) const {
+	const FSimLink &link = graph.links[links[id]];
+	float speedLimit = link.speedLimit;
+	int next = nextLinks[id];
+	if (next >= 0 && link.length - positions[id] < SIM_SLOW_ZONE) {
+		speedLimit = std::min(speedLimit, graph.links[next].speedLimit);
+	}
+	return speedLimit * params[id].speedFactor;
+}
+
+void FSimTraffic::findObstacleAhead(int id, int lane, float &gap, float &obstacleSpeed) const {
+	const FSimLink &link = graph.links[links[id]];
+	float remaining = link.length - positions[id];
+	int next = nextLinks[id];
+	gap = SIM_FREE_GAP;
+	obstacleSpeed = speeds[id];
+	if (next < 0) {
+		// leaving the road
+		return;
+	}
+	const FSimLink &nextLink = graph.links[next];
+	if (nextLink.signal >= 0) {
+		int state = graph.signals[nextLink.signal].getState(time);
+		float v = speeds[id];
+		float stopDistance = v * v / (2 * params[id].comfortDeceleration);
+		// stop at red, and at yellow when stopping is still comfortable
+		if (state == 2 || (state == 1 && remaining > stopDistance)) {
+			gap = remaining;
+			obstacleSpeed = 0;
+			return;
+		}
+	}
+	// the last vehicle on the next link
+	const std::vector<int> &nextVehicles = laneVehicles[nextLink.firstLane + std::min(lane, nextLink.numLanes - 1)];
+	if (nextVehicles.size()) {
+		int leader = nextVehicles.back();
+		gap = remaining + positions[leader] - params[leader].length;
+		obstacleSpeed = speeds[leader];
+	}
+}
+
+void FSimTraffic::findNeighbours(int laneIndex, float position, int &leader, int &follower) const {
+	const std::vector<int> &vehicles = laneVehicles[laneIndex];
+	// vehicles are ordered by descending position
+	auto it = std::partition_point(vehicles.begin(), vehicles.end(), [&](int id) {
+		return positions[id] >= position;
+	});
+	leader = it != vehicles.begin() ? *(it - 1) : -1;
+	follower = it != vehicles.end() ? *it : -1;
+}
+
+void FSimTraffic::applyTransitions() {
+	// lane changes, checked again against vehicles that changed before
+	laneChangers.clear();
+	for (const std::vector<int> &vehicles : laneVehicles) {
+		for (int id : vehicles) {
+			if (laneChanges[id]) {
+				laneChangers.push_back(id);
+			}
+		}
+	}
+	for (int id : laneChangers) {
+		int lane = lanes[id] + laneChanges[id];
+		laneChanges[id] = 0;
+		if (hasRoom(links[id], lane, positions[id], params[id].length)) {
+			removeFromLane(id);
+			lanes[id] = lane;
+			insertIntoLane(id);
+		}
+	}
+
+	// move vehicles passing the end of their link, fronts of lanes first
+	for (int laneIndex = 0; laneIndex < graph.numLanes; laneIndex++) {
+		std::vector<int> &vehicles = laneVehicles[laneIndex];
+		while (vehicles.size()) {
+			int id = vehicles.front();
+			const FSimLink &link = graph.links[links[id]];
+			if (positions[id] < link.length) {
+				break;
+			}
+			vehicles.erase(vehicles.begin());
+			int next = nextLinks[id];
+			if (next < 0) {
+				// dead end
+				numExited++;
+				if (!respawnExited || !respawn(id)) {
+					alive[id] = 0;
+					freeIds.push_back(id);
+					numVehicles--;
+				}
+				continue;
+			}
+			const FSimLink &nextLink = graph.links[next];
+			positions[id] -= link.length;
+			links[id] = next;
+			lanes[id] = std::min(lanes[id], nextLink.numLanes - 1);
+			nextLinks[id] = chooseNextLink(id, next);
+			insertIntoLane(id);
+		}
+	}
+}
+
+bool FSimTraffic::respawn(int id) {
+	for (int attempt = 0; attempt < SIM_SPAWN_ATTEMPTS; attempt++) {
+		int link = std::min((int)(nextRandom(spawnState) * graph.links.size()), (int)graph.links.size() - 1);
+		const FSimLink &simLink = graph.links[link];
+		if (simLink.isTurn) {
+			continue;
+		}
+		int lane = std::min((int)(nextRandom(spawnState) * simLink.numLanes), simLink.numLanes - 1);
+		if (hasRoom(link, lane, 0, params[id].length)) {
+			links[id] = link;
+			lanes[id] = lane;
+			positions[id] = 0;
+			speeds[id] = std::min(speeds[id], simLink.speedLimit * params[id].speedFactor);
+			nextLinks[id] = chooseNextLink(id, link);
+			insertIntoLane(id);
+			return true;
+		}
+	}
+	return false;
+}
+
+void FSimTraffic::insertIntoLane(int id) {
+	std::vector<int> &vehicles = laneVehicles[graph.links[links[id]].firstLane + lanes[id]];
+	float position = positions[id];
+	auto it = std::partition_point(vehicles.begin(), vehicles.end(), [&](int other) {
+		return positions[other] >= position;
+	});
+	vehicles.insert(it, id);
+}
+
+void FSimTraffic::removeFromLane(int id) {
+	std::vector<int> &vehicles = laneVehicles[graph.links[links[id]].firstLane + lanes[id]];
+	auto it = std::find(vehicles.begin(), vehicles.end(), id);
+	if (it != vehicles.end()) {
+		vehicles.erase(it);
+	}
+}
+
+int FSimTraffic::chooseNextLink(int id, int link) {
+	const FSimLink &simLink = graph.links[link];
+	if (!simLink.numNext) {
+		return -1;
+	}
+	int choice = std::min((int)(randomFloat(id) * simLink.numNext), simLink.numNext - 1);
+	return graph.nextLinks[simLink.firstNext + choice];
+}
+
+float FSimTraffic::randomFloat(int id) {
+	return nextRandom(randomStates[id]);
+}
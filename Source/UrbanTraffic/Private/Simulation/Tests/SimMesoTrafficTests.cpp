@@ -0,0 +1,175 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#if URBANTRAFFIC_SIMULATION_TESTS
+
+#include "SimTest.h"
+#include "SimMesoTraffic.h"
+
+#include <algorithm>
+
+/* Adds a straight link along the x axis. */
+static int addMesoLink(FSimRoadGraph &graph, float x, float length, int lanes, int signal = -1) {
+	float points[6] = { x, 0, 0, x + length, 0, 0 };
+	return graph.addLink(points, 2, lanes, 3.5f, 14, false, signal);
+}
+
+/* Adds a signal which stays red, or turns green once at a time. */
+static int addRedSignal(FSimRoadGraph &graph, float greenAt = -1) {
+	FSimSignal signal;
+	signal.cycle = 1000;
+	signal.green = greenAt < 0 ? 0 : 100;
+	signal.yellow = 0;
+	signal.offset = greenAt < 0 ? 0 : greenAt;
+	return graph.addSignal(signal);
+}
+
+/* Steps a model for some seconds at 10 Hz. */
+static void stepSeconds(FSimTrafficModel &traffic, float seconds) {
+	for (int frame = 0; frame < (int)(seconds * 10 + 0.5f); frame++) {
+		traffic.step(0.1f);
+	}
+}
+
+SIM_TEST(MesoSaturationDischarge) {
+	FSimRoadGraph graph;
+	int a = addMesoLink(graph, 0, 200, 1);
+	int b = addMesoLink(graph, 200, 500, 1);
+	graph.connect(a, b);
+	graph.finalize();
+	FSimMesoTraffic traffic(graph, 1);
+	traffic.respawnExited = false;
+	const int numVehicles = 20;
+	for (int i = 0; i < numVehicles; i++) {
+		// everyone may leave at once, only the saturation flow holds them back
+		traffic.addVehicle(a, 0, 200, 0, FSimDriverParams());
+	}
+	std::vector<int> arrivals;
+	for (int frame = 0; frame < 300; frame++) {
+		traffic.step(0.1f);
+		for (int id = 0; id < numVehicles; id++) {
+			if (traffic.getLink(id) == b && std::find(arrivals.begin(), arrivals.end(), id) == arrivals.end()) {
+				arrivals.push_back(id);
+			}
+		}
+	}
+	// one vehicle every 2 seconds at 0.5 vehicles per second and lane
+	SIM_CHECK((int)arrivals.size() >= 14 && (int)arrivals.size() <= 15);
+	// first in, first out
+	for (int i = 0; i < (int)arrivals.size(); i++) {
+		SIM_CHECK(arrivals[i] == i);
+	}
+	SIM_CHECK(traffic.num() == numVehicles);
+}
+
+SIM_TEST(MesoBlockedByRed) {
+	FSimRoadGraph graph;
+	int a = addMesoLink(graph, 0, 100, 1);
+	int b = addMesoLink(graph, 100, 100, 1, addRedSignal(graph, 30));
+	graph.connect(a, b);
+	graph.finalize();
+	FSimMesoTraffic traffic(graph, 1);
+	int id = traffic.addVehicle(a, 0, 100, 0, FSimDriverParams());
+	stepSeconds(traffic, 29);
+	SIM_CHECK(traffic.getLink(id) == a);
+	SIM_CHECK_NEAR(traffic.getPosition(id), 100, 1e-3);
+	SIM_CHECK(traffic.getSpeed(id) == 0);
+	stepSeconds(traffic, 2);
+	SIM_CHECK(traffic.getLink(id) == b);
+}
+
+SIM_TEST(MesoBlockedByFullLink) {
+	FSimRoadGraph graph;
+	int a = addMesoLink(graph, 0, 100, 1);
+	// room for one vehicle only, its exit stays red
+	int b = addMesoLink(graph, 100, 10, 1);
+	int c = addMesoLink(graph, 110, 100, 1, addRedSignal(graph));
+	graph.connect(a, b);
+	graph.connect(b, c);
+	graph.finalize();
+	FSimMesoTraffic traffic(graph, 1);
+	int first = traffic.addVehicle(b, 0, 10, 0, FSimDriverParams());
+	int second = traffic.addVehicle(a, 0, 100, 0, FSimDriverParams());
+	SIM_CHECK(traffic.getOccupancy(b) > 0.5f);
+	stepSeconds(traffic, 20);
+	SIM_CHECK(traffic.getLink(first) == b);
+	SIM_CHECK(traffic.getLink(second) == a);
+	// removing the blocker frees the storage
+	traffic.removeVehicle(first);
+	stepSeconds(traffic, 3);
+	SIM_CHECK(traffic.getLink(second) == b);
+}
+
+SIM_TEST(MesoQueuePositions) {
+	FSimRoadGraph graph;
+	int a = addMesoLink(graph, 0, 200, 2);
+	int b = addMesoLink(graph, 200, 100, 2, addRedSignal(graph));
+	graph.connect(a, b);
+	graph.finalize();
+	FSimMesoTraffic traffic(graph, 1);
+	FSimDriverParams params;
+	float space = params.length + params.minimumGap;
+	const int numQueued = 10;
+	for (int i = 0; i < numQueued; i++) {
+		traffic.addVehicle(a, i % 2, 200, 0, params);
+	}
+	// free flowing vehicle far behind the queue
+	int moving = traffic.addVehicle(a, 0, 20, 10, params);
+	traffic.step(0.1f);
+	// queued vehicles stand bumper to bumper on their lane, in queue order
+	for (int i = 0; i < numQueued; i++) {
+		SIM_CHECK(traffic.getLane(i) == i % 2);
+		SIM_CHECK_NEAR(traffic.getPosition(i), 200 - (i / 2) * space, 1e-3);
+		SIM_CHECK(traffic.getSpeed(i) == 0);
+	}
+	SIM_CHECK(traffic.getPosition(moving) > 20 && traffic.getPosition(moving) < 22);
+	SIM_CHECK(traffic.getSpeed(moving) > 0);
+	// catching up with the queue, it stops behind the last vehicle of its lane
+	stepSeconds(traffic, 60);
+	SIM_CHECK_NEAR(traffic.getPosition(moving), 200 - (numQueued / 2) * space, 1e-3);
+	SIM_CHECK(traffic.getSpeed(moving) == 0);
+	for (int id = 0; id < traffic.getCapacity(); id++) {
+		SIM_CHECK(traffic.getPosition(id) >= 0 && traffic.getPosition(id) <= 200);
+	}
+}
+
+SIM_TEST(MesoClearRestarts) {
+	FSimRoadGraph graph;
+	int a = addMesoLink(graph, 0, 100, 1);
+	int b = addMesoLink(graph, 100, 100, 1);
+	graph.connect(a, b);
+	graph.finalize();
+	FSimMesoTraffic traffic(graph, 1);
+	stepSeconds(traffic, 10);
+	traffic.clear();
+	SIM_CHECK(traffic.getTime() == 0);
+	SIM_CHECK(traffic.num() == 0);
+	// no credit is left over from before clearing
+	int id = traffic.addVehicle(a, 0, 100, 0, FSimDriverParams());
+	traffic.step(0.1f);
+	SIM_CHECK(traffic.getLink(id) == a);
+	stepSeconds(traffic, 2);
+	SIM_CHECK(traffic.getLink(id) == b);
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+// Minimal test harness of the standalone simulation build, see CMakeLists.txt.
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+/* A registered test case. */
+struct FSimTestCase
+{
+	const char* name;
+	void (*body)();
+};
+
+/* Registered test cases and the number of failed checks of the running one. */
+std::vector<FSimTestCase>& getSimTestCases();
+int& getSimTestFailures();
+
+/* Registers a test case at static initialization. */
+struct FSimTestRegistrar
+{
+	FSimTestRegistrar(const char* name, void (*body)()) {
+		getSimTestCases().push_back({ name, body });
+	}
+};
+
+#define SIM_TEST(Name) \
+	static void Name(); \
+	static FSimTestRegistrar Name##Registrar(#Name, Name); \
+	static void Name()
+
+#define SIM_CHECK(Condition) \
+	do { \
+		if (!(Condition)) { \
+			std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #Condition); \
+			getSimTestFailures()++; \
+		} \
+	} while (0)
+
+#define SIM_CHECK_NEAR(Value, Expected, Tolerance) \
+	do { \
+		double simValue = (Value), simExpected = (Expected); \
+		if (std::fabs(simValue - simExpected) > (Tolerance)) { \
+			std::printf("%s:%d: check failed: %s is %g, expected %g\n", __FILE__, __LINE__, #Value, simValue, simExpected); \
+			getSimTestFailures()++; \
+		} \
+	} while (0)
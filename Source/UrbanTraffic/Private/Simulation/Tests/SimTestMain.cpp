@@ -0,0 +1,63 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+// Test sources live in the module tree, so the engine build compiles them as empty files.
+#if URBANTRAFFIC_SIMULATION_TESTS
+
+#include "SimTest.h"
+
+#include <cstring>
+
+std::vector<FSimTestCase>& getSimTestCases() {
+	static std::vector<FSimTestCase> cases;
+	return cases;
+}
+
+int& getSimTestFailures() {
+	static int failures = 0;
+	return failures;
+}
+
+/* Runs all test cases, or the ones whose name is given on the command line. */
+int main(int argc, char** argv) {
+	int failedCases = 0, numRun = 0;
+	for (const FSimTestCase &testCase : getSimTestCases()) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; i++) {
+			selected |= std::strcmp(argv[i], testCase.name) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+		getSimTestFailures() = 0;
+		testCase.body();
+		numRun++;
+		bool passed = getSimTestFailures() == 0;
+		failedCases += passed ? 0 : 1;
+		std::printf("[%s] %s\n", passed ? "PASS" : "FAIL", testCase.name);
+	}
+	std::printf("%d of %d test cases passed\n", numRun - failedCases, numRun);
+	return failedCases || !numRun ? 1 : 0;
+}
+
+#endif
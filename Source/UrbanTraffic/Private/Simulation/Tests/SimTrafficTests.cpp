@@ -0,0 +1,249 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#if URBANTRAFFIC_SIMULATION_TESTS
+
+#include "SimTest.h"
+#include "SimTraffic.h"
+
+#include <algorithm>
+
+/* Adds a straight link between two points. */
+static int addStraightLink(FSimRoadGraph &graph, float x0, float y0, float x1, float y1, int lanes, int signal = -1) {
+	float points[6] = { x0, y0, 0, x1, y1, 0 };
+	return graph.addLink(points, 2, lanes, 3.5f, 14, false, signal);
+}
+
+/* Builds a closed ring of square sides, each side split into links of equal length. */
+static void buildRing(FSimRoadGraph &graph, int linksPerSide, float linkLength, int lanes) {
+	static const float directions[4][2] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 } };
+	float x = 0, y = 0;
+	for (int side = 0; side < 4; side++) {
+		for (int i = 0; i < linksPerSide; i++) {
+			float nextX = x + directions[side][0] * linkLength, nextY = y + directions[side][1] * linkLength;
+			addStraightLink(graph, x, y, nextX, nextY, lanes);
+			x = nextX;
+			y = nextY;
+		}
+	}
+	int numLinks = (int)graph.links.size();
+	for (int link = 0; link < numLinks; link++) {
+		graph.connect(link, (link + 1) % numLinks);
+	}
+}
+
+/* Checks that no two vehicles of a lane overlap and every vehicle stays on its link. */
+static void checkLaneOrder(const FSimRoadGraph &graph, const FSimTraffic &traffic) {
+	for (int link = 0; link < (int)graph.links.size(); link++) {
+		for (int lane = 0; lane < graph.links[link].numLanes; lane++) {
+			const std::vector<int> &vehicles = traffic.getLaneVehicles(link, lane);
+			for (int i = 0; i < (int)vehicles.size(); i++) {
+				int id = vehicles[i];
+				SIM_CHECK(traffic.getLink(id) == link && traffic.getLane(id) == lane);
+				SIM_CHECK(traffic.getPosition(id) >= 0 && traffic.getPosition(id) < graph.links[link].length);
+				if (i > 0) {
+					int leader = vehicles[i - 1];
+					SIM_CHECK(traffic.getPosition(leader) - traffic.getParams(leader).length - traffic.getPosition(id) > 0);
+				}
+			}
+		}
+	}
+}
+
+SIM_TEST(GraphFinalize) {
+	FSimRoadGraph graph;
+	float bent[9] = { 0, 0, 0, 3, 4, 0, 3, 4, 12 };
+	int a = graph.addLink(bent, 3, 2, 2, 10, false);
+	int b = addStraightLink(graph, 3, 4, 10, 4, 1);
+	int c = addStraightLink(graph, 3, 4, 3, 10, 3);
+	graph.connect(a, c);
+	graph.connect(a, b);
+	graph.connect(a, b);
+	graph.connect(c, a);
+	graph.finalize();
+
+	SIM_CHECK_NEAR(graph.links[a].length, 17, 1e-4);
+	// successors grouped by source, sorted and without duplicates
+	SIM_CHECK(graph.links[a].numNext == 2);
+	SIM_CHECK(graph.nextLinks[graph.links[a].firstNext] == b);
+	SIM_CHECK(graph.nextLinks[graph.links[a].firstNext + 1] == c);
+	SIM_CHECK(graph.links[b].numNext == 0);
+	SIM_CHECK(graph.links[c].numNext == 1);
+	SIM_CHECK(graph.nextLinks[graph.links[c].firstNext] == a);
+	// lanes of all links laid out in one range
+	SIM_CHECK(graph.links[a].firstLane == 0);
+	SIM_CHECK(graph.links[b].firstLane == 2);
+	SIM_CHECK(graph.links[c].firstLane == 3);
+	SIM_CHECK(graph.numLanes == 6);
+
+	// halfway along the first piece, half a lane to the right of the polyline
+	float x, y, z, heading;
+	graph.locate(a, 0, 2.5f, x, y, z, heading);
+	SIM_CHECK_NEAR(x, 1.5f - 0.8f, 1e-4);
+	SIM_CHECK_NEAR(y, 2 + 0.6f, 1e-4);
+	SIM_CHECK_NEAR(z, 0, 1e-4);
+	SIM_CHECK_NEAR(heading, std::atan2(4.0, 3.0), 1e-4);
+	graph.locate(a, 1, 11, x, y, z, heading);
+	SIM_CHECK_NEAR(z, 6, 1e-4);
+
+	graph.clear();
+	SIM_CHECK(graph.links.empty() && graph.nextLinks.empty() && graph.numLanes == 0);
+}
+
+SIM_TEST(CentredLaneRoundTrip) {
+	// a one-way port of three lanes numbers them from -1, around the centre line
+	FSimRoadGraph graph;
+	int link = addStraightLink(graph, 0, 0, 100, 0, 3);
+	graph.links[link].laneOffset = -1;
+	graph.finalize();
+	FSimTraffic traffic(graph, 1, 1);
+	for (int lane = -1; lane <= 1; lane++) {
+		int id = traffic.addVehicle(link, lane - graph.links[link].laneOffset, 20 + lane * 20, 0, FSimDriverParams());
+		SIM_CHECK(traffic.getLane(id) + graph.links[link].laneOffset == lane);
+		// same place as the lane target of the port
+		float x, y, z, heading;
+		traffic.locate(id, x, y, z, heading);
+		SIM_CHECK_NEAR(y, (lane + 0.5f) * 3.5f, 1e-4);
+	}
+}
+
+SIM_TEST(SignalState) {
+	FSimSignal signal;
+	signal.cycle = 60;
+	signal.offset = 10;
+	signal.green = 27;
+	signal.yellow = 3;
+	SIM_CHECK(signal.getState(10) == 0);
+	SIM_CHECK(signal.getState(36.9) == 0);
+	SIM_CHECK(signal.getState(37.5) == 1);
+	SIM_CHECK(signal.getState(40.5) == 2);
+	SIM_CHECK(signal.getState(69.9) == 2);
+	SIM_CHECK(signal.getState(70) == 0);
+	// before the offset, the previous cycle is running
+	SIM_CHECK(signal.getState(9) == 2);
+	SIM_CHECK(signal.getState(-25) == 0);
+}
+
+SIM_TEST(RingRoadStepping) {
+	FSimRoadGraph graph;
+	buildRing(graph, 2, 50, 1);
+	graph.finalize();
+	FSimTraffic traffic(graph, 2, 1);
+	FSimDriverParams params;
+	const int numVehicles = 20;
+	for (int i = 0; i < numVehicles; i++) {
+		float position = i * 20.0f;
+		traffic.addVehicle((int)(position / 50), 0, std::fmod(position, 50.0f) + 5, 0, params);
+	}
+	checkLaneOrder(graph, traffic);
+	for (int frame = 0; frame < 3000; frame++) {
+		traffic.step(0.1f);
+		if (frame % 100 == 0) {
+			checkLaneOrder(graph, traffic);
+		}
+	}
+	checkLaneOrder(graph, traffic);
+	SIM_CHECK_NEAR(traffic.getTime(), 300, 1e-3);
+	// nobody leaves a closed ring
+	SIM_CHECK(traffic.num() == numVehicles);
+	SIM_CHECK(traffic.getNumExited() == 0);
+	// a ring at 20 m spacing settles near the IDM equilibrium speed, between 8 and 9 m/s
+	float meanSpeed = 0;
+	for (int id = 0; id < traffic.getCapacity(); id++) {
+		SIM_CHECK(traffic.isAlive(id));
+		SIM_CHECK(traffic.getSpeed(id) >= 0 && traffic.getSpeed(id) <= 14 * params.speedFactor + 0.01f);
+		meanSpeed += traffic.getSpeed(id) / numVehicles;
+	}
+	SIM_CHECK(meanSpeed > 6 && meanSpeed < 10);
+}
+
+SIM_TEST(RedSignalStopsRing) {
+	FSimRoadGraph graph;
+	buildRing(graph, 1, 100, 1);
+	FSimSignal red;
+	red.green = 0;
+	red.yellow = 0;
+	graph.links[1].signal = graph.addSignal(red);
+	graph.finalize();
+	FSimTraffic traffic(graph, 1, 1);
+	int id = traffic.addVehicle(0, 0, 10, 10, FSimDriverParams());
+	for (int frame = 0; frame < 600; frame++) {
+		traffic.step(0.1f);
+	}
+	// waits at the stop line of the red link
+	SIM_CHECK(traffic.getLink(id) == 0);
+	SIM_CHECK(traffic.getPosition(id) > 90 && traffic.getPosition(id) < 100);
+	SIM_CHECK_NEAR(traffic.getSpeed(id), 0, 0.1);
+}
+
+/* Runs a branching two lane ring with the same seed, returns the vehicle state. */
+static std::vector<float> runBranchingRing(int numThreads) {
+	FSimRoadGraph graph;
+	buildRing(graph, 24, 40, 2);
+	int numRing = (int)graph.links.size();
+	// bypasses skipping every eighth link, half of them behind a signal
+	FSimSignal signal;
+	signal.cycle = 40;
+	signal.green = 17;
+	int signalIndex = graph.addSignal(signal);
+	for (int link = 0; link < numRing; link += 8) {
+		int skipped = (link + 1) % numRing;
+		const FSimLink &from = graph.links[skipped];
+		float x0 = graph.pointX[from.firstPoint], y0 = graph.pointY[from.firstPoint];
+		float x1 = graph.pointX[from.firstPoint + 1], y1 = graph.pointY[from.firstPoint + 1];
+		int bypass = addStraightLink(graph, x0, y0, x1, y1, 1, link % 16 ? -1 : signalIndex);
+		graph.links[bypass].isTurn = true;
+		graph.connect(link, bypass);
+		graph.connect(bypass, (link + 2) % numRing);
+	}
+	graph.finalize();
+	FSimTraffic traffic(graph, numThreads, 7);
+	FSimDriverParams params;
+	for (int i = 0; i < 400; i++) {
+		params.speedFactor = 0.8f + 0.05f * (i % 8);
+		traffic.addRandomVehicle(params);
+	}
+	for (int frame = 0; frame < 2000; frame++) {
+		traffic.step(0.05f);
+	}
+	std::vector<float> state;
+	for (int id = 0; id < traffic.getCapacity(); id++) {
+		if (traffic.isAlive(id)) {
+			state.push_back((float)id);
+			state.push_back((float)traffic.getLink(id));
+			state.push_back((float)traffic.getLane(id));
+			state.push_back(traffic.getPosition(id));
+			state.push_back(traffic.getSpeed(id));
+		}
+	}
+	return state;
+}
+
+SIM_TEST(DeterministicAcrossThreadCounts) {
+	std::vector<float> single = runBranchingRing(1);
+	std::vector<float> parallel = runBranchingRing(4);
+	SIM_CHECK(single.size() > 0);
+	SIM_CHECK(single == parallel);
+}
+
+#endif
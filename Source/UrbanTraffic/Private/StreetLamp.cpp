@@ -23,6 +23,8 @@
  */
 
 #include "StreetLamp.h"
+#include "UrbanTraffic.h"
+#include "EngineUtils.h"
 
 AStreetLamp::AStreetLamp() {
 	PrimaryActorTick.bCanEverTick = false;
@@ -31,6 +33,24 @@ AStreetLamp::AStreetLamp() {
 	lights->AttachToComponent(RootComponent, FAttachmentTransformRules::KeepRelativeTransform);
 }
 
+void AStreetLamp::BeginPlay() {
+	Super::BeginPlay();
+	// the manager switches lights of lamps by day and night
+	TActorIterator<AUrbanTraffic> it(GetWorld());
+	if (it) {
+		manager = *it;
+		manager->registerStreetLamp(this);
+	}
+}
+
+void AStreetLamp::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	if (manager.IsValid()) {
+		manager->unregisterStreetLamp(this, EndPlayReason == EEndPlayReason::RemovedFromWorld);
+	}
+	manager = nullptr;
+	Super::EndPlay(EndPlayReason);
+}
+
 void AStreetLamp::collectLightComponents(TArray<USceneComponent*> &lightCollection) {
 	TArray<USceneComponent*> lightComponents;
 	lights->GetChildrenComponents(false, lightComponents);
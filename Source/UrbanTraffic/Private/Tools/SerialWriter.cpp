@@ -0,0 +1,178 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "SerialWriter.h"
+#include "UrbanTraffic.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+
+/* Capacity of the packet ring, about a second of packets at the hardware tick rate. */
+static const uint32 SERIAL_QUEUE_CAPACITY = 32;
+
+/* Seconds the writer sleeps when the device is busy. */
+static const float SERIAL_BUSY_WAIT = 0.005f;
+
+/* Milliseconds the writer waits for packets between reconnect checks. */
+static const uint32 SERIAL_RECONNECT_POLL = 100;
+
+/* Seconds before the first reconnect attempt, doubled after each failure. */
+static const float SERIAL_RECONNECT_MIN_DELAY = 0.5f;
+
+/* Longest delay between reconnect attempts, in seconds. */
+static const float SERIAL_RECONNECT_MAX_DELAY = 8;
+
+FSerialWriter::FSerialWriter(const FString &port, uint32 baud) :
+	portName(port), baudrate(baud), queue(SERIAL_QUEUE_CAPACITY)
+{
+	wakeup = FPlatformProcess::GetSynchEventFromPool(false);
+	thread = FRunnableThread::Create(this, *FString::Printf(TEXT("SerialWriter %s"), *port), 0, TPri_BelowNormal);
+}
+
+FSerialWriter::~FSerialWriter() {
+	if (thread) {
+		thread->Kill(true);
+		delete thread;
+	}
+	FPlatformProcess::ReturnSynchEventToPool(wakeup);
+	FSerialWriterStats stats = getStats();
+	UE_LOG(LogUrbanTraffic, Log, TEXT("Serial port %s closed: %u sent, %u coalesced, %u dropped, %u busy writes, %u reconnects"),
+		*portName, stats.sent, stats.coalesced, stats.dropped, stats.busyWrites, stats.reconnects);
+}
+
+bool FSerialWriter::enqueue(SerialPacketKind kind, const uint8* data, uint8 length) {
+	FSerialPacket packet;
+	packet.kind = kind;
+	packet.length = FMath::Min<uint8>(length, sizeof(packet.data));
+	FMemory::Memcpy(packet.data, data, packet.length);
+	if (!queue.Enqueue(packet)) {
+		dropped++;
+		return false;
+	}
+	wakeup->Trigger();
+	return true;
+}
+
+FSerialWriterStats FSerialWriter::getStats() const {
+	FSerialWriterStats stats;
+	stats.sent = sent;
+	stats.coalesced = coalesced;
+	stats.dropped = dropped;
+	stats.busyWrites = busyWrites;
+	stats.reconnects = reconnects;
+	return stats;
+}
+
+void FSerialWriter::Stop() {
+	running = false;
+	wakeup->Trigger();
+}
+
+uint32 FSerialWriter::Run() {
+	serial.open(TCHAR_TO_ANSI(*portName), baudrate);
+	reconnectDelay = SERIAL_RECONNECT_MIN_DELAY;
+	reconnectTime = FPlatformTime::Seconds() + reconnectDelay;
+	while (running) {
+		drainQueue();
+		if (!serial.isConnected()) {
+			connected = false;
+			// the rest of a half written packet would break framing on the new connection
+			hasPending = false;
+			reconnect();
+			wakeup->Wait(SERIAL_RECONNECT_POLL);
+			continue;
+		}
+		connected = true;
+		bool busy = false;
+		while (!busy && (hasPending || takeLatest())) {
+			busy = !writePending();
+		}
+		if (busy) {
+			FPlatformProcess::SleepNoStats(SERIAL_BUSY_WAIT);
+		}
+		else {
+			wakeup->Wait();
+		}
+	}
+	serial.close();
+	connected = false;
+	return 0;
+}
+
+void FSerialWriter::drainQueue() {
+	FSerialPacket packet;
+	while (queue.Dequeue(packet)) {
+		int kind = (int)packet.kind;
+		if (hasLatest[kind]) {
+			coalesced++;
+		}
+		latest[kind] = packet;
+		hasLatest[kind] = true;
+	}
+}
+
+bool FSerialWriter::takeLatest() {
+	for (int kind = 0; kind < (int)SerialPacketKind::Count; kind++) {
+		if (hasLatest[kind]) {
+			pending = latest[kind];
+			pendingOffset = 0;
+			hasPending = true;
+			hasLatest[kind] = false;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FSerialWriter::writePending() {
+	int written = serial.write(pending.data + pendingOffset, pending.length - pendingOffset);
+	if (written < 0) {
+		return false;
+	}
+	pendingOffset += written;
+	if (pendingOffset < pending.length) {
+		busyWrites++;
+		return false;
+	}
+	hasPending = false;
+	sent++;
+	return true;
+}
+
+void FSerialWriter::reconnect() {
+	double now = FPlatformTime::Seconds();
+	if (now < reconnectTime) {
+		return;
+	}
+	reconnects++;
+	serial.open(TCHAR_TO_ANSI(*portName), baudrate);
+	if (serial.isConnected()) {
+		UE_LOG(LogUrbanTraffic, Log, TEXT("Serial port %s reconnected"), *portName);
+		reconnectDelay = SERIAL_RECONNECT_MIN_DELAY;
+	}
+	else {
+		reconnectDelay = FMath::Min(reconnectDelay * 2, SERIAL_RECONNECT_MAX_DELAY);
+	}
+	reconnectTime = now + reconnectDelay;
+}
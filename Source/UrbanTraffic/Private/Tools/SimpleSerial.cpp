@@ -23,146 +23,184 @@
  */
 
 #include "SimpleSerial.h"
+#include "UrbanTraffic.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include "Windows/MinWindows.h"
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 
 SimpleSerial::~SimpleSerial() {
 	close();
 }
 
-void SimpleSerial::open(char* comPort, DWORD baudrate) {
+bool SimpleSerial::isConnected() {
+	return comConnected;
+}
+
+#if PLATFORM_WINDOWS
+
+// ================================================================
+// ===                          WINDOWS                         ===
+// ================================================================
+
+void SimpleSerial::open(const char* comPort, uint32 baudrate) {
 	close();
-	comHandler = CreateFileA(static_cast<LPCSTR>(comPort),
+	comName = ANSI_TO_TCHAR(comPort);
+	HANDLE handle = CreateFileA(comPort,
 		GENERIC_READ | GENERIC_WRITE,
 		0,
 		NULL,
 		OPEN_EXISTING,
 		FILE_ATTRIBUTE_NORMAL,
 		NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot open serial port %s, error %u"), *comName, (uint32)GetLastError());
+		return;
+	}
+	DCB dcbSerialParams = { 0 };
+	dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+	if (!GetCommState(handle, &dcbSerialParams)) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot get parameters of serial port %s, error %u"), *comName, (uint32)GetLastError());
+		CloseHandle(handle);
+		return;
+	}
+	dcbSerialParams.BaudRate = baudrate;
+	dcbSerialParams.ByteSize = 8;
+	dcbSerialParams.StopBits = ONESTOPBIT;
+	dcbSerialParams.Parity = NOPARITY;
+	dcbSerialParams.fDtrControl = DTR_CONTROL_ENABLE;
+	// writes return once the driver buffer is full instead of waiting for the device
+	COMMTIMEOUTS timeouts = { 0 };
+	timeouts.WriteTotalTimeoutConstant = 1;
+	if (!SetCommState(handle, &dcbSerialParams) || !SetCommTimeouts(handle, &timeouts)) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot set serial port %s to %u baud, error %u"), *comName, baudrate, (uint32)GetLastError());
+		CloseHandle(handle);
+		return;
+	}
+	PurgeComm(handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+	comHandler = handle;
+	comConnected = true;
+}
 
-	if (comHandler == INVALID_HANDLE_VALUE) {
-		if (GetLastError() == ERROR_FILE_NOT_FOUND)
-			printf("Warning: Handle was not attached. Reason: %s not available\n", comPort);
-	} else {
-		DCB dcbSerialParams/* = { 0 }*/;
-		if (!GetCommState(comHandler, &dcbSerialParams)) {
-			printf("Warning: Failed to get current serial params");
-		} else {
-			dcbSerialParams.BaudRate = baudrate;
-			dcbSerialParams.ByteSize = 8;
-			dcbSerialParams.StopBits = ONESTOPBIT;
-			dcbSerialParams.Parity = NOPARITY;
-			dcbSerialParams.fDtrControl = DTR_CONTROL_ENABLE;
-			if (!SetCommState(comHandler, &dcbSerialParams)) {
-				printf("Warning: could not set serial port params\n");
-			} else {
-				comConnected = true;
-				PurgeComm(comHandler, PURGE_RXCLEAR | PURGE_TXCLEAR);
-			}
+int SimpleSerial::write(const uint8_t *data, uint32_t length) {
+	if (!comConnected) {
+		return -1;
+	}
+	DWORD written = 0;
+	if (!WriteFile(comHandler, (const void*)data, length, &written, NULL)) {
+		// ClearCommError overwrites the last error code
+		DWORD error = GetLastError();
+		DWORD errors;
+		COMSTAT status;
+		ClearCommError(comHandler, &errors, &status);
+		if (error != ERROR_TIMEOUT) {
+			UE_LOG(LogUrbanTraffic, Error, TEXT("Serial port %s failed, error %u"), *comName, (uint32)error);
+			close();
+			return -1;
 		}
 	}
+	return (int)written;
 }
 
-//void SimpleSerial::CustomSyntax(string syntax_type) {
-//
-//	ifstream syntaxfile_exist("syntax_config.txt");
-//
-//	if (!syntaxfile_exist) {
-//		ofstream syntaxfile;
-//		syntaxfile.open("syntax_config.txt");
-//
-//		if (syntaxfile) {
-//			syntaxfile << "json { }\n";
-//			syntaxfile << "greater_less_than < >\n";
-//			syntaxfile.close();
-//		}
-//	}
-//
-//	syntaxfile_exist.close();
-//
-//	ifstream syntaxfile_in;
-//	syntaxfile_in.open("syntax_config.txt");
-//
-//	string line;
-//	bool found = false;
-//
-//	if (syntaxfile_in.is_open()) {
-//
-//		while (syntaxfile_in) {
-//			syntaxfile_in >> syntax_name_ >> front_delimiter_ >> end_delimiter_;
-//			getline(syntaxfile_in, line);
-//
-//			if (syntax_name_ == syntax_type) {
-//				found = true;
-//				break;
-//			}
-//		}
-//
-//		syntaxfile_in.close();
-//
-//		if (!found) {
-//			syntax_name_ = "";
-//			front_delimiter_ = ' ';
-//			end_delimiter_ = ' ';
-//			printf("Warning: Could not find delimiters, may cause problems!\n");
-//		}
-//	}
-//	else
-//		printf("Warning: No file open");
-//}
-
-//string SimpleSerial::ReadSerialPort(int reply_wait_time, string syntax_type) {
-//
-//	DWORD bytes_read;
-//	char inc_msg[1];
-//	string complete_inc_msg;
-//	bool began = false;
-//
-//	CustomSyntax(syntax_type);
-//
-//	unsigned long start_time = time(nullptr);
-//
-//	ClearCommError(comHandler, &comErrors, &comStatus);
-//
-//	while ((time(nullptr) - start_time) < reply_wait_time) {
-//
-//		if (comStatus.cbInQue > 0) {
-//
-//			if (ReadFile(comHandler, inc_msg, 1, &bytes_read, NULL)) {
-//
-//				if (inc_msg[0] == front_delimiter_ || began) {
-//					began = true;
-//
-//					if (inc_msg[0] == end_delimiter_)
-//						return complete_inc_msg;
-//
-//					if (inc_msg[0] != front_delimiter_)
-//						complete_inc_msg.append(inc_msg, 1);
-//				}
-//			}
-//			else
-//				return "Warning: Failed to receive data.\n";
-//		}
-//	}
-//	return complete_inc_msg;
-//}
-
-int SimpleSerial::write(uint8_t *data, uint32_t length) {
+void SimpleSerial::close() {
 	if (comConnected) {
-		DWORD written;
-		if (!WriteFile(comHandler, (void*)data, length, &written, NULL)) {
-			ClearCommError(comHandler, &comErrors, &comStatus);
+		comConnected = false;
+		CloseHandle(comHandler);
+		comHandler = nullptr;
+	}
+}
+
+#else
+
+// ================================================================
+// ===                      POSIX TERMIOS                       ===
+// ================================================================
+
+/* Gets termios speed of a baud rate, 0 when not supported. */
+static speed_t getTermiosSpeed(uint32 baudrate) {
+	switch (baudrate) {
+	case 1200: return B1200;
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	default: return 0;
+	}
+}
+
+void SimpleSerial::open(const char* comPort, uint32 baudrate) {
+	close();
+	comName = ANSI_TO_TCHAR(comPort);
+	speed_t speed = getTermiosSpeed(baudrate);
+	if (!speed) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Serial port %s does not support %u baud"), *comName, baudrate);
+		return;
+	}
+	// the port never becomes the controlling terminal, writes never block
+	int descriptor = ::open(comPort, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (descriptor < 0) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot open serial port %s: %s"), *comName, ANSI_TO_TCHAR(strerror(errno)));
+		return;
+	}
+	termios options;
+	if (tcgetattr(descriptor, &options) != 0) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot get parameters of serial port %s: %s"), *comName, ANSI_TO_TCHAR(strerror(errno)));
+		::close(descriptor);
+		return;
+	}
+	// raw 8N1 without flow control, same as the Windows settings
+	cfmakeraw(&options);
+	options.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+	options.c_cflag |= CS8 | CLOCAL | CREAD;
+	options.c_cc[VMIN] = 0;
+	options.c_cc[VTIME] = 0;
+	cfsetispeed(&options, speed);
+	cfsetospeed(&options, speed);
+	if (tcsetattr(descriptor, TCSANOW, &options) != 0) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot set serial port %s to %u baud: %s"), *comName, baudrate, ANSI_TO_TCHAR(strerror(errno)));
+		::close(descriptor);
+		return;
+	}
+	tcflush(descriptor, TCIOFLUSH);
+	comDescriptor = descriptor;
+	comConnected = true;
+}
+
+int SimpleSerial::write(const uint8_t *data, uint32_t length) {
+	if (!comConnected) {
+		return -1;
+	}
+	ssize_t written = ::write(comDescriptor, data, length);
+	if (written < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			// output buffer is full, the device is slower than us
+			return 0;
 		}
-		return written;
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Serial port %s failed: %s"), *comName, ANSI_TO_TCHAR(strerror(errno)));
+		close();
+		return -1;
 	}
-	return -1;
+	return (int)written;
 }
 
 void SimpleSerial::close() {
 	if (comConnected) {
 		comConnected = false;
-		CloseHandle(comHandler);
+		::close(comDescriptor);
+		comDescriptor = -1;
 	}
 }
 
-bool SimpleSerial::isConnected() {
-	return comConnected;
-}
\ No newline at end of file
+#endif
@@ -0,0 +1,88 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "SimpleSerial.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && !PLATFORM_WINDOWS
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSimpleSerialPtyTest, "UrbanTraffic.Tools.SimpleSerial.PseudoTerminal",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSimpleSerialPtyTest::RunTest(const FString& Parameters) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || !ptsname(master)) {
+		AddError(TEXT("Cannot open a pseudo-terminal pair"));
+		if (master >= 0) {
+			close(master);
+		}
+		return false;
+	}
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+	SimpleSerial serial;
+	serial.open(ptsname(master), 115200);
+	TestTrue(TEXT("Slave opened"), serial.isConnected());
+	if (!serial.isConnected()) {
+		close(master);
+		return false;
+	}
+
+	// the packet comes out of the master untouched, the slave is raw
+	const uint8_t packet[] = { 0x55, 0xAA, 0x00, 0x0A, 0x0D, 0xFF, 0x7E };
+	TestEqual(TEXT("Packet written"), serial.write(packet, sizeof(packet)), (int)sizeof(packet));
+	uint8_t received[sizeof(packet)];
+	int receivedLength = 0;
+	pollfd masterPoll = { master, POLLIN, 0 };
+	while (receivedLength < (int)sizeof(packet) && poll(&masterPoll, 1, 1000) > 0) {
+		ssize_t length = read(master, received + receivedLength, sizeof(packet) - receivedLength);
+		if (length <= 0) {
+			break;
+		}
+		receivedLength += (int)length;
+	}
+	TestEqual(TEXT("Packet length read back"), receivedLength, (int)sizeof(packet));
+	TestTrue(TEXT("Packet read back"), receivedLength == (int)sizeof(packet) && FMemory::Memcmp(packet, received, sizeof(packet)) == 0);
+
+	// nobody reads the master, the pty buffer fills up and writes report a busy device
+	uint8_t block[1024];
+	FMemory::Memset(block, 0x5A, sizeof(block));
+	int result = 1;
+	for (int i = 0; i < 4096 && result > 0; i++) {
+		result = serial.write(block, sizeof(block));
+	}
+	TestEqual(TEXT("Write returns 0 on a full buffer"), result, 0);
+	TestTrue(TEXT("Still connected on a full buffer"), serial.isConnected());
+
+	serial.close();
+	close(master);
+	return true;
+}
+
+#endif
@@ -0,0 +1,375 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "TrafficBenchmarkCommandlet.h"
+#include "UrbanTraffic.h"
+#include "VehicleBase.h"
+#include "RoadNodePort.h"
+#include "RoadSegment.h"
+#include "RoadPlanner.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "GameFramework/WorldSettings.h"
+#include "Components/StaticMeshComponent.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformProperties.h"
+#include "Misc/App.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/EngineVersion.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+/* Distance from crossing center to its ports, in centimeters. */
+static const float GRID_CROSS_RADIUS = 1200;
+
+/* Distance between normal nodes of grid streets, in centimeters. */
+static const float GRID_NODE_SPACING = 1500;
+
+/* Lane width of grid streets, in centimeters. */
+static const float GRID_LANE_WIDTH = 350;
+
+/* Number of timed road builds. */
+static const int BUILD_REPEATS = 5;
+
+/* Fixed time step of simulation, in seconds. */
+static const float SIMULATION_STEP = 1.0f / 30;
+
+/* Summarizes latency samples in milliseconds: percentiles and throughput. */
+static TSharedPtr<FJsonObject> summarizeSamples(TArray<double> &samples) {
+	TSharedPtr<FJsonObject> summary = MakeShareable(new FJsonObject());
+	samples.Sort();
+	double total = 0;
+	for (double sample : samples) {
+		total += sample;
+	}
+	int count = samples.Num();
+	auto percentile = [&](double ratio) {
+		return count ? samples[FMath::Clamp(FMath::RoundToInt(ratio * (count - 1)), 0, count - 1)] : 0;
+	};
+	summary->SetNumberField(TEXT("count"), count);
+	summary->SetNumberField(TEXT("totalMs"), total);
+	summary->SetNumberField(TEXT("meanMs"), count ? total / count : 0);
+	summary->SetNumberField(TEXT("p50Ms"), percentile(0.5));
+	summary->SetNumberField(TEXT("p90Ms"), percentile(0.9));
+	summary->SetNumberField(TEXT("p99Ms"), percentile(0.99));
+	summary->SetNumberField(TEXT("maxMs"), count ? samples.Last() : 0);
+	summary->SetNumberField(TEXT("perSecond"), total > 0 ? count * 1000 / total : 0);
+	return summary;
+}
+
+UTrafficBenchmarkCommandlet::UTrafficBenchmarkCommandlet() {
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UTrafficBenchmarkCommandlet::Main(const FString& Params) {
+	const TCHAR* params = *Params;
+	int32 gridSize = 24;
+	float gridSpacing = 10000;
+	FString roadFileList, reportPath;
+	FParse::Value(params, TEXT("GridSize="), gridSize);
+	FParse::Value(params, TEXT("GridSpacing="), gridSpacing);
+	FParse::Value(params, TEXT("Queries="), numQueries);
+	FParse::Value(params, TEXT("Routes="), numRoutes);
+	FParse::Value(params, TEXT("Minutes="), simulationMinutes);
+	FParse::Value(params, TEXT("Seed="), seed);
+	FParse::Value(params, TEXT("Vehicle="), vehicleClass);
+	FParse::Value(params, TEXT("RoadFiles="), roadFileList);
+	if (!FParse::Value(params, TEXT("Report="), reportPath)) {
+		reportPath = FPaths::ProjectSavedDir() / TEXT("UrbanTraffic") /
+			FString::Printf(TEXT("Benchmark-%s.json"), *FDateTime::Now().ToString());
+	}
+
+	// reference road files, each benchmarked on its own, then the generated grid city
+	TArray<FString> roadFiles;
+	roadFileList.ParseIntoArray(roadFiles, TEXT("+"), true);
+	FString gridFile = writeGridCity(FMath::Max(gridSize, 2), gridSpacing);
+	roadFiles.Add(gridFile);
+
+	TArray<TSharedPtr<FJsonValue>> maps;
+	for (const FString &roadFile : roadFiles) {
+		UE_LOG(LogUrbanTraffic, Display, TEXT("Benchmarking %s"), *roadFile);
+		TSharedPtr<FJsonObject> map = MakeShareable(new FJsonObject());
+		map->SetStringField(TEXT("roadFile"), roadFile);
+		map->SetObjectField(TEXT("graph"), benchmarkGraph({ roadFile }));
+		if (roadFile == gridFile && simulationMinutes > 0) {
+			map->SetObjectField(TEXT("simulation"), benchmarkSimulation({ roadFile }));
+		}
+		maps.Add(MakeShareable(new FJsonValueObject(map)));
+	}
+
+	// machine readable report, compare runs on the same machine
+	TSharedPtr<FJsonObject> report = MakeShareable(new FJsonObject());
+	report->SetStringField(TEXT("engine"), FEngineVersion::Current().ToString());
+	report->SetStringField(TEXT("platform"), FString(FPlatformProperties::IniPlatformName()));
+	report->SetStringField(TEXT("cpu"), FPlatformMisc::GetCPUBrand());
+	report->SetStringField(TEXT("time"), FDateTime::UtcNow().ToIso8601());
+	report->SetNumberField(TEXT("seed"), seed);
+	report->SetNumberField(TEXT("gridSize"), gridSize);
+	report->SetNumberField(TEXT("gridSpacing"), gridSpacing);
+	report->SetArrayField(TEXT("maps"), maps);
+	FString output;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&output);
+	FJsonSerializer::Serialize(report.ToSharedRef(), writer);
+	if (!FFileHelper::SaveStringToFile(output, *reportPath)) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot write benchmark report %s"), *reportPath);
+		return 1;
+	}
+	UE_LOG(LogUrbanTraffic, Display, TEXT("Benchmark report written to %s"), *reportPath);
+	return 0;
+}
+
+FString UTrafficBenchmarkCommandlet::writeGridCity(int size, float spacing) {
+	// same format as road files: type,next,x,y,z[,laneWidth,numRights,numLefts] and break
+	FString lines;
+	auto addPort = [&](int next, float x, float y) {
+		lines += FString::Printf(TEXT("1,%d,%.1f,%.1f,0,%.1f,1,1\n"), next, x, y, GRID_LANE_WIDTH);
+	};
+	// crossings, one port towards each neighbor, then the cross node
+	for (int i = 0; i < size; i++) {
+		for (int j = 0; j < size; j++) {
+			float x = i * spacing, y = j * spacing;
+			TArray<FVector2D> directions;
+			if (i < size - 1) directions.Add(FVector2D(1, 0));
+			if (j < size - 1) directions.Add(FVector2D(0, 1));
+			if (i > 0) directions.Add(FVector2D(-1, 0));
+			if (j > 0) directions.Add(FVector2D(0, -1));
+			for (const FVector2D &direction : directions) {
+				addPort(directions.Num(), x + direction.X * GRID_CROSS_RADIUS, y + direction.Y * GRID_CROSS_RADIUS);
+			}
+			lines += FString::Printf(TEXT("3,-1,%.1f,%.1f,0\nbreak\n"), x, y);
+		}
+	}
+	// streets between neighbor crossings, ports meet the crossing ports
+	float streetLength = spacing - GRID_CROSS_RADIUS * 2;
+	int numSteps = FMath::Max(2, FMath::RoundToInt(streetLength / GRID_NODE_SPACING));
+	for (int i = 0; i < size; i++) {
+		for (int j = 0; j < size; j++) {
+			for (const FVector2D &direction : { FVector2D(1, 0), FVector2D(0, 1) }) {
+				if ((direction.X && i == size - 1) || (direction.Y && j == size - 1)) {
+					continue;
+				}
+				FVector2D start = FVector2D(i * spacing, j * spacing) + direction * GRID_CROSS_RADIUS;
+				addPort(1, start.X, start.Y);
+				for (int k = 1; k < numSteps; k++) {
+					FVector2D point = start + direction * (streetLength * k / numSteps);
+					lines += FString::Printf(TEXT("2,%d,%.1f,%.1f,0\n"), k + 1, point.X, point.Y);
+				}
+				FVector2D end = start + direction * streetLength;
+				addPort(-1, end.X, end.Y);
+				lines += TEXT("break\n");
+			}
+		}
+	}
+	FString path = FPaths::ProjectSavedDir() / TEXT("UrbanTraffic") / FString::Printf(TEXT("GridCity-%d.txt"), size);
+	FFileHelper::SaveStringToFile(lines, *path);
+	FPaths::MakePathRelativeTo(path, *FPaths::ProjectDir());
+	return path;
+}
+
+AUrbanTraffic* UTrafficBenchmarkCommandlet::createTraffic(const TArray<FString> &roadFiles) {
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("TrafficBenchmark"));
+	FWorldContext &context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	context.SetCurrentWorld(world);
+	// road files must be known before components initialize, which builds the road system
+	AUrbanTraffic* manager = world->SpawnActorDeferred<AUrbanTraffic>(AUrbanTraffic::StaticClass(), FTransform::Identity);
+	manager->RoadFiles = roadFiles;
+	manager->TrafficSeed = seed;
+	manager->FinishSpawning(FTransform::Identity);
+	return manager;
+}
+
+void UTrafficBenchmarkCommandlet::destroyTraffic(AUrbanTraffic* manager) {
+	UWorld* world = manager->GetWorld();
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+TSharedPtr<FJsonObject> UTrafficBenchmarkCommandlet::benchmarkGraph(const TArray<FString> &roadFiles) {
+	TSharedPtr<FJsonObject> result = MakeShareable(new FJsonObject());
+	AUrbanTraffic* manager = createTraffic(roadFiles);
+	FRandomStream stream(seed);
+	TArray<double> samples;
+	double start;
+
+	// road building
+	for (int i = 0; i < BUILD_REPEATS; i++) {
+		start = FPlatformTime::Seconds();
+		manager->buildRoadSystem();
+		samples.Add((FPlatformTime::Seconds() - start) * 1000);
+	}
+	result->SetObjectField(TEXT("buildRoadSystem"), summarizeSamples(samples));
+	result->SetNumberField(TEXT("segments"), manager->roadSegments.Num());
+	result->SetNumberField(TEXT("nodes"), manager->roadNodes.Num());
+	result->SetNumberField(TEXT("ports"), manager->roadPorts.Num());
+	if (!manager->roadNodes.Num()) {
+		destroyTraffic(manager);
+		return result;
+	}
+
+	// nearest node queries inside the road bounds
+	FBox bounds(ForceInit);
+	for (URoadNode* node : manager->roadNodes) {
+		bounds += node->position;
+	}
+	samples.Reset();
+	for (int i = 0; i < numQueries; i++) {
+		FVector position(
+			stream.FRandRange(bounds.Min.X, bounds.Max.X),
+			stream.FRandRange(bounds.Min.Y, bounds.Max.Y),
+			stream.FRandRange(bounds.Min.Z, bounds.Max.Z));
+		start = FPlatformTime::Seconds();
+		manager->findNearestRoadNode(position);
+		samples.Add((FPlatformTime::Seconds() - start) * 1000);
+	}
+	result->SetObjectField(TEXT("findNearestRoadNode"), summarizeSamples(samples));
+
+	// spawn volume expansion around random nodes, without spawning
+	manager->VehicleDensity = 0;
+	samples.Reset();
+	int64 volumeNodes = 0;
+	int numVolumes = FMath::Min(numQueries, manager->roadNodes.Num());
+	for (int i = 0; i < numVolumes; i++) {
+		URoadNode* node = manager->roadNodes[stream.RandRange(0, manager->roadNodes.Num() - 1)];
+		manager->SetSpawnFocus(node->position);
+		start = FPlatformTime::Seconds();
+		manager->updateVehicleSpawnVolume(true);
+		samples.Add((FPlatformTime::Seconds() - start) * 1000);
+		volumeNodes += manager->spawnVolumeNodes.Num();
+	}
+	result->SetObjectField(TEXT("updateVehicleSpawnVolume"), summarizeSamples(samples));
+	result->SetNumberField(TEXT("spawnVolumeNodes"), numVolumes ? (double)volumeNodes / numVolumes : 0);
+
+	// route planning between random entry ports and segments
+	TArray<URoadNodePort*> entryPorts;
+	for (URoadNodePort* port : manager->roadPorts) {
+		if (port->numRights) {
+			entryPorts.Add(port);
+		}
+	}
+	if (entryPorts.Num()) {
+		samples.Reset();
+		int found = 0;
+		int64 turns = 0;
+		TArray<URoadTurn*> route;
+		for (int i = 0; i < numRoutes; i++) {
+			URoadNodePort* startPort = entryPorts[stream.RandRange(0, entryPorts.Num() - 1)];
+			URoadSegment* goal = manager->roadSegments[stream.RandRange(0, manager->roadSegments.Num() - 1)];
+			start = FPlatformTime::Seconds();
+			if (URoadPlanner::findRoute(startPort, goal, route)) {
+				found++;
+				turns += route.Num();
+			}
+			samples.Add((FPlatformTime::Seconds() - start) * 1000);
+		}
+		result->SetObjectField(TEXT("findRoute"), summarizeSamples(samples));
+		result->SetNumberField(TEXT("routesFound"), found);
+		result->SetNumberField(TEXT("routeTurns"), found ? (double)turns / found : 0);
+	}
+
+	// routing tables
+	samples.Reset();
+	for (int i = 0; i < BUILD_REPEATS; i++) {
+		start = FPlatformTime::Seconds();
+		manager->buildRoutingTables();
+		samples.Add((FPlatformTime::Seconds() - start) * 1000);
+	}
+	result->SetObjectField(TEXT("buildRoutingTables"), summarizeSamples(samples));
+	result->SetNumberField(TEXT("routingZones"), manager->numRoutingZones);
+
+	destroyTraffic(manager);
+	return result;
+}
+
+TSharedPtr<FJsonObject> UTrafficBenchmarkCommandlet::benchmarkSimulation(const TArray<FString> &roadFiles) {
+	TSharedPtr<FJsonObject> result = MakeShareable(new FJsonObject());
+	UClass* vehicleType = LoadClass<AVehicleBase>(nullptr, *vehicleClass);
+	if (!vehicleType) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot load vehicle class %s, simulation skipped"), *vehicleClass);
+		return result;
+	}
+	AUrbanTraffic* manager = createTraffic(roadFiles);
+	UWorld* world = manager->GetWorld();
+	manager->VehicleTypes.Add(vehicleType);
+	manager->VehicleDensity = 10;
+
+	// spawn around the center, on a ground covering all roads
+	FBox bounds(ForceInit);
+	for (URoadNode* node : manager->roadNodes) {
+		bounds += node->position;
+	}
+	FVector center = bounds.GetCenter();
+	manager->SetSpawnFocus(center);
+	UStaticMesh* cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	AStaticMeshActor* ground = world->SpawnActor<AStaticMeshActor>(FVector(center.X, center.Y, bounds.Min.Z - 50), FRotator::ZeroRotator);
+	if (ground && cube) {
+		UStaticMeshComponent* mesh = ground->GetStaticMeshComponent();
+		mesh->SetMobility(EComponentMobility::Movable);
+		mesh->SetStaticMesh(cube);
+		FVector size = bounds.GetSize() + FVector(20000, 20000, 0);
+		ground->SetActorScale3D(FVector(size.X / 100, size.Y / 100, 1));
+	}
+
+	// begin play without game mode, then tick with fixed steps
+	world->InitializeActorsForPlay(FURL());
+	world->GetWorldSettings()->NotifyBeginPlay();
+	int numFrames = FMath::CeilToInt(simulationMinutes * 60 / SIMULATION_STEP);
+	TArray<double> samples;
+	samples.Reserve(numFrames);
+	int64 vehicleFrames = 0;
+	int maxVehicles = 0;
+	double wallStart = FPlatformTime::Seconds();
+	for (int i = 0; i < numFrames; i++) {
+		double start = FPlatformTime::Seconds();
+		FApp::SetDeltaTime(SIMULATION_STEP);
+		world->Tick(LEVELTICK_All, SIMULATION_STEP);
+		// deliver routes planned on worker threads
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		GFrameCounter++;
+		samples.Add((FPlatformTime::Seconds() - start) * 1000);
+		vehicleFrames += manager->vehicles.Num();
+		maxVehicles = FMath::Max(maxVehicles, manager->vehicles.Num());
+	}
+	double wallSeconds = FPlatformTime::Seconds() - wallStart;
+	double simulatedSeconds = numFrames * SIMULATION_STEP;
+	result->SetObjectField(TEXT("frame"), summarizeSamples(samples));
+	result->SetNumberField(TEXT("simulatedSeconds"), simulatedSeconds);
+	result->SetNumberField(TEXT("wallSeconds"), wallSeconds);
+	result->SetNumberField(TEXT("realtimeFactor"), wallSeconds > 0 ? simulatedSeconds / wallSeconds : 0);
+	result->SetNumberField(TEXT("averageVehicles"), numFrames ? (double)vehicleFrames / numFrames : 0);
+	result->SetNumberField(TEXT("maxVehicles"), maxVehicles);
+	result->SetNumberField(TEXT("vehicleStepsPerSecond"), wallSeconds > 0 ? vehicleFrames / wallSeconds : 0);
+
+	destroyTraffic(manager);
+	return result;
+}
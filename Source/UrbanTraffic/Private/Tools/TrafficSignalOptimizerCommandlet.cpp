@@ -0,0 +1,342 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "TrafficSignalOptimizerCommandlet.h"
+#include "UrbanTraffic.h"
+#include "TrafficLight.h"
+#include "VehicleBase.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "UObject/Package.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+/* Time step of evaluations, in seconds. */
+static const float OPTIMIZER_STEP = 0.5f;
+
+/* Chance of a candidate trying another common cycle. */
+static const float CYCLE_MUTATION_CHANCE = 0.3f;
+
+/* Largest change of a green split by one mutation. */
+static const float SPLIT_MUTATION = 0.15f;
+
+UTrafficSignalOptimizerCommandlet::UTrafficSignalOptimizerCommandlet() {
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UTrafficSignalOptimizerCommandlet::Main(const FString& Params) {
+	const TCHAR* params = *Params;
+	FString mapName, demandList, cycleList, objective, reportPath;
+	int32 numGenerations = 20;
+	int32 numCandidates = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+	FParse::Value(params, TEXT("Map="), mapName);
+	FParse::Value(params, TEXT("Demand="), demandList);
+	FParse::Value(params, TEXT("Minutes="), simulationMinutes);
+	FParse::Value(params, TEXT("Warmup="), warmupMinutes);
+	FParse::Value(params, TEXT("MinGreen="), minGreen);
+	FParse::Value(params, TEXT("Generations="), numGenerations);
+	FParse::Value(params, TEXT("Candidates="), numCandidates);
+	FParse::Value(params, TEXT("Seed="), seed);
+	if (!FParse::Value(params, TEXT("Cycles="), cycleList)) {
+		cycleList = TEXT("45+60+75+90+120");
+	}
+	if (FParse::Value(params, TEXT("Objective="), objective)) {
+		minimizeDelay = objective != TEXT("Throughput");
+	}
+	if (!FParse::Value(params, TEXT("Report="), reportPath)) {
+		reportPath = FPaths::ProjectSavedDir() / TEXT("UrbanTraffic") /
+			FString::Printf(TEXT("SignalPlan-%s.json"), *FDateTime::Now().ToString());
+	}
+	bool save = FParse::Param(params, TEXT("Save"));
+	numCandidates = FMath::Max(numCandidates, 1);
+	minGreen = FMath::Max(minGreen, 1);
+	TArray<FString> values;
+	cycleList.ParseIntoArray(values, TEXT("+"), true);
+	for (const FString &value : values) {
+		cycles.Add(FMath::Max(FCString::Atoi(*value), 1));
+	}
+
+	if (mapName.IsEmpty()) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Missing -Map=<long package name> of the map to optimize"));
+		return 1;
+	}
+	manager = loadTraffic(mapName);
+	if (!manager) {
+		return 1;
+	}
+	if (!masters.Num()) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("No traffic light of %s is bound to a crossing"), *mapName);
+		return 1;
+	}
+	// demand defaults to the simulated vehicles of the traffic manager
+	demandList.ParseIntoArray(values, TEXT("+"), true);
+	for (const FString &value : values) {
+		demand.Add(FMath::Max(FCString::Atoi(*value), 0));
+	}
+	if (!demand.Num()) {
+		demand.Add(manager->SimulatedVehicles);
+	}
+	AVehicleBase* defaultVehicle = manager->VehicleTypes.Num() && manager->VehicleTypes[0] ?
+		manager->VehicleTypes[0]->GetDefaultObject<AVehicleBase>() : nullptr;
+	driverParams = manager->getSimDriverParams(defaultVehicle);
+
+	// current timing of the lights, then the same splits on every candidate cycle
+	TArray<FSignalPlanPeriods> currentPlan;
+	for (ATrafficLight* master : masters) {
+		float greenStart, green, yellow;
+		master->getSignalWindow(greenStart, green, yellow);
+		currentPlan.Add({ master->getCycleLength() - (int)green - (int)yellow, (int)yellow, (int)green });
+	}
+	TArray<TArray<FSignalPlanPeriods>> candidates;
+	candidates.Add(currentPlan);
+	for (int cycle : cycles) {
+		TArray<FSignalPlanPeriods> &candidate = candidates.AddDefaulted_GetRef();
+		for (const FSignalPlanPeriods &periods : currentPlan) {
+			candidate.Add(makePeriods(cycle, getSplit(periods), periods.yellow));
+		}
+	}
+
+	// (1 + lambda) evolution, all candidates of a generation run in parallel on the same traffic
+	FRandomStream stream(seed);
+	TArray<FSignalPlanPeriods> bestPlan = currentPlan;
+	double currentCost = 0, bestCost = 0;
+	TArray<double> costs;
+	double wallStart = FPlatformTime::Seconds();
+	for (int generation = 0; generation <= numGenerations; generation++) {
+		if (generation > 0) {
+			candidates.SetNum(numCandidates);
+			for (TArray<FSignalPlanPeriods> &candidate : candidates) {
+				mutatePlan(bestPlan, stream, candidate);
+			}
+		}
+		costs.SetNum(candidates.Num());
+		ParallelFor(candidates.Num(), [&](int32 i) {
+			costs[i] = evaluatePlan(candidates[i]);
+		});
+		if (generation == 0) {
+			currentCost = bestCost = costs[0];
+		}
+		for (int i = 0; i < candidates.Num(); i++) {
+			if (costs[i] < bestCost) {
+				bestCost = costs[i];
+				bestPlan = candidates[i];
+			}
+		}
+		UE_LOG(LogUrbanTraffic, Display, TEXT("Generation %d: best cost %.2f, current timing %.2f"), generation, bestCost, currentCost);
+	}
+	double wallSeconds = FPlatformTime::Seconds() - wallStart;
+	if (!applyPlan(bestPlan, save)) {
+		return 1;
+	}
+
+	// machine readable plan, costs are vehicle hours of delay or negative vehicle kilometers
+	TArray<TSharedPtr<FJsonValue>> lights;
+	for (int i = 0; i < masters.Num(); i++) {
+		TSharedPtr<FJsonObject> light = MakeShareable(new FJsonObject());
+		light->SetStringField(TEXT("name"), masters[i]->GetPathName());
+		light->SetNumberField(TEXT("red"), bestPlan[i].red);
+		light->SetNumberField(TEXT("yellow"), bestPlan[i].yellow);
+		light->SetNumberField(TEXT("green"), bestPlan[i].green);
+		lights.Add(MakeShareable(new FJsonValueObject(light)));
+	}
+	TSharedPtr<FJsonObject> report = MakeShareable(new FJsonObject());
+	report->SetStringField(TEXT("map"), mapName);
+	report->SetStringField(TEXT("objective"), minimizeDelay ? TEXT("Delay") : TEXT("Throughput"));
+	report->SetNumberField(TEXT("seed"), seed);
+	report->SetNumberField(TEXT("currentCost"), currentCost);
+	report->SetNumberField(TEXT("bestCost"), bestCost);
+	report->SetNumberField(TEXT("wallSeconds"), wallSeconds);
+	report->SetArrayField(TEXT("lights"), lights);
+	FString output;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&output);
+	FJsonSerializer::Serialize(report.ToSharedRef(), writer);
+	if (!FFileHelper::SaveStringToFile(output, *reportPath)) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot write signal plan %s"), *reportPath);
+		return 1;
+	}
+	UE_LOG(LogUrbanTraffic, Display, TEXT("Signal plan written to %s"), *reportPath);
+	return 0;
+}
+
+AUrbanTraffic* UTrafficSignalOptimizerCommandlet::loadTraffic(const FString &mapName) {
+	UPackage* package = LoadPackage(nullptr, *mapName, LOAD_None);
+	UWorld* world = package ? UWorld::FindWorldInPackage(package) : nullptr;
+	if (!world) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot load map %s"), *mapName);
+		return nullptr;
+	}
+	// an editor world is enough, nothing begins play
+	world->AddToRoot();
+	world->WorldType = EWorldType::Editor;
+	if (!world->bIsWorldInitialized) {
+		world->InitWorld(UWorld::InitializationValues()
+			.AllowAudioPlayback(false)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.ShouldSimulatePhysics(false));
+	}
+	world->UpdateWorldComponents(true, false);
+	TActorIterator<AUrbanTraffic> it(world);
+	if (!it) {
+		UE_LOG(LogUrbanTraffic, Error, TEXT("%s has no traffic manager"), *mapName);
+		return nullptr;
+	}
+	AUrbanTraffic* traffic = *it;
+	traffic->buildRoadSystem();
+	// lights of streaming levels are not loaded, only the persistent level is optimized
+	for (TActorIterator<ATrafficLight> light(world); light; ++light) {
+		traffic->bindTrafficLight(*light);
+	}
+	traffic->compileSimulationGraph();
+	for (const TPair<ATrafficLight*, int> &pair : traffic->simSignalsByLight) {
+		if (pair.Value < 0) {
+			continue;
+		}
+		ATrafficLight* master = pair.Key->getSignalMaster();
+		int index = masters.AddUnique(master);
+		bindings.Add({ pair.Key, pair.Value, index, master->getSignalPhase() });
+	}
+	UE_LOG(LogUrbanTraffic, Display, TEXT("Optimizing %d signals of %d lights on %d links"),
+		masters.Num(), bindings.Num(), (int)traffic->simGraph.links.size());
+	return traffic;
+}
+
+double UTrafficSignalOptimizerCommandlet::evaluatePlan(const TArray<FSignalPlanPeriods> &plan) const {
+	FSimRoadGraph graph = manager->simGraph;
+	for (const FSignalPlanBinding &binding : bindings) {
+		const FSignalPlanPeriods &periods = plan[binding.master];
+		FSimSignal &signal = graph.signals[binding.signal];
+		float greenStart;
+		binding.light->getSignalWindow(periods.red, periods.yellow, periods.green, greenStart, signal.green, signal.yellow);
+		signal.cycle = periods.red + periods.yellow + periods.green;
+		signal.offset = greenStart - binding.phase;
+	}
+	// single threaded, evaluations run in parallel instead
+	FSimTraffic traffic(graph, 1, (uint32)seed);
+	FRandomStream stream(seed);
+	int numWarmup = FMath::CeilToInt(warmupMinutes * 60 / OPTIMIZER_STEP);
+	int numMeasured = FMath::Max(1, FMath::CeilToInt(simulationMinutes * 60 / OPTIMIZER_STEP));
+	double cost = 0;
+	for (int i = 0; i < numWarmup + numMeasured; i++) {
+		// demand periods split the measured time, the warmup runs the first one
+		int period = FMath::Clamp((i - numWarmup) * demand.Num() / numMeasured, 0, demand.Num() - 1);
+		while (traffic.num() < demand[period]) {
+			FSimDriverParams params = driverParams;
+			params.speedFactor = stream.FRandRange(0.9f, 1.1f);
+			if (traffic.addRandomVehicle(params) < 0) {
+				break;
+			}
+		}
+		for (int id = traffic.getCapacity() - 1; id >= 0 && traffic.num() > demand[period]; id--) {
+			if (traffic.isAlive(id)) {
+				traffic.removeVehicle(id);
+			}
+		}
+		traffic.step(OPTIMIZER_STEP);
+		if (i < numWarmup) {
+			continue;
+		}
+		for (int id = 0; id < traffic.getCapacity(); id++) {
+			if (!traffic.isAlive(id)) {
+				continue;
+			}
+			float speed = traffic.getSpeed(id);
+			if (minimizeDelay) {
+				float speedLimit = graph.links[traffic.getLink(id)].speedLimit;
+				cost += FMath::Max(0.0f, 1 - speed / speedLimit) * OPTIMIZER_STEP / 3600;
+			}
+			else {
+				cost -= speed * OPTIMIZER_STEP / 1000;
+			}
+		}
+	}
+	return cost;
+}
+
+void UTrafficSignalOptimizerCommandlet::mutatePlan(const TArray<FSignalPlanPeriods> &plan, FRandomStream &stream, TArray<FSignalPlanPeriods> &candidate) const {
+	candidate = plan;
+	// a common cycle keeps offsets between crossings meaningful
+	if (cycles.Num() && stream.FRand() < CYCLE_MUTATION_CHANCE) {
+		int cycle = cycles[stream.RandRange(0, cycles.Num() - 1)];
+		for (FSignalPlanPeriods &periods : candidate) {
+			periods = makePeriods(cycle, getSplit(periods), periods.yellow);
+		}
+		return;
+	}
+	float chance = FMath::Min(1.0f, 2.0f / candidate.Num());
+	for (FSignalPlanPeriods &periods : candidate) {
+		if (stream.FRand() < chance) {
+			float split = getSplit(periods) + stream.FRandRange(-SPLIT_MUTATION, SPLIT_MUTATION);
+			periods = makePeriods(periods.red + periods.yellow + periods.green, split, periods.yellow);
+		}
+	}
+}
+
+FSignalPlanPeriods UTrafficSignalOptimizerCommandlet::makePeriods(int cycle, float split, int yellow) const {
+	// both greens share the cycle less a yellow each
+	int greens = FMath::Max(cycle - yellow * 2, minGreen * 2);
+	int green = FMath::Clamp(FMath::RoundToInt(split * greens), minGreen, greens - minGreen);
+	return { greens - green + yellow, yellow, green };
+}
+
+float UTrafficSignalOptimizerCommandlet::getSplit(const FSignalPlanPeriods &periods) const {
+	int greens = periods.green + periods.red - periods.yellow;
+	return greens > 0 ? (float)periods.green / greens : 0.5f;
+}
+
+bool UTrafficSignalOptimizerCommandlet::applyPlan(const TArray<FSignalPlanPeriods> &plan, bool save) {
+	TSet<UPackage*> packages;
+	for (int i = 0; i < masters.Num(); i++) {
+		masters[i]->Modify();
+		masters[i]->SetSignalPeriods(plan[i].red, plan[i].yellow, plan[i].green);
+		packages.Add(masters[i]->GetOutermost());
+	}
+	if (!save) {
+		return true;
+	}
+#if WITH_EDITOR
+	for (UPackage* package : packages) {
+		FString filename = FPackageName::LongPackageNameToFilename(package->GetName(), FPackageName::GetMapPackageExtension());
+		if (!UPackage::SavePackage(package, UWorld::FindWorldInPackage(package), RF_Standalone, *filename)) {
+			UE_LOG(LogUrbanTraffic, Error, TEXT("Cannot save %s"), *filename);
+			return false;
+		}
+		UE_LOG(LogUrbanTraffic, Display, TEXT("Signal plan saved into %s"), *filename);
+	}
+	return true;
+#else
+	UE_LOG(LogUrbanTraffic, Error, TEXT("Saving maps needs the editor, run the optimizer with UE4Editor-Cmd"));
+	return false;
+#endif
+}
@@ -25,6 +25,11 @@
 #include "TrafficLight.h"
 #include "Components/SceneComponent.h"
 #include "Components/ShapeComponent.h"
+#include "TrafficStats.h"
+#include "UrbanTraffic.h"
+#include "EngineUtils.h"
+
+DECLARE_CYCLE_STAT(TEXT("Traffic Light Tick"), STAT_UrbanTrafficLightTick, STATGROUP_UrbanTraffic);
 
 ATrafficLight::ATrafficLight() {
 	PrimaryActorTick.bCanEverTick = true;
@@ -50,12 +55,10 @@ ATrafficLight::ATrafficLight() {
 }
 
 void ATrafficLight::BeginPlay() {
+	TArray<ATrafficLight*> changedLights;
 	if (Master) {
 		// slave mode
 		Master->slaves.Add(this);
-		red->SetVisibility(false, true);
-		yellow->SetVisibility(false, true);
-		green->SetVisibility(false, true);
 		if (Reversed) {
 			switch (Master->LightState) {
 			case TrafficLightState::Blink:
@@ -69,91 +72,310 @@ void ATrafficLight::BeginPlay() {
 				Master->reversedState = TrafficLightState::Red;
 				break;
 			}
-			setLightState(Master->reversedState);
+			setLightState(Master->reversedState, changedLights);
 		}
 		else {
-			setLightState(Master->LightState);
+			setLightState(Master->LightState, changedLights);
 		}
 	}
 	else {
 		// master mode
 		Super::BeginPlay();
-		setLightState(LightState, false);
+		setLightState(LightState, changedLights);
+		if (scheduled) {
+			SetActorTickEnabled(false);
+		}
+	}
+	applyVisualState();
+	// the manager binds the light to the road graph and drives its signal
+	TActorIterator<AUrbanTraffic> it(GetWorld());
+	if (it) {
+		manager = *it;
+		manager->registerTrafficLight(this);
+	}
+}
+
+void ATrafficLight::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	if (manager.IsValid()) {
+		manager->unregisterTrafficLight(this);
 	}
+	manager = nullptr;
+	if (Master) {
+		Master->slaves.Remove(this);
+	}
+	Super::EndPlay(EndPlayReason);
 }
 
 void ATrafficLight::Tick(float DeltaSeconds) {
-	//if (!master) {
-		Super::Tick(DeltaSeconds);
-		TickCountdown -= 1; // DeltaSeconds = TickInterval
-		if (LightState == TrafficLightState::Blink) {
-			// blink mode
-			if (TickCountdown <= 0) {
-				TickCountdown = BlinkPeriod;
-				blinkState = !blinkState;
-				yellow->SetVisibility(blinkState, true);
-				// update slaves
-				for (ATrafficLight* slave : slaves) {
-					slave->yellow->SetVisibility(blinkState, true);
-				}
-			}
-		}
-		else {
-			// individual mode
-			if (TickCountdown <= 0) {
-				switch (LightState) {
-				case TrafficLightState::Green:
-					setLightState(TrafficLightState::Yellow);
-					break;
-
-				case TrafficLightState::Yellow:
-					setLightState(TrafficLightState::Red);
-					reversedState = TrafficLightState::Green;
-					break;
-
-				case TrafficLightState::Red:
-					setLightState(TrafficLightState::Green);
-					reversedState = TrafficLightState::Red;
-					break;
-				}
-				updateSlaves();
-			}
-			else if (TickCountdown <= YellowPeriod && reversedState == TrafficLightState::Green) {
-				reversedState = TrafficLightState::Yellow;
-				updateSlaves();
-			}
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficLightTick);
+	Super::Tick(DeltaSeconds);
+	if (scheduled) {
+		// the traffic manager took over
+		SetActorTickEnabled(false);
+		return;
+	}
+	TickCountdown -= 1; // DeltaSeconds = TickInterval
+	if (TickCountdown <= 0) {
+		TArray<ATrafficLight*> changedLights;
+		TickCountdown = FMath::Max(1, FMath::RoundToInt(advanceSignal(changedLights)));
+		for (ATrafficLight* light : changedLights) {
+			light->applyVisualState();
 		}
-	//}
+	}
 }
 
-void ATrafficLight::setLightState(TrafficLightState newState, bool setCountdown) {
-	LightState = newState;
-	bool isRed = newState == TrafficLightState::Red;
-	bool isYellow = newState == TrafficLightState::Yellow;
-	bool isGreen = newState == TrafficLightState::Green;
-	red->SetVisibility(isRed, true);
-	yellow->SetVisibility(isYellow, true);
-	green->SetVisibility(isGreen, true);
-	VehicleBlocker->SetCollisionEnabled((isRed || isYellow) ? ECollisionEnabled::QueryOnly : ECollisionEnabled::NoCollision);
-	if (setCountdown) {
-		if (isRed) {
-			TickCountdown = RedPeriod;
-		}
-		else if (isYellow) {
-			TickCountdown = YellowPeriod;
+bool ATrafficLight::isSignalMaster() {
+	return !Master;
+}
+
+float ATrafficLight::scheduleSignal() {
+	scheduled = true;
+	SetActorTickEnabled(false);
+	return FMath::Max(0, TickCountdown);
+}
+
+float ATrafficLight::advanceSignal(TArray<ATrafficLight*> &changedLights) {
+	if (LightState == TrafficLightState::Blink) {
+		// blink mode
+		blinkState = !blinkState;
+		setLightState(TrafficLightState::Blink, changedLights);
+		for (ATrafficLight* slave : slaves) {
+			slave->blinkState = blinkState;
 		}
-		else if (isGreen) {
-			TickCountdown = GreenPeriod;
+		updateSlaves(changedLights);
+		return BlinkPeriod;
+	}
+	// individual mode, the reversed lights turn yellow before red ends
+	float delay = 0;
+	switch (LightState) {
+	case TrafficLightState::Green:
+		setLightState(TrafficLightState::Yellow, changedLights);
+		delay = YellowPeriod;
+		break;
+
+	case TrafficLightState::Yellow:
+		setLightState(TrafficLightState::Red, changedLights);
+		reversedState = TrafficLightState::Green;
+		delay = isActuated() ? MinGreenPeriod : FMath::Max(0, RedPeriod - YellowPeriod);
+		greenTime = delay;
+		break;
+
+	case TrafficLightState::Red:
+		if (reversedState == TrafficLightState::Green) {
+			reversedState = TrafficLightState::Yellow;
+			delay = FMath::Min(YellowPeriod, RedPeriod);
 		}
 		else {
-			TickCountdown = BlinkPeriod;
+			setLightState(TrafficLightState::Green, changedLights);
+			reversedState = TrafficLightState::Red;
+			delay = isActuated() ? MinGreenPeriod : GreenPeriod;
+			greenTime = delay;
+		}
+		break;
+	}
+	updateSlaves(changedLights);
+	return delay;
+}
+
+void ATrafficLight::setLightState(TrafficLightState newState, TArray<ATrafficLight*> &changedLights) {
+	LightState = newState;
+	if (!visualPending) {
+		visualPending = true;
+		changedLights.Add(this);
+	}
+}
+
+void ATrafficLight::applyVisualState() {
+	visualPending = false;
+	bool isRed = LightState == TrafficLightState::Red;
+	bool isYellow = LightState == TrafficLightState::Yellow ||
+		(LightState == TrafficLightState::Blink && blinkState);
+	bool isGreen = LightState == TrafficLightState::Green;
+	if (red->IsVisible() != isRed) {
+		red->SetVisibility(isRed, true);
+	}
+	if (yellow->IsVisible() != isYellow) {
+		yellow->SetVisibility(isYellow, true);
+	}
+	if (green->IsVisible() != isGreen) {
+		green->SetVisibility(isGreen, true);
+	}
+	// bound lights stop vehicles from the road graph, the blocker is only kept on request
+	bool isStop = LightState == TrafficLightState::Red || LightState == TrafficLightState::Yellow;
+	isStop = isStop && (UseVehicleBlocker || !boundPort);
+	ECollisionEnabled::Type blocking = isStop ? ECollisionEnabled::QueryOnly : ECollisionEnabled::NoCollision;
+	if (VehicleBlocker->GetCollisionEnabled() != blocking) {
+		VehicleBlocker->SetCollisionEnabled(blocking);
+		blockerRevision++;
+	}
+}
+
+UBoxComponent* ATrafficLight::getActiveBlocker() {
+	return VehicleBlocker->GetCollisionEnabled() != ECollisionEnabled::NoCollision ? VehicleBlocker : nullptr;
+}
+
+uint32 ATrafficLight::getBlockerRevision() {
+	return blockerRevision;
+}
+
+TrafficLightState ATrafficLight::getLightState() {
+	return LightState;
+}
+
+FVector ATrafficLight::getStopLocation() {
+	return VehicleBlocker->GetComponentLocation();
+}
+
+bool ATrafficLight::isControlledTurn(RoadTurnType turnType) {
+	return !ControlledTurns.Num() || ControlledTurns.Contains(turnType);
+}
+
+void ATrafficLight::bindSignal(URoadNodePort* port) {
+	boundPort = port;
+	applyVisualState();
+}
+
+URoadNodePort* ATrafficLight::getBoundPort() {
+	return boundPort;
+}
+
+ATrafficLight* ATrafficLight::getSignalMaster() {
+	return Master ? Master : this;
+}
+
+int ATrafficLight::getCycleLength() {
+	return RedPeriod + YellowPeriod + GreenPeriod;
+}
+
+float ATrafficLight::getGreenStart() {
+	// reversed lights turn green when their master turns red
+	return Master && Reversed ? Master->GreenPeriod + Master->YellowPeriod : 0;
+}
+
+float ATrafficLight::getSignalPhase(float countdown) {
+	ATrafficLight* master = getSignalMaster();
+	if (countdown < 0) {
+		// the manager does not write the tick countdown of scheduled lights
+		countdown = FMath::Max(0, master->TickCountdown);
+	}
+	switch (master->LightState) {
+	case TrafficLightState::Green:
+		return FMath::Max(0.0f, master->GreenPeriod - countdown);
+	case TrafficLightState::Yellow:
+		return FMath::Max(0.0f, master->GreenPeriod + master->YellowPeriod - countdown);
+	case TrafficLightState::Red:
+		// the reversed yellow is the last part of the red
+		return FMath::Max(0.0f, master->getCycleLength() - countdown -
+			(master->reversedState == TrafficLightState::Green ? master->YellowPeriod : 0));
+	default:
+		return 0;
+	}
+}
+
+bool ATrafficLight::getSignalWindow(float &greenStart, float &green, float &yellow) {
+	ATrafficLight* master = getSignalMaster();
+	if (master->LightState == TrafficLightState::Blink) {
+		return false;
+	}
+	getSignalWindow(master->RedPeriod, master->YellowPeriod, master->GreenPeriod, greenStart, green, yellow);
+	return true;
+}
+
+void ATrafficLight::getSignalWindow(int masterRed, int masterYellow, int masterGreen, float &greenStart, float &green, float &yellow) {
+	if (Master && Reversed) {
+		// same sequence as advanceSignal, reversed lights are green during the master red less a yellow
+		yellow = FMath::Min(masterYellow, masterRed);
+		greenStart = masterGreen + masterYellow;
+		green = masterRed - yellow;
+	}
+	else {
+		yellow = masterYellow;
+		greenStart = 0;
+		green = masterGreen;
+	}
+}
+
+float ATrafficLight::setSignalPhase(float phase, TArray<ATrafficLight*> &changedLights) {
+	float cycle = FMath::Max(1, getCycleLength());
+	phase = FMath::Fmod(phase, cycle);
+	if (phase < 0) {
+		phase += cycle;
+	}
+	// same sequence as advanceSignal: green, yellow, red with the reversed yellow at its end
+	float delay;
+	if (phase < GreenPeriod) {
+		setLightState(TrafficLightState::Green, changedLights);
+		reversedState = TrafficLightState::Red;
+		delay = GreenPeriod - phase;
+	}
+	else if (phase < GreenPeriod + YellowPeriod) {
+		setLightState(TrafficLightState::Yellow, changedLights);
+		reversedState = TrafficLightState::Red;
+		delay = GreenPeriod + YellowPeriod - phase;
+	}
+	else {
+		setLightState(TrafficLightState::Red, changedLights);
+		float remaining = cycle - phase;
+		reversedState = remaining > YellowPeriod ? TrafficLightState::Green : TrafficLightState::Yellow;
+		delay = remaining > YellowPeriod ? remaining - YellowPeriod : remaining;
+	}
+	updateSlaves(changedLights);
+	TickCountdown = FMath::Max(1, FMath::CeilToInt(delay));
+	return delay;
+}
+
+void ATrafficLight::SetSignalPeriods(int red, int yellow, int green) {
+	RedPeriod = FMath::Max(1, red);
+	YellowPeriod = FMath::Max(0, yellow);
+	GreenPeriod = FMath::Max(1, green);
+}
+
+bool ATrafficLight::isActuated() {
+	// ticking lights have no manager to measure demand
+	return Actuated && scheduled && !Master && LightState != TrafficLightState::Blink;
+}
+
+bool ATrafficLight::isGreenEnding() {
+	return LightState == TrafficLightState::Green ||
+		(LightState == TrafficLightState::Red && reversedState == TrafficLightState::Green);
+}
+
+void ATrafficLight::getGroupPorts(TrafficLightState state, TArray<URoadNodePort*> &ports) {
+	if (boundPort && LightState == state) {
+		ports.Add(boundPort);
+	}
+	for (ATrafficLight* slave : slaves) {
+		if (slave->boundPort && slave->LightState == state) {
+			ports.Add(slave->boundPort);
 		}
 	}
 }
 
-void ATrafficLight::updateSlaves() {
+/* Expected arrivals within one extension which keep the green. */
+static const float ACTUATED_CALL_VEHICLES = 0.5f;
+
+float ATrafficLight::actuateGreen(const FSignalDemand &served, const FSignalDemand &conflicting) {
+	// nobody waits for the other phase, skip it by resting in green
+	bool hasCall = conflicting.queue > 0 || conflicting.arrivalRate * GreenExtension >= ACTUATED_CALL_VEHICLES;
+	float extension = 0;
+	if (!hasCall) {
+		extension = GreenExtension;
+	}
+	else if (served.queue > 0 || served.arrivalRate * GreenExtension >= ACTUATED_CALL_VEHICLES) {
+		// the queue still discharges or vehicles keep coming, up to the max green
+		extension = FMath::Min((float)GreenExtension, FMath::Max(MinGreenPeriod, MaxGreenPeriod) - greenTime);
+	}
+	if (extension <= 0) {
+		return 0;
+	}
+	greenTime += extension;
+	TickCountdown = FMath::CeilToInt(extension);
+	return extension;
+}
+
+void ATrafficLight::updateSlaves(TArray<ATrafficLight*> &changedLights) {
 	for (ATrafficLight* slave : slaves) {
 		slave->setLightState(slave->Reversed ?
-			reversedState : LightState);
+			reversedState : LightState, changedLights);
 	}
-}
\ No newline at end of file
+}
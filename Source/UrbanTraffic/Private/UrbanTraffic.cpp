@@ -6,16 +6,72 @@
 #include "RoadNodeNormal.h"
 #include "RoadNodePort.h"
 #include "RoadNodeCross.h"
+#include "RoadTurn.h"
+#include "RoadPlanner.h"
+#include "ObstacleSensorComponent.h"
+#include "TrafficLight.h"
+#include "TrafficStats.h"
+#include "EngineUtils.h"
+#include "Algo/BinarySearch.h"
 
 #include <string>
 #include <fstream>
 #include <iostream>
 
 #include "Kismet/GameplayStatics.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Misc/Paths.h"
 #include "DrawDebugHelpers.h"
 #include "Modules/ModuleManager.h"
+#include "Async/TaskGraphInterfaces.h"
+
+DEFINE_LOG_CATEGORY(LogUrbanTraffic);
+
+DEFINE_STAT(STAT_UrbanTrafficVehiclesNear);
+DEFINE_STAT(STAT_UrbanTrafficVehiclesNormal);
+DEFINE_STAT(STAT_UrbanTrafficVehiclesFar);
+DEFINE_STAT(STAT_UrbanTrafficPhysicsQueries);
+DEFINE_STAT(STAT_UrbanTrafficVirtualRays);
+DEFINE_STAT(STAT_UrbanTrafficCoherentUpdates);
+DEFINE_STAT(STAT_UrbanTrafficSpawnRate);
+DEFINE_STAT(STAT_UrbanTrafficDespawnRate);
+DEFINE_STAT(STAT_UrbanTrafficSpawnVolumeNodes);
+DEFINE_STAT(STAT_UrbanTrafficRouteNodes);
+DEFINE_STAT(STAT_UrbanTrafficLightSwitches);
+DEFINE_STAT(STAT_UrbanTrafficDynamicLights);
+DEFINE_STAT(STAT_UrbanTrafficSimulatedVehicles);
+
+DECLARE_CYCLE_STAT(TEXT("Manager Tick"), STAT_UrbanTrafficTick, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Build Road System"), STAT_UrbanTrafficBuildRoads, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Build Routing Tables"), STAT_UrbanTrafficBuildRouting, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Update Spawn Volume"), STAT_UrbanTrafficSpawnVolume, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Update Light System"), STAT_UrbanTrafficLightSystem, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Update Signals"), STAT_UrbanTrafficSignals, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Update Lane Ordering"), STAT_UrbanTrafficLaneOrdering, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Sensor Schedule"), STAT_UrbanTrafficSensorSchedule, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Virtual Scene"), STAT_UrbanTrafficVirtualScene, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Virtual Rays"), STAT_UrbanTrafficVirtualTrace, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Simulation Step"), STAT_UrbanTrafficSimulationStep, STATGROUP_UrbanTraffic);
+DECLARE_CYCLE_STAT(TEXT("Simulation Mirror"), STAT_UrbanTrafficSimulationMirror, STATGROUP_UrbanTraffic);
+
+#if URBANTRAFFIC_TRACE
+UE_TRACE_CHANNEL_DEFINE(UrbanTrafficChannel);
+
+UE_TRACE_EVENT_BEGIN(UrbanTraffic, VehicleDecision)
+	UE_TRACE_EVENT_FIELD(uint64, Cycle)
+	UE_TRACE_EVENT_FIELD(uint32, VehicleId)
+	UE_TRACE_EVENT_FIELD(uint8, Decision)
+UE_TRACE_EVENT_END()
+
+void FTrafficTrace::vehicleDecision(const AActor* vehicle, VehicleDecisionType decision) {
+	UE_TRACE_LOG(UrbanTraffic, VehicleDecision, UrbanTrafficChannel)
+		<< VehicleDecision.Cycle(FPlatformTime::Cycles64())
+		<< VehicleDecision.VehicleId(vehicle->GetUniqueID())
+		<< VehicleDecision.Decision((uint8)decision);
+}
+#endif
 
 #define LOCTEXT_NAMESPACE "FUrbanTrafficModule"
 
@@ -37,7 +93,7 @@ IMPLEMENT_MODULE(FUrbanTrafficModule, UrbanTraffic)
 AUrbanTraffic::AUrbanTraffic()
 {
 	PrimaryActorTick.bCanEverTick = true;
-	PrimaryActorTick.TickInterval = 2;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
 	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("DefaultSceneRoot"));
 	RootComponent->SetMobility(EComponentMobility::Static);
 }
@@ -52,6 +108,11 @@ void AUrbanTraffic::PostInitializeComponents() {
 	Super::PostInitializeComponents();
 	// rebuild road system
 	buildRoadSystem();
+	clockHour = TimerStart;
+	applyLightHour(clockHour, true);
+	lightBudget = FLightBudget(LightBudgetCellSize);
+	lightBudget.maxRealLights = MaxDynamicLights;
+	lightBudget.proxyParameter = LightProxyParameter;
 	// preload levels before play
 	ConsumePreloadLevels();
 }
@@ -65,36 +126,76 @@ void AUrbanTraffic::ConsumePreloadLevels() {
 		UGameplayStatics::LoadStreamLevel(this, levelName, true, false, latent);
 		//UKismetSystemLibrary::PrintString(this, name.ToString());
 	}
-	else {
-		// collect lights from preloaded levels
-		RebuildLightSystem();
-	}
 }
 
 void AUrbanTraffic::BeginPlay()
 {
 	Super::BeginPlay();
+	trafficStream.Initialize(TrafficSeed);
 	// register player vehicle
 	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
 	AVehicleBase* playerVehicle = Cast<AVehicleBase>(playerPawn);
 	if (playerVehicle) {
+		playerVehicle->setRandomSeed(trafficStream.GetUnsignedInt());
 		RegisterVehicle(playerVehicle);
 		playerVehicle->onPlacedInSystem(this);
 		playerVehicle->setAutoMode(PossessPlayerAI);
 	}
+	// populate the simulation core before the first vehicles are mirrored
+	if (OffscreenTraffic != OffscreenTrafficMode::Destroy) {
+		buildSimulation();
+	}
 	// spawn initial vehicles
 	updateVehicleSpawnVolume(true);
 }
 
+/* Interval of updating spawn volume, in seconds. */
+static const float SPAWN_UPDATE_INTERVAL = 2;
+
 void AUrbanTraffic::Tick(float DeltaSeconds) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficTick);
+	TRAFFIC_TRACE_SCOPE(Tick);
+	// advance vehicles kept by the simulation core
+	if (simTraffic) {
+		SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSimulationStep);
+		simTraffic->step(DeltaSeconds);
+	}
 	// update and spawn vehicles
-	updateVehicleSpawnVolume(false);
+	spawnTimer += DeltaSeconds;
+	if (spawnTimer >= SPAWN_UPDATE_INTERVAL) {
+		spawnTimer = 0;
+		updateVehicleSpawnVolume(false);
+	}
+	// significance of vehicles depends on the player camera
+	APlayerController* pc = UGameplayStatics::GetPlayerController(this, 0);
+	hasViewLocation = pc && pc->PlayerCameraManager;
+	if (hasViewLocation) {
+		viewLocation = pc->PlayerCameraManager->GetCameraLocation();
+	}
+	// lights near the camera switch first
+	updateDayClock(DeltaSeconds);
+	if (hasViewLocation && isLightBudgetEnabled()) {
+		SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficLightSystem);
+		lightBudget.update(viewLocation);
+		SET_DWORD_STAT(STAT_UrbanTrafficDynamicLights, lightBudget.getNumReal());
+	}
+	// change due signals before sensors see their blockers
+	updateSignals(DeltaSeconds);
+	if (simTraffic && simSignalRevision != signalRevision) {
+		// lights came, went or were coordinated since the graph took their phases
+		updateSimSignals();
+	}
+	// trace due sensors
+	updateSensorSchedule();
+	updateTrafficStats(DeltaSeconds);
 }
 
 void AUrbanTraffic::BeginDestroy() {
 	Super::BeginDestroy();
 	cleanRoadSystem();
-	timedLights.Empty();
+	lampLights.Empty();
+	lightSwitches.Empty();
+	lightBudget.empty();
 }
 
 // ================================================================
@@ -102,44 +203,435 @@ void AUrbanTraffic::BeginDestroy() {
 // ================================================================
 
 void AUrbanTraffic::RebuildLightSystem() {
-	timedLights.Reset();
-	// collect components from street lamps
-	TArray<AActor*> lampActors;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), AStreetLamp::StaticClass(), lampActors);
-	for (AActor* actor : lampActors) {
-		AStreetLamp* lamp = Cast<AStreetLamp>(actor);
-		lamp->collectLightComponents(timedLights);
+	// lamps register themselves, force update system by current time
+	applyLightHour(clockHour, true);
+}
+
+void AUrbanTraffic::registerStreetLamp(AStreetLamp* lamp) {
+	TArray<USceneComponent*> &lights = lampLights.FindOrAdd(lamp->GetLevel());
+	int first = lights.Num();
+	lamp->collectLightComponents(lights);
+	for (int i = first; i < lights.Num(); i++) {
+		lights[i]->SetVisibility(lightState);
+		if (isLightBudgetEnabled()) {
+			lightBudget.addLight(lights[i], false);
+		}
+	}
+}
+
+bool AUrbanTraffic::isLightBudgetEnabled() {
+	return MaxDynamicLights > 0;
+}
+
+void AUrbanTraffic::unregisterStreetLamp(AStreetLamp* lamp, bool levelRemoved) {
+	ULevel* level = lamp->GetLevel();
+	TArray<USceneComponent*>* lights = lampLights.Find(level);
+	if (!lights) {
+		return;
+	}
+	if (levelRemoved) {
+		// the first lamp of a streamed out level drops the group, the others find nothing
+		for (USceneComponent* light : *lights) {
+			lightBudget.removeLight(light);
+		}
+		lampLights.Remove(level);
+		return;
+	}
+	TArray<USceneComponent*> lampComponents;
+	lamp->collectLightComponents(lampComponents);
+	for (USceneComponent* light : lampComponents) {
+		lights->RemoveSwap(light);
+		lightBudget.removeLight(light);
+	}
+	if (!lights->Num()) {
+		lampLights.Remove(level);
 	}
-	// force update system by start time
-	UpdateLightSystem(TimerStart, true);
+}
+
+float AUrbanTraffic::GetTimerHour() {
+	return clockHour;
 }
 
 void AUrbanTraffic::UpdateLightSystem(float timerHour, bool forceUpdate) {
+	// an external clock wins over the simulated one, which would flip lights back otherwise
+	externalClock = true;
+	clockHour = timerHour;
+	applyLightHour(timerHour, forceUpdate);
+}
+
+void AUrbanTraffic::applyLightHour(float timerHour, bool forceUpdate) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficLightSystem);
 	// change light on state by hours
-	if (forceUpdate) {
-		lightState = TimerStart < 5.5f || TimerStart > 18.5f;
+	bool isNight = timerHour < 5.5f || timerHour > 18.5f;
+	if (isNight == lightState && !forceUpdate) {
+		return;
 	}
-	else {
-		if (5.5f < timerHour && timerHour < 18.5f) {
-			if (lightState) {
-				lightState = false;
-				forceUpdate = true;
-			}
-		}
-		else if (!lightState) {
-			lightState = true;
-			forceUpdate = true;
+	lightState = isNight;
+	if (!forceUpdate && LightSwitchBudget > 0) {
+		// spread over the next frames
+		queueLightSwitches();
+		return;
+	}
+	lightSwitches.Reset();
+	for (const TPair<ULevel*, TArray<USceneComponent*>> &group : lampLights) {
+		for (USceneComponent* light : group.Value) {
+			light->SetVisibility(lightState);
 		}
 	}
-	// update visibility when needed
-	if (forceUpdate) {
-		for (USceneComponent* light : timedLights) {
+	for (AVehicleBase* vehicle : vehicles) {
+		vehicle->SetLightState(lightState);
+	}
+}
+
+void AUrbanTraffic::updateDayClock(float deltaSeconds) {
+	if (!externalClock) {
+		clockHour = FMath::Fmod(clockHour + deltaSeconds * TimerSpeed / 3600, 24.0f);
+		applyLightHour(clockHour, false);
+	}
+	if (!lightSwitches.Num()) {
+		return;
+	}
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficLightSystem);
+	for (int i = 0; i < LightSwitchBudget && lightSwitches.Num(); i++) {
+		FLightSwitchEntry entry = lightSwitches.Pop(false);
+		if (USceneComponent* light = entry.light.Get()) {
 			light->SetVisibility(lightState);
 		}
-		for (AVehicleBase* vehicle : vehicles) {
+		else if (AVehicleBase* vehicle = entry.vehicle.Get()) {
 			vehicle->SetLightState(lightState);
 		}
 	}
+	SET_DWORD_STAT(STAT_UrbanTrafficLightSwitches, lightSwitches.Num());
+}
+
+void AUrbanTraffic::queueLightSwitches() {
+	FVector origin = hasViewLocation ? viewLocation : spawnFocus;
+	// a state flipping back mid-switch starts over, entries already in state are skipped
+	lightSwitches.Reset();
+	for (const TPair<ULevel*, TArray<USceneComponent*>> &group : lampLights) {
+		for (USceneComponent* light : group.Value) {
+			if (light->IsVisible() != lightState) {
+				lightSwitches.Add({ light, nullptr, FVector::DistSquared(light->GetComponentLocation(), origin) });
+			}
+		}
+	}
+	for (AVehicleBase* vehicle : vehicles) {
+		if (vehicle->GetLightState() != lightState) {
+			lightSwitches.Add({ nullptr, vehicle, FVector::DistSquared(vehicle->GetActorLocation(), origin) });
+		}
+	}
+	lightSwitches.Sort([](const FLightSwitchEntry &a, const FLightSwitchEntry &b) {
+		return a.distance > b.distance;
+	});
+	SET_DWORD_STAT(STAT_UrbanTrafficLightSwitches, lightSwitches.Num());
+}
+
+// ================================================================
+// ===                       SIGNAL SYSTEM                      ===
+// ================================================================
+
+/* Farthest distance from a stop line to the crossing entry port it belongs to, in centimeters. */
+static const float SIGNAL_BIND_DISTANCE = 1500;
+
+/* Least cosine between the facing of a light and the approach of its entry port. */
+static const float SIGNAL_BIND_MIN_ALIGNMENT = 0.5f;
+
+void AUrbanTraffic::registerTrafficLight(ATrafficLight* light) {
+	trafficLights.AddUnique(light);
+	bindTrafficLight(light);
+	if (light->isSignalMaster()) {
+		signalWheel.remove(light);
+		scheduleSignalChange(light, light->scheduleSignal());
+	}
+	// lights of a level register one by one, coordinate them together
+	if (CoordinateSignals) {
+		coordinationPending = true;
+	}
+	signalRevision++;
+}
+
+void AUrbanTraffic::unregisterTrafficLight(ATrafficLight* light) {
+	trafficLights.Remove(light);
+	unbindTrafficLight(light);
+	signalWheel.remove(light);
+	signalDueTimes.Remove(light);
+	coordinatedCycles.Remove(light);
+	signalRevision++;
+}
+
+void AUrbanTraffic::bindTrafficLight(ATrafficLight* light) {
+	// lights stand at stop lines, right before the entry ports of crossings, facing along the approach
+	FVector stopLocation = light->getStopLocation();
+	FVector facing = light->GetActorForwardVector().GetSafeNormal2D();
+	URoadNodePort* nearestPort = nullptr;
+	float nearestDistance = SIGNAL_BIND_DISTANCE;
+	for (URoadNodePort* port : roadPorts) {
+		URoadNodeCross* crossNode = port->getSegment()->getCrossNode();
+		if (!crossNode || !port->numRights) {
+			continue;
+		}
+		float distance = FVector::Dist(stopLocation, port->position);
+		// a light on the far corner may be nearer to another approach
+		FVector approach = (crossNode->position - port->position).GetSafeNormal2D();
+		if (distance < nearestDistance && FVector::DotProduct(approach, facing) >= SIGNAL_BIND_MIN_ALIGNMENT) {
+			nearestDistance = distance;
+			nearestPort = port;
+		}
+	}
+	if (!nearestPort) {
+		UE_LOG(LogUrbanTraffic, Warning, TEXT("%s is not near any crossing entry it faces, it keeps its vehicle blocker"), *light->GetName());
+		return;
+	}
+	int numBound = 0;
+	for (URoadTurn* turn : nearestPort->getSegment()->getCrossNode()->getPortTurns(nearestPort)) {
+		if (!light->isControlledTurn(turn->getTurnType())) {
+			continue;
+		}
+		ATrafficLight* current = turn->getSignal();
+		if (current && current != light) {
+			// the first light keeps the turn
+			UE_LOG(LogUrbanTraffic, Warning, TEXT("%s controls a turn already signalized by %s, the turn keeps %s"),
+				*light->GetName(), *current->GetName(), *current->GetName());
+			continue;
+		}
+		turn->setSignal(light);
+		numBound++;
+	}
+	if (numBound) {
+		light->bindSignal(nearestPort);
+	}
+}
+
+void AUrbanTraffic::unbindTrafficLight(ATrafficLight* light) {
+	URoadNodePort* port = light->getBoundPort();
+	if (!port) {
+		return;
+	}
+	for (URoadTurn* turn : port->getSegment()->getCrossNode()->getPortTurns(port)) {
+		if (turn->getSignal() == light) {
+			turn->setSignal(nullptr);
+		}
+	}
+	light->bindSignal(nullptr);
+}
+
+void AUrbanTraffic::updateSignals(float deltaSeconds) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSignals);
+	if (coordinationPending) {
+		coordinationPending = false;
+		coordinateSignals();
+	}
+	dueLights.Reset();
+	signalWheel.advance(deltaSeconds, dueLights);
+	if (!dueLights.Num()) {
+		return;
+	}
+	changedLights.Reset();
+	bool cycleChanged = false;
+	for (ATrafficLight* light : dueLights) {
+		if (light->isActuated() && light->isGreenEnding()) {
+			// decided only at green ends, so demand is measured a few times per cycle
+			float extension = light->actuateGreen(measureSignalDemand(light, TrafficLightState::Green),
+				measureSignalDemand(light, TrafficLightState::Red));
+			if (extension > 0) {
+				scheduleSignalChange(light, extension);
+				continue;
+			}
+		}
+		scheduleSignalChange(light, light->advanceSignal(changedLights));
+		int* cycle = coordinatedCycles.Find(light);
+		cycleChanged = cycleChanged || (cycle && *cycle != light->getCycleLength());
+	}
+	// one pass of visibility and collision updates
+	for (ATrafficLight* light : changedLights) {
+		light->applyVisualState();
+	}
+	if (cycleChanged) {
+		coordinateSignals();
+	}
+}
+
+void AUrbanTraffic::scheduleSignalChange(ATrafficLight* master, float delay) {
+	signalWheel.schedule(master, delay);
+	float now = GetWorld() ? GetWorld()->GetTimeSeconds() : 0;
+	signalDueTimes.Add(master, now + delay);
+}
+
+float AUrbanTraffic::getSignalCountdown(ATrafficLight* light) {
+	const float* due = signalDueTimes.Find(light->getSignalMaster());
+	if (!due) {
+		return -1;
+	}
+	float now = GetWorld() ? GetWorld()->GetTimeSeconds() : 0;
+	return FMath::Max(0.0f, *due - now);
+}
+
+/* Length of the approach watched by actuated signals, from the stop line. */
+static const float ACTUATED_DETECTOR_LENGTH = 6000;
+
+/* Vehicles slower than this are counted as queued, in km/h. */
+static const float ACTUATED_QUEUE_SPEED = 5;
+
+FSignalDemand AUrbanTraffic::measureSignalDemand(ATrafficLight* master, TrafficLightState state) {
+	FSignalDemand demand;
+	demandPorts.Reset();
+	master->getGroupPorts(state, demandPorts);
+	if (!demandPorts.Num()) {
+		return demand;
+	}
+	updateLaneOrdering();
+	for (URoadNodePort* port : demandPorts) {
+		// approaching vehicles are ordered by the exit port connected to the crossing entry
+		URoadNode* laneNode = port->getConnectedPort();
+		int first = Algo::LowerBoundBy(laneEntries, laneNode, [](const FVehicleLaneEntry &entry) {
+			return entry.laneNode;
+		});
+		for (int i = first; i < laneEntries.Num() && laneEntries[i].laneNode == laneNode; i++) {
+			const FVehicleLaneEntry &entry = laneEntries[i];
+			if (entry.remainLength > ACTUATED_DETECTOR_LENGTH) {
+				continue;
+			}
+			float speed = entry.vehicle->Speed;
+			if (speed < ACTUATED_QUEUE_SPEED) {
+				demand.queue++;
+			}
+			else {
+				// flow is density times speed
+				demand.arrivalRate += speed / 0.036f / ACTUATED_DETECTOR_LENGTH;
+			}
+		}
+	}
+	return demand;
+}
+
+/* Longest chain of straight segments between two crossings of a corridor. */
+static const int CORRIDOR_MAX_SEGMENTS = 16;
+
+/* Edge of a signal corridor: a platoon leaving the green of one light reaches another. */
+struct FSignalCorridorLink
+{
+	ATrafficLight* from;
+	ATrafficLight* to;
+	float travelTime;
+};
+
+TMap<ATrafficLight*, float> AUrbanTraffic::computeSignalStarts() {
+	float speed = FMath::Max(DesignSpeed, 5.0f) / 0.036f; // cm/s
+	// straight turns are the corridors, follow each to the stop line of the next crossing
+	TArray<FSignalCorridorLink> corridorLinks;
+	for (URoadNodePort* port : roadPorts) {
+		URoadNodeCross* crossNode = port->getSegment()->getCrossNode();
+		if (!crossNode || !port->numRights) {
+			continue;
+		}
+		for (URoadTurn* turn : crossNode->getPortTurns(port)) {
+			ATrafficLight* fromLight = turn->getSignal();
+			if (turn->getTurnType() != RoadTurnType::None || !fromLight) {
+				continue;
+			}
+			float distance = turn->getTurnLength();
+			URoadNodePort* nextPort = turn->getEndPort()->getConnectedPort();
+			for (int i = 0; i < CORRIDOR_MAX_SEGMENTS && nextPort && !nextPort->getSegment()->getCrossNode(); i++) {
+				URoadSegment* segment = nextPort->getSegment();
+				distance += segment->getSegmentLength();
+				URoadNodePort* exitPort = segment->getExitPort(nextPort->nextIndex < 0);
+				nextPort = exitPort ? exitPort->getConnectedPort() : nullptr;
+			}
+			if (!nextPort || !nextPort->getSegment()->getCrossNode()) {
+				continue;
+			}
+			for (URoadTurn* nextTurn : nextPort->getSegment()->getCrossNode()->getPortTurns(nextPort)) {
+				ATrafficLight* toLight = nextTurn->getSignal();
+				if (nextTurn->getTurnType() == RoadTurnType::None && toLight) {
+					corridorLinks.Add({ fromLight, toLight, distance / speed });
+				}
+			}
+		}
+	}
+
+	// walk a spanning tree of masters, where corridors close a loop the first direction found wins
+	TMap<ATrafficLight*, float> starts;
+	for (int root = 0; root < corridorLinks.Num(); root++) {
+		ATrafficLight* rootMaster = corridorLinks[root].from->getSignalMaster();
+		if (starts.Contains(rootMaster)) {
+			continue;
+		}
+		starts.Add(rootMaster, 0);
+		bool expanded = true;
+		while (expanded) {
+			expanded = false;
+			for (const FSignalCorridorLink &link : corridorLinks) {
+				ATrafficLight* fromMaster = link.from->getSignalMaster();
+				ATrafficLight* toMaster = link.to->getSignalMaster();
+				if (fromMaster == toMaster) {
+					continue;
+				}
+				float* fromStart = starts.Find(fromMaster);
+				float* toStart = starts.Find(toMaster);
+				// green of the next light starts when the platoon arrives
+				float delta = link.from->getGreenStart() + link.travelTime - link.to->getGreenStart();
+				if (fromStart && !toStart) {
+					starts.Add(toMaster, *fromStart + delta);
+					expanded = true;
+				}
+				else if (toStart && !fromStart) {
+					starts.Add(fromMaster, *toStart - delta);
+					expanded = true;
+				}
+			}
+		}
+	}
+	return starts;
+}
+
+void AUrbanTraffic::coordinateSignals() {
+	coordinatedCycles.Reset();
+	changedLights.Reset();
+	float now = GetWorld() ? GetWorld()->GetTimeSeconds() : 0;
+	for (const TPair<ATrafficLight*, float> &pair : computeSignalStarts()) {
+		ATrafficLight* master = pair.Key;
+		if (master->getLightState() == TrafficLightState::Blink) {
+			continue;
+		}
+		float delay = master->setSignalPhase(now - pair.Value, changedLights);
+		signalWheel.remove(master);
+		scheduleSignalChange(master, delay);
+		coordinatedCycles.Add(master, master->getCycleLength());
+	}
+	for (ATrafficLight* light : changedLights) {
+		light->applyVisualState();
+	}
+	// phases moved, the simulation core follows on next update
+	signalRevision++;
+	UE_LOG(LogUrbanTraffic, Log, TEXT("Coordinated %d signals into green waves"), coordinatedCycles.Num());
+}
+
+void AUrbanTraffic::CoordinateSignalCorridors() {
+	UWorld* world = GetWorld();
+	if (world && world->IsGameWorld()) {
+		coordinateSignals();
+		return;
+	}
+	// in the editor, bind lights for the computation only and store the phases on the lights
+	TArray<ATrafficLight*> editorLights;
+	for (TActorIterator<ATrafficLight> it(world); it; ++it) {
+		editorLights.Add(*it);
+		bindTrafficLight(*it);
+	}
+	TArray<ATrafficLight*> editedLights;
+	for (const TPair<ATrafficLight*, float> &pair : computeSignalStarts()) {
+		ATrafficLight* master = pair.Key;
+		if (master->getLightState() != TrafficLightState::Blink) {
+			master->Modify();
+			master->setSignalPhase(-pair.Value, editedLights);
+		}
+	}
+	for (ATrafficLight* light : editedLights) {
+		light->applyVisualState();
+	}
+	for (ATrafficLight* light : editorLights) {
+		unbindTrafficLight(light);
+	}
 }
 
 // ================================================================
@@ -150,12 +642,18 @@ void AUrbanTraffic::RegisterVehicle(AVehicleBase* vehicle) {
 	if (!vehicles.Contains(vehicle)) {
 		vehicle->SetLightState(lightState);
 		vehicles.Add(vehicle);
+		if (isLightBudgetEnabled()) {
+			lightBudget.addLight(vehicle->getLightContainer(), true);
+		}
+		spawnStatCount++;
 	}
 }
 
 void AUrbanTraffic::UnregisterVehicle(AVehicleBase* vehicle) {
 	if (vehicles.Contains(vehicle)) {
 		vehicles.Remove(vehicle);
+		lightBudget.removeLight(vehicle->getLightContainer());
+		despawnStatCount++;
 	}
 }
 
@@ -163,9 +661,101 @@ URoadNode* AUrbanTraffic::findNearestRoadNode(FVector position) {
 	return URoadNode::findNearestNode(position, roadNodes);
 }
 
+void AUrbanTraffic::RequestVehicleRoute(AVehicleBase* vehicle, FVector destination) {
+	IVehicleControllerInterface* controller = vehicle ? vehicle->getAutoController() : nullptr;
+	if (!controller) {
+		return;
+	}
+	URoadNodePort* startPort = controller->getPlanningPort();
+	URoadNode* goalNode = findNearestRoadNode(destination);
+	if (!startPort || !goalNode) {
+		return;
+	}
+	controller->setRouteDestination(destination);
+	if (numRoutingZones) {
+		// turns are looked up from crossing tables
+		controller->setDestinationZone(getRoutingZone(destination));
+		return;
+	}
+	// plan on a worker thread, then deliver on the game thread
+	URoadSegment* goalSegment = goalNode->getSegment();
+	TWeakObjectPtr<AUrbanTraffic> weakManager(this);
+	TWeakObjectPtr<AVehicleBase> weakVehicle(vehicle);
+	uint32 generation = roadGeneration;
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [=]() {
+		TArray<URoadTurn*> turns;
+		if (!URoadPlanner::findRoute(startPort, goalSegment, turns)) {
+			return;
+		}
+		AsyncTask(ENamedThreads::GameThread, [=]() {
+			AUrbanTraffic* manager = weakManager.Get();
+			AVehicleBase* target = weakVehicle.Get();
+			if (manager && target && manager->roadGeneration == generation) {
+				IVehicleControllerInterface* targetController = target->getAutoController();
+				if (targetController) {
+					targetController->setPlannedRoute(turns);
+				}
+			}
+		});
+	});
+}
+
+void AUrbanTraffic::SetSpawnFocus(FVector location) {
+	spawnFocus = location;
+	hasSpawnFocus = true;
+}
+
+bool AUrbanTraffic::isReservationEnabled() {
+	return UseIntersectionReservation;
+}
+
+int AUrbanTraffic::getRoutingZone(FVector position) {
+	URoadNode* node = numRoutingZones ? findNearestRoadNode(position) : nullptr;
+	return node ? getSegmentZone(node->getSegment()) : -1;
+}
+
+int AUrbanTraffic::getSegmentZone(URoadSegment* segment) {
+	const int* zone = segmentZones.Find(segment);
+	return zone ? *zone : -1;
+}
+
+void AUrbanTraffic::buildRoutingTables() {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficBuildRouting);
+	// assign segments to grid cells, grow the cells until zones fit the limit
+	float zoneSize = RoutingZoneSize;
+	TMap<FIntPoint, int> cells;
+	do {
+		cells.Reset();
+		segmentZones.Reset();
+		for (URoadSegment* segment : roadSegments) {
+			FVector position = segment->getNode(0)->position;
+			FIntPoint cell(FMath::FloorToInt(position.X / zoneSize), FMath::FloorToInt(position.Y / zoneSize));
+			const int* zone = cells.Find(cell);
+			segmentZones.Add(segment, zone ? *zone : cells.Add(cell, cells.Num()));
+		}
+		zoneSize *= 2;
+	} while (cells.Num() > MaxRoutingZones);
+	numRoutingZones = cells.Num();
+	int bytes = URoadPlanner::buildZoneTables(roadPorts, segmentZones, numRoutingZones);
+	UE_LOG(LogUrbanTraffic, Log, TEXT("Routing tables: %d zones (%.0f cm), %d bytes"), numRoutingZones, zoneSize / 2, bytes);
+}
+
 void AUrbanTraffic::cleanRoadSystem() {
+	simTraffic.Reset();
+	simGraph.clear();
+	simLinksByEntry.Reset();
+	simLinksByExit.Reset();
+	simSignalsByLight.Reset();
+	freeSimSignals.Reset();
+	simTurnLinks.Reset();
 	vehicles.Empty();
+	laneEntries.Reset();
+	laneSlots.Reset();
+	laneOrderFrame = 0;
+	segmentZones.Reset();
+	numRoutingZones = 0;
 	spawnVolumeNodes.Reset();
+	spawnOrigin = nullptr;
 	roadNodes.Reset();
 	roadPorts.Reset();
 	roadSegments.Empty();
@@ -173,8 +763,11 @@ void AUrbanTraffic::cleanRoadSystem() {
 }
 
 void AUrbanTraffic::buildRoadSystem() {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficBuildRoads);
+	TRAFFIC_TRACE_SCOPE(BuildRoadSystem);
 	// clear previous data
 	cleanRoadSystem();
+	roadGeneration++;
 
 	// read and compile road data from file
 	for (FString Path : RoadFiles) {
@@ -249,6 +842,10 @@ void AUrbanTraffic::buildRoadSystem() {
 		} ();
 	}
 
+	if (UseRoutingTables && roadSegments.Num()) {
+		buildRoutingTables();
+	}
+
 	// compile debug flags and draw
 	uint8 debugFlags = 0;
 	if (DrawRoadPaths) {
@@ -272,6 +869,8 @@ void AUrbanTraffic::buildRoadSystem() {
 }
 
 void AUrbanTraffic::updateVehicleSpawnVolume(bool isBegin) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSpawnVolume);
+	TRAFFIC_TRACE_SCOPE(UpdateSpawnVolume);
 	// find node from origin
 	URoadNode* newSpawnNode = nullptr;
 	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
@@ -285,6 +884,13 @@ void AUrbanTraffic::updateVehicleSpawnVolume(bool isBegin) {
 			newSpawnNode = spawnOrigin;
 		}
 	}
+	else if (hasSpawnFocus) {
+		URoadNode* focusNode = findNearestRoadNode(spawnFocus);
+		if (focusNode != spawnOrigin) {
+			spawnOrigin = focusNode;
+			newSpawnNode = spawnOrigin;
+		}
+	}
 
 	// update spawn volume from new spawn origin
 	if (newSpawnNode) {
@@ -325,6 +931,15 @@ void AUrbanTraffic::updateVehicleSpawnVolume(bool isBegin) {
 				}
 			}
 		}
+		SET_DWORD_STAT(STAT_UrbanTrafficSpawnVolumeNodes, spawnVolumeNodes.Num());
+	}
+
+	// the simulation core keeps vehicles outside the volume
+	if (isSimulationActive()) {
+		if (playerVehicle || hasSpawnFocus) {
+			updateSimulationMirror(playerVehicle ? playerVehicle->GetActorLocation() : spawnFocus, playerVehicle);
+		}
+		return;
 	}
 
 	// destroy vehicles outside volume
@@ -352,7 +967,7 @@ void AUrbanTraffic::updateVehicleSpawnVolume(bool isBegin) {
 	}
 
 	// spawn vehicles inside volume
-	if (spawnableNodes.Num()) {
+	if (spawnableNodes.Num() && VehicleTypes.Num()) {
 		int maxVehicles = spawnOrigin->getSegment()->computeMaxVehicles(VehicleDensity);
 		int numPawns = maxVehicles - vehicles.Num();
 		// spawn random vehicles by numPawns
@@ -360,19 +975,21 @@ void AUrbanTraffic::updateVehicleSpawnVolume(bool isBegin) {
 		int i = 0;
 		while (i < numPawns) {
 			// random spawn node
-			URoadNodeNormal* node = spawnableNodes[FMath::RandRange(0, spawnableNodes.Num() - 1)];
+			URoadNodeNormal* node = spawnableNodes[trafficStream.RandRange(0, spawnableNodes.Num() - 1)];
 			URoadSegment* segment = node->getSegment();
 			// random port and lane
 			TArray<URoadNodePort*> inPorts = segment->collectEntryPorts();
-			URoadNodePort* inPort = inPorts[FMath::RandRange(0, inPorts.Num() - 1)];
+			URoadNodePort* inPort = inPorts[trafficStream.RandRange(0, inPorts.Num() - 1)];
 			bool invert = inPort->nextIndex < 0;
-			if (isBegin || playerVehicle->isSpawnableAt(segment, invert)) {
-				int lane = inPort->randomRightLane(100);
+			if (isBegin || !playerVehicle || playerVehicle->isSpawnableAt(segment, invert)) {
+				int lane = inPort->randomRightLane(100, trafficStream);
 				FVector location = node->computeTarget(lane, invert);
 				FRotator rotation = node->getHeadVector(invert).ToOrientationRotator();
-				TSubclassOf<AVehicleBase> type = VehicleTypes[FMath::RandRange(0, VehicleTypes.Num() - 1)];
+				TSubclassOf<AVehicleBase> type = VehicleTypes[trafficStream.RandRange(0, VehicleTypes.Num() - 1)];
+				int32 seed = trafficStream.GetUnsignedInt(); // drawn even if spawn fails, keeps sequence stable
 				AVehicleBase* vehicle = world->SpawnActor<AVehicleBase>(type, location, rotation);
 				if (vehicle) {
+					vehicle->setRandomSeed(seed);
 					vehicle->RandomizeVehiclePaint();
 					RegisterVehicle(vehicle);
 					vehicle->onSpawnedInSystem(this);
@@ -383,6 +1000,559 @@ void AUrbanTraffic::updateVehicleSpawnVolume(bool isBegin) {
 	}
 }
 
+// ================================================================
+// ===                        DRIVER MODEL                      ===
+// ================================================================
+
+/* Gap reported when there is no leading vehicle on the lane, in centimeters. */
+static const float FREE_ROAD_GAP = 100000;
+
+float AUrbanTraffic::getDriverAcceleration(AVehicleBase* vehicle) {
+	updateLaneOrdering();
+	int* slot = laneSlots.Find(vehicle);
+	if (slot) {
+		int batchIndex = laneEntries[*slot].batchIndex;
+		if (batchIndex != INDEX_NONE) {
+			return driverBatch.accelerations[batchIndex];
+		}
+	}
+	return 0;
+}
+
+AVehicleBase* AUrbanTraffic::findLeadingVehicle(AVehicleBase* vehicle, float &gap, float &closingSpeed) {
+	updateLaneOrdering();
+	int* slot = laneSlots.Find(vehicle);
+	if (slot) {
+		const FVehicleLaneEntry &entry = laneEntries[*slot];
+		gap = entry.gap;
+		closingSpeed = entry.closingSpeed;
+		return entry.leader;
+	}
+	gap = FREE_ROAD_GAP;
+	closingSpeed = 0;
+	return nullptr;
+}
+
+bool AUrbanTraffic::isLaneOrdered(AVehicleBase* vehicle) {
+	updateLaneOrdering();
+	return laneSlots.Contains(vehicle);
+}
+
+int AUrbanTraffic::findLaneRear(URoadNode* laneNode, int lane) {
+	// entries are sorted, the rearmost one comes right before the next lane
+	int next = Algo::LowerBound(laneEntries, laneNode, [lane](const FVehicleLaneEntry &entry, URoadNode* node) {
+		return entry.laneNode != node ? entry.laneNode < node : entry.lane <= lane;
+	});
+	if (next > 0 && laneEntries[next - 1].laneNode == laneNode && laneEntries[next - 1].lane == lane) {
+		return next - 1;
+	}
+	return INDEX_NONE;
+}
+
+void AUrbanTraffic::updateLaneOrdering() {
+	if (laneOrderFrame == GFrameCounter) {
+		return;
+	}
+	laneOrderFrame = GFrameCounter;
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficLaneOrdering);
+	// collect lane positions
+	laneEntries.Reset();
+	for (AVehicleBase* vehicle : vehicles) {
+		FVehicleLaneEntry entry;
+		if (vehicle->getLanePosition(entry.laneNode, entry.lane, entry.remainLength)) {
+			entry.vehicle = vehicle;
+			laneEntries.Add(entry);
+		}
+	}
+	// sort by lane, then by remaining length, so the leader comes right before its follower
+	laneEntries.Sort([](const FVehicleLaneEntry &a, const FVehicleLaneEntry &b) {
+		if (a.laneNode != b.laneNode) {
+			return a.laneNode < b.laneNode;
+		}
+		if (a.lane != b.lane) {
+			return a.lane < b.lane;
+		}
+		return a.remainLength < b.remainLength;
+	});
+	// link followers to leaders and batch driver model inputs
+	laneSlots.Reset();
+	driverBatch.reset();
+	for (int i = 0; i < laneEntries.Num(); i++) {
+		FVehicleLaneEntry &entry = laneEntries[i];
+		AVehicleBase* vehicle = entry.vehicle;
+		IVehicleControllerInterface* controller = vehicle->getAutoController();
+		const FVehicleLaneEntry* front = i > 0 ? &laneEntries[i - 1] : nullptr;
+		// distance from the lane key of the follower to the lane key of the leader
+		float keyDistance = 0;
+		if (!front || front->laneNode != entry.laneNode || front->lane != entry.lane) {
+			// the first vehicle of a lane follows the rearmost one of the lane it enters next
+			front = nullptr;
+			URoadNode* nextLaneNode = controller ? controller->getNextLaneNode(entry.laneNode) : nullptr;
+			int rear = nextLaneNode ? findLaneRear(nextLaneNode, entry.lane) : INDEX_NONE;
+			if (rear != INDEX_NONE) {
+				front = &laneEntries[rear];
+				keyDistance = FVector::Dist(entry.laneNode->position, nextLaneNode->position);
+			}
+		}
+		if (front) {
+			float halfLengths = vehicle->Bounding->GetScaledBoxExtent().X +
+				front->vehicle->Bounding->GetScaledBoxExtent().X;
+			entry.leader = front->vehicle;
+			entry.gap = FMath::Max(0.0f, entry.remainLength + keyDistance - front->remainLength - halfLengths);
+			entry.closingSpeed = vehicle->Speed - front->vehicle->Speed;
+		}
+		else {
+			entry.leader = nullptr;
+			entry.gap = FREE_ROAD_GAP;
+			entry.closingSpeed = 0;
+		}
+		entry.batchIndex = INDEX_NONE;
+		if (controller && vehicle->LongitudinalModel == LongitudinalModelType::IntelligentDriver) {
+			entry.batchIndex = driverBatch.add(vehicle->Speed, controller->getDesiredSpeed(),
+				entry.gap, entry.closingSpeed, vehicle->DriverModel);
+		}
+		laneSlots.Add(vehicle, i);
+	}
+	driverBatch.compute();
+}
+
 //void AUrbanTraffic::recaptureNavigation() {
 //
-//}
\ No newline at end of file
+//}
+// ================================================================
+// ===                      SENSOR SCHEDULER                    ===
+// ================================================================
+
+/* Deceleration assumed for stopping distance, in cm/s^2. */
+static const float SENSOR_BRAKE_DECELERATION = 500;
+
+/* Extra interval per significance level of far vehicles, in seconds. */
+static const float SENSOR_FAR_INTERVAL = 0.1f;
+
+void AUrbanTraffic::registerSensor(UObstacleSensorComponent* sensor, AVehicleBase* vehicle) {
+	sensor->setScheduled(true);
+	sensorEntries.Add({ sensor, vehicle });
+}
+
+void AUrbanTraffic::unregisterSensor(UObstacleSensorComponent* sensor) {
+	int index = sensorEntries.IndexOfByPredicate([sensor](const FSensorScheduleEntry &entry) {
+		return entry.sensor == sensor;
+	});
+	if (index != INDEX_NONE) {
+		sensor->setScheduled(false);
+		sensorEntries.RemoveAtSwap(index);
+	}
+}
+
+bool AUrbanTraffic::isSensorScheduleEnabled() {
+	return ScheduleSensors;
+}
+
+FSensorResultBuffer& AUrbanTraffic::getSensorResults() {
+	return sensorResults;
+}
+
+float AUrbanTraffic::computeSensorInterval(UObstacleSensorComponent* sensor, AVehicleBase* vehicle) {
+	// time until an obstacle at the end of the rays needs braking
+	float speed = FMath::Abs(vehicle->Speed) / 0.036f; // km/h to cm/s
+	float stopDistance = speed * speed / (2 * SENSOR_BRAKE_DECELERATION);
+	float interval = speed < 1 ? MaxSensorInterval :
+		FMath::Clamp((sensor->TraceLength.Y - stopDistance) / speed, 0.0f, MaxSensorInterval);
+	// far vehicles are less significant
+	if (hasViewLocation) {
+		float distance = FVector::Dist(viewLocation, vehicle->GetActorLocation());
+		float significance = FMath::Clamp(distance / SensorSignificanceRadius, 1.0f, 4.0f);
+		interval = interval * significance + (significance - 1) * SENSOR_FAR_INTERVAL;
+	}
+	return interval;
+}
+
+void AUrbanTraffic::updateSensorSchedule() {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSensorSchedule);
+	int numEntries = sensorEntries.Num();
+	if (!numEntries) {
+		return;
+	}
+	// visit all sensors once from the cursor, stop when the budget runs out
+	int budget = SensorTraceBudget > 0 ? SensorTraceBudget : MAX_int32;
+	int index = sensorCursor % numEntries;
+	bool traced = false;
+	for (int i = 0; i < numEntries; i++, index = (index + 1) % numEntries) {
+		const FSensorScheduleEntry &entry = sensorEntries[index];
+		UObstacleSensorComponent* sensor = entry.sensor;
+		if (!sensor->IsActive()) {
+			continue;
+		}
+		float interval = computeSensorInterval(sensor, entry.vehicle);
+		if (sensor->GetResultAge() >= interval) {
+			int queries = sensor->getQueryCount();
+			// a sensor wider than the budget still goes through alone, so the cursor never stalls
+			if (queries > budget && traced) {
+				break; // the rest waits for next frame, starting from here
+			}
+			budget -= queries;
+			traced = true;
+			sensor->updateTraces();
+		}
+	}
+	sensorCursor = index;
+}
+
+// ================================================================
+// ===                      VIRTUAL SENSORS                     ===
+// ================================================================
+
+/* Size of virtual scene grid cells, in centimeters. */
+static const float VIRTUAL_CELL_SIZE = 2000;
+
+bool AUrbanTraffic::traceVirtualRays(const TArray<FVector> &starts, const TArray<FVector> &ends, const AActor* ignored,
+	TArray<float> &distances, TArray<AActor*> &hitActors, float padding) {
+	updateVirtualScene();
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficVirtualTrace);
+	INC_DWORD_STAT_BY(STAT_UrbanTrafficVirtualRays, starts.Num());
+	return virtualScene.traceRays(starts, ends, ignored, distances, hitActors, padding);
+}
+
+bool AUrbanTraffic::isPhysicsSensorRequired(FVector location) {
+	return hasViewLocation && FVector::DistSquared(location, viewLocation) < PhysicsSensorRadius * PhysicsSensorRadius;
+}
+
+uint32 AUrbanTraffic::getSceneRevision() {
+	if (sceneRevisionFrame != GFrameCounter) {
+		// counters only grow, so their sum changes whenever one of them does,
+		// vehicles coming and going are left to the pose check of each kept hit
+		sceneRevisionFrame = GFrameCounter;
+		sceneRevision = signalRevision;
+		for (const TWeakObjectPtr<ATrafficLight> &light : trafficLights) {
+			if (light.IsValid()) {
+				sceneRevision += light->getBlockerRevision();
+			}
+		}
+	}
+	return sceneRevision;
+}
+
+void AUrbanTraffic::updateVirtualScene() {
+	if (virtualSceneFrame == GFrameCounter) {
+		return;
+	}
+	virtualSceneFrame = GFrameCounter;
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficVirtualScene);
+	virtualScene.reset(VIRTUAL_CELL_SIZE);
+	for (AVehicleBase* vehicle : vehicles) {
+		UBoxComponent* bounding = vehicle->Bounding;
+		virtualScene.addBox(vehicle, bounding->GetComponentLocation(), bounding->GetComponentQuat(), bounding->GetScaledBoxExtent());
+	}
+	for (const TWeakObjectPtr<ATrafficLight> &light : trafficLights) {
+		UBoxComponent* blocker = light.IsValid() ? light->getActiveBlocker() : nullptr;
+		if (blocker) {
+			virtualScene.addBox(light.Get(), blocker->GetComponentLocation(), blocker->GetComponentQuat(), blocker->GetScaledBoxExtent());
+		}
+	}
+}
+
+// ================================================================
+// ===                      SIMULATION CORE                     ===
+// ================================================================
+
+/* Cycle and green time of signal groups at crossings of the simulation, in seconds. */
+static const float SIM_SIGNAL_CYCLE = 60;
+static const float SIM_SIGNAL_GREEN = 27;
+
+/* Crossings with fewer entries than this are not signalized in the simulation. */
+static const int SIM_SIGNAL_MIN_ENTRIES = 3;
+
+bool AUrbanTraffic::isSimulationActive() {
+	return OffscreenTraffic != OffscreenTrafficMode::Destroy && simTraffic.IsValid();
+}
+
+FSimDriverParams AUrbanTraffic::getSimDriverParams(AVehicleBase* vehicle) {
+	FSimDriverParams params;
+	if (vehicle) {
+		params.timeHeadway = vehicle->DriverModel.TimeHeadway;
+		params.minimumGap = vehicle->DriverModel.MinimumGap * 0.01f;
+		params.maxAcceleration = vehicle->DriverModel.MaxAcceleration;
+		params.comfortDeceleration = vehicle->DriverModel.ComfortDeceleration;
+		if (vehicle->Bounding) {
+			params.length = vehicle->Bounding->GetScaledBoxExtent().X * 0.02f;
+		}
+	}
+	return params;
+}
+
+void AUrbanTraffic::compileSimulationGraph() {
+	simGraph.clear();
+	simLinksByEntry.Reset();
+	simLinksByExit.Reset();
+	simSignalsByLight.Reset();
+	freeSimSignals.Reset();
+	simTurnLinks.Reset();
+	simSignalRevision = signalRevision;
+	if (!roadSegments.Num()) {
+		return;
+	}
+	AVehicleBase* defaultVehicle = VehicleTypes.Num() && VehicleTypes[0] ? VehicleTypes[0]->GetDefaultObject<AVehicleBase>() : nullptr;
+	float baseSpeed = (defaultVehicle ? defaultVehicle->MaxSpeedLimit : 50) / 3.6f;
+
+	// links of straight segments, one per direction, and of turns
+	TArray<URoadNodePort*> linkExits;
+	TMap<URoadNodePort*, TArray<int>> turnLinks;
+	TArray<float> points;
+	auto addPoint = [&points](FVector point) {
+		points.Add(point.X * 0.01f);
+		points.Add(point.Y * 0.01f);
+		points.Add(point.Z * 0.01f);
+	};
+	for (URoadSegment* segment : roadSegments) {
+		URoadNodeCross* crossNode = segment->getCrossNode();
+		if (crossNode) {
+			// two alternating signal groups, entries along the axis of the first entry go first,
+			// they are kept for crossings whose lights are bound later or go away
+			TArray<URoadNodePort*> entries = segment->collectEntryPorts();
+			if (!entries.Num()) {
+				continue;
+			}
+			int signals[2] = { -1, -1 };
+			bool isSignalized = crossNode->isSignalized();
+			if (entries.Num() >= SIM_SIGNAL_MIN_ENTRIES) {
+				FSimSignal signal;
+				signal.cycle = SIM_SIGNAL_CYCLE;
+				signal.green = SIM_SIGNAL_GREEN;
+				signals[0] = simGraph.addSignal(signal);
+				signal.offset = SIM_SIGNAL_CYCLE * 0.5f;
+				signals[1] = simGraph.addSignal(signal);
+			}
+			FVector axis = (crossNode->position - entries[0]->position).GetSafeNormal2D();
+			for (URoadNodePort* port : entries) {
+				FVector direction = (crossNode->position - port->position).GetSafeNormal2D();
+				int fixedSignal = signals[FMath::Abs(FVector::DotProduct(direction, axis)) > 0.7f ? 0 : 1];
+				for (URoadTurn* turn : crossNode->getPortTurns(port)) {
+					// crossings with bound lights run their signals, turns without a light are free
+					int signal = fixedSignal;
+					if (isSignalized) {
+						signal = turn->getSignal() ? getSimSignal(turn->getSignal()) : -1;
+					}
+					points.Reset();
+					for (FVector point : turn->collectPathPoints()) {
+						addPoint(point);
+					}
+					// turn paths are lane paths already, no lateral offset
+					int link = simGraph.addLink(points.GetData(), points.Num() / 3, 1, 0,
+						baseSpeed * turn->getSpeedLimit(), true, signal);
+					simTurnLinks.Add({ link, turn, fixedSignal });
+					turnLinks.FindOrAdd(port).Add(link);
+					linkExits.Add(turn->getEndPort());
+				}
+			}
+		}
+		else {
+			float speedFactor = segment->getSegmentLength() / FMath::Max(segment->getTravelCost(), 1.0f);
+			for (bool invert : { false, true }) {
+				TArray<URoadNodePort*> ports = segment->collectPorts(invert);
+				if (ports.Num() < 2 || !ports[0]->numRights) {
+					continue;
+				}
+				points.Reset();
+				for (URoadNode* node : segment->collectNodes(invert)) {
+					addPoint(node->position);
+				}
+				int link = simGraph.addLink(points.GetData(), points.Num() / 3, ports[0]->numRights,
+					ports[0]->laneWidth * 0.01f, baseSpeed * speedFactor, false);
+				// one-way ports number their lanes around the centre line
+				simGraph.links[link].laneOffset = ports[0]->getMinRight();
+				simLinksByEntry.Add(ports[0], link);
+				simLinksByExit.Add(ports.Last(), link);
+				linkExits.Add(ports.Last());
+			}
+		}
+	}
+
+	// connect exits to the entries of the next segment
+	for (int link = 0; link < linkExits.Num(); link++) {
+		URoadNodePort* nextPort = linkExits[link]->getConnectedPort();
+		if (!nextPort) {
+			continue;
+		}
+		if (int* straight = simLinksByEntry.Find(nextPort)) {
+			simGraph.connect(link, *straight);
+		}
+		else if (TArray<int>* turns = turnLinks.Find(nextPort)) {
+			for (int turn : *turns) {
+				simGraph.connect(link, turn);
+			}
+		}
+	}
+	simGraph.finalize();
+}
+
+int AUrbanTraffic::getSimSignal(ATrafficLight* light) {
+	if (int* signal = simSignalsByLight.Find(light)) {
+		return *signal;
+	}
+	FSimSignal signal;
+	float greenStart;
+	int index = -1;
+	if (light->getSignalWindow(greenStart, signal.green, signal.yellow)) {
+		// the phase runs from now, which is the current time of the simulation
+		double simTime = simTraffic ? simTraffic->getTime() : 0;
+		signal.cycle = FMath::Max(1, light->getSignalMaster()->getCycleLength());
+		signal.offset = simTime + greenStart - light->getSignalPhase(getSignalCountdown(light));
+		if (freeSimSignals.Num()) {
+			index = freeSimSignals.Pop(false);
+			simGraph.signals[index] = signal;
+		}
+		else {
+			index = simGraph.addSignal(signal);
+		}
+	}
+	simSignalsByLight.Add(light, index);
+	return index;
+}
+
+void AUrbanTraffic::updateSimSignals() {
+	simSignalRevision = signalRevision;
+	// lights may be gone, only their signal indices are kept
+	for (const TPair<ATrafficLight*, int> &pair : simSignalsByLight) {
+		if (pair.Value >= 0) {
+			freeSimSignals.Add(pair.Value);
+		}
+	}
+	simSignalsByLight.Reset();
+	for (const FSimTurnLink &turnLink : simTurnLinks) {
+		int signal = turnLink.fixedSignal;
+		if (turnLink.turn->getCrossNode()->isSignalized()) {
+			ATrafficLight* light = turnLink.turn->getSignal();
+			signal = light ? getSimSignal(light) : -1;
+		}
+		simGraph.links[turnLink.link].signal = signal;
+	}
+}
+
+void AUrbanTraffic::buildSimulation() {
+	simTraffic.Reset();
+	compileSimulationGraph();
+	if (OffscreenTraffic == OffscreenTrafficMode::Destroy || simGraph.links.empty()) {
+		return;
+	}
+
+	// populate with the seed of the traffic stream, the simulation does not depend on the thread count
+	if (OffscreenTraffic == OffscreenTrafficMode::Mesoscopic) {
+		simTraffic = MakeUnique<FSimMesoTraffic>(simGraph, (uint32)TrafficSeed);
+	}
+	else {
+		simTraffic = MakeUnique<FSimTraffic>(simGraph, SimulationThreads, (uint32)TrafficSeed);
+	}
+	for (int i = 0; i < SimulatedVehicles; i++) {
+		TSubclassOf<AVehicleBase> type = VehicleTypes.Num() ? VehicleTypes[trafficStream.RandRange(0, VehicleTypes.Num() - 1)] : nullptr;
+		FSimDriverParams params = getSimDriverParams(type ? type->GetDefaultObject<AVehicleBase>() : nullptr);
+		params.speedFactor = trafficStream.FRandRange(0.9f, 1.1f);
+		simTraffic->addRandomVehicle(params);
+	}
+	UE_LOG(LogUrbanTraffic, Log, TEXT("Simulation core: %d links, %d lanes, %d vehicles"),
+		(int)simGraph.links.size(), simGraph.numLanes, simTraffic->num());
+}
+
+void AUrbanTraffic::updateSimulationMirror(FVector focus, AVehicleBase* playerVehicle) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficSimulationMirror);
+	float hideRadiusSquared = FMath::Square(MirrorRadius * 1.2f);
+	float showRadiusSquared = FMath::Square(MirrorRadius);
+	// far actors go back first, so their lanes are known to vehicles mirrored next
+	for (int i = vehicles.Num() - 1; i >= 0; i--) {
+		AVehicleBase* vehicle = vehicles[i];
+		if (vehicle != playerVehicle && FVector::DistSquared2D(vehicle->GetActorLocation(), focus) > hideRadiusSquared) {
+			dematerializeVehicle(vehicle);
+		}
+	}
+	FVector focusMeters = focus * 0.01f;
+	for (int id = 0; id < simTraffic->getCapacity(); id++) {
+		if (!simTraffic->isAlive(id) || simGraph.links[simTraffic->getLink(id)].isTurn) {
+			continue;
+		}
+		float x, y, z, heading;
+		simTraffic->locate(id, x, y, z, heading);
+		if (FVector::DistSquared2D(FVector(x, y, z), focusMeters) * 10000 < showRadiusSquared) {
+			materializeVehicle(id);
+		}
+	}
+	SET_DWORD_STAT(STAT_UrbanTrafficSimulatedVehicles, simTraffic->num());
+}
+
+bool AUrbanTraffic::materializeVehicle(int id) {
+	if (!VehicleTypes.Num()) {
+		return false;
+	}
+	float x, y, z, heading;
+	simTraffic->locate(id, x, y, z, heading);
+	FVector location = FVector(x, y, z) * 100;
+	FRotator rotation(0, FMath::RadiansToDegrees(heading), 0);
+	TSubclassOf<AVehicleBase> type = VehicleTypes[trafficStream.RandRange(0, VehicleTypes.Num() - 1)];
+	int32 seed = trafficStream.GetUnsignedInt();
+	AVehicleBase* vehicle = GetWorld()->SpawnActor<AVehicleBase>(type, location, rotation);
+	if (!vehicle) {
+		// blocked by an actor, try again next update
+		return false;
+	}
+	vehicle->setRandomSeed(seed);
+	vehicle->RandomizeVehiclePaint();
+	RegisterVehicle(vehicle);
+	vehicle->onSpawnedInSystem(this);
+	// keep the simulated speed
+	UPrimitiveComponent* body = Cast<UPrimitiveComponent>(vehicle->GetRootComponent());
+	if (body && body->IsSimulatingPhysics()) {
+		body->SetPhysicsLinearVelocity(rotation.Vector() * simTraffic->getSpeed(id) * 100);
+	}
+	simTraffic->removeVehicle(id);
+	return true;
+}
+
+bool AUrbanTraffic::dematerializeVehicle(AVehicleBase* vehicle) {
+	URoadNode* laneNode;
+	int lane;
+	float remainLength;
+	if (!vehicle->getLanePosition(laneNode, lane, remainLength) || laneNode->getNodeType() != RoadNodeType::Port) {
+		return false;
+	}
+	int* link = simLinksByExit.Find((URoadNodePort*)laneNode);
+	if (!link || laneNode->getSegment()->getCrossNode()) {
+		return false;
+	}
+	const FSimLink &simLink = simGraph.links[*link];
+	float position = FMath::Clamp(simLink.length - remainLength * 0.01f, 0.0f, simLink.length);
+	simTraffic->addVehicle(*link, lane - simLink.laneOffset, position, FMath::Max(0.0f, vehicle->Speed) / 3.6f, getSimDriverParams(vehicle));
+	vehicle->Destroy();
+	return true;
+}
+
+// ================================================================
+// ===                           STATS                          ===
+// ================================================================
+
+void AUrbanTraffic::updateTrafficStats(float deltaSeconds) {
+#if STATS
+	// vehicle tiers follow sensor significance
+	int numNear = 0, numNormal = 0, numFar = 0;
+	for (AVehicleBase* vehicle : vehicles) {
+		float distance = hasViewLocation ? FVector::Dist(viewLocation, vehicle->GetActorLocation()) : 0;
+		if (distance < PhysicsSensorRadius) {
+			numNear++;
+		}
+		else if (distance < SensorSignificanceRadius) {
+			numNormal++;
+		}
+		else {
+			numFar++;
+		}
+	}
+	SET_DWORD_STAT(STAT_UrbanTrafficVehiclesNear, numNear);
+	SET_DWORD_STAT(STAT_UrbanTrafficVehiclesNormal, numNormal);
+	SET_DWORD_STAT(STAT_UrbanTrafficVehiclesFar, numFar);
+	// spawn rates over the last second
+	spawnStatTimer += deltaSeconds;
+	if (spawnStatTimer >= 1) {
+		SET_FLOAT_STAT(STAT_UrbanTrafficSpawnRate, spawnStatCount / spawnStatTimer);
+		SET_FLOAT_STAT(STAT_UrbanTrafficDespawnRate, despawnStatCount / spawnStatTimer);
+		spawnStatCount = despawnStatCount = 0;
+		spawnStatTimer = 0;
+	}
+#endif
+}
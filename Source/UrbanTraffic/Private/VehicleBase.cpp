@@ -247,7 +247,7 @@ void AVehicleBase::RandomizeVehiclePaint()
 {
 	if (PaintSets.Num()) {
 		USkeletalMeshComponent* mesh = GetMesh();
-		VehiclePaint = PaintSets[FMath::RandRange(0, PaintSets.Num() - 1)];
+		VehiclePaint = PaintSets[randomStream.RandRange(0, PaintSets.Num() - 1)];
 		mesh->SetVectorParameterValueOnMaterials(PAINT_PRIMARY, (FVector)VehiclePaint.PrimaryColor);
 		mesh->SetVectorParameterValueOnMaterials(PAINT_SECONDARY, (FVector)VehiclePaint.SecondaryColor);
 	}
@@ -350,6 +350,10 @@ void AVehicleBase::onDestroyInSystem() {
 	}
 }
 
+USceneComponent* AVehicleBase::getLightContainer() {
+	return lights;
+}
+
 bool AVehicleBase::isSpawnableAt(URoadSegment* segment, bool invert) {
 	if (autoController && prevNode->getSegment() == segment) {
 		if (autoController->invertPath == invert) {
@@ -359,6 +363,35 @@ bool AVehicleBase::isSpawnableAt(URoadSegment* segment, bool invert) {
 	return true;
 }
 
+bool AVehicleBase::getLanePosition(URoadNode* &laneNode, int &lane, float &remainLength) {
+	if (autoController) {
+		return autoController->getLanePosition(laneNode, lane, remainLength);
+	}
+	// manual vehicles are only tracked on straight segments
+	float absLane = GetAbsoluteLane(); // this also updates prevNode
+	if (!FMath::IsNaN(absLane)) {
+		URoadSegment* segment = prevNode->getSegment();
+		bool invert = FVector::DotProduct(prevNode->getHeadVector(true), GetActorForwardVector()) > 0;
+		laneNode = segment->getExitPort(invert);
+		lane = FMath::RoundToInt(absLane);
+		remainLength = segment->getLengthOnSegment(GetActorLocation(), !invert);
+		return laneNode != nullptr;
+	}
+	return false;
+}
+
+AUrbanTraffic* AVehicleBase::getTrafficManager() {
+	return trafficManager;
+}
+
+void AVehicleBase::setRandomSeed(int32 seed) {
+	randomStream.Initialize(seed);
+}
+
+FRandomStream& AVehicleBase::getRandomStream() {
+	return randomStream;
+}
+
 // ================================================================
 // ===                         VEHICLE AI                       ===
 // ================================================================
@@ -386,6 +419,10 @@ bool AVehicleBase::isAutoMode() {
 	return autoController != nullptr;
 }
 
+IVehicleControllerInterface* AVehicleBase::getAutoController() {
+	return autoController;
+}
+
 // ================================================================
 // ===                      CONTROL DELEGATE                    ===
 // ================================================================
@@ -441,6 +478,10 @@ void AVehicleBase::SetLightState(bool state) {
 	}
 }
 
+bool AVehicleBase::GetLightState() {
+	return lightState;
+}
+
 void AVehicleBase::SetSideLightState(SideLightState state) {
 	if (state != sideLightState) {
 		sideLightState = state;
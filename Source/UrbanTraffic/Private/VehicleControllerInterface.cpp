@@ -24,6 +24,9 @@
 
 #include "VehicleControllerInterface.h"
 #include "VehicleBase.h"
+#include "UrbanTraffic.h"
+#include "RoadTurn.h"
+#include "TrafficStats.h"
 #include "WheeledVehicleMovementComponent.h"
 #include "DrawDebugHelpers.h"
 #include "Kismet/KismetSystemLibrary.h"
@@ -35,6 +38,8 @@
 void IVehicleControllerInterface::bindVehicle(AVehicleBase* target) {
 	// trigger target reached
 	currentTarget = target->GetActorLocation();
+	// the driver model reads desired speed before the first driving input, start from cruising
+	desiredSpeed = target->MaxSpeedLimit;
 	
 	// initial path data
 	//prevNode = trafficManager->findNearestRoadNode(GetActorLocation());
@@ -94,20 +99,47 @@ void IVehicleControllerInterface::bindVehicle(AVehicleBase* target) {
 	leftSensor->AttachToComponent(root, FAttachmentTransformRules::KeepRelativeTransform);
 	leftSensor->RegisterComponent();
 	// setup lane switch sensor
-	laneSensor = NewObject<UObstacleSensorComponent>(target);
-	laneSensor->TraceLength = FVector2D(0, 2000);
-	laneSensor->RelativeLocation = headSensor->RelativeLocation;
-	laneSensor->AttachToComponent(root, FAttachmentTransformRules::KeepRelativeTransform);
-	laneSensor->RegisterComponent();
-	laneSensor->SetActive(false);
-	
+	leftLaneSensor = NewObject<UObstacleSensorComponent>(target);
+	leftLaneSensor->TraceLength = FVector2D(0, 2000);
+	leftLaneSensor->RelativeLocation = headSensor->RelativeLocation + FVector(0, -500, 0);
+	leftLaneSensor->AttachToComponent(root, FAttachmentTransformRules::KeepRelativeTransform);
+	leftLaneSensor->RegisterComponent();
+	leftLaneSensor->SetActive(false);
+	rightLaneSensor = NewObject<UObstacleSensorComponent>(target);
+	rightLaneSensor->TraceLength = FVector2D(0, 2000);
+	rightLaneSensor->RelativeLocation = headSensor->RelativeLocation + FVector(0, 500, 0);
+	rightLaneSensor->AttachToComponent(root, FAttachmentTransformRules::KeepRelativeTransform);
+	rightLaneSensor->RegisterComponent();
+	rightLaneSensor->SetActive(false);
+
+	// async sensors: one frame latency, requested sensors report unknown space as blocked
+	for (UObstacleSensorComponent* sensor : { headSensor, backSensor, rightSensor, leftSensor, leftLaneSensor, rightLaneSensor }) {
+		sensor->AsyncTrace = target->AsyncSensors;
+		sensor->Backend = target->SensorBackend;
+		sensor->Shape = target->SensorShape;
+		sensor->CoherenceFrames = target->SensorCoherenceFrames;
+		sensor->setTrafficManager(target->getTrafficManager());
+	}
+	// lane checks come at any node, so async lane sensors keep tracing to stay one frame old
+	leftLaneSensor->SetActive(target->AsyncSensors);
+	rightLaneSensor->SetActive(target->AsyncSensors);
+
+	// let the manager schedule ticking sensors by speed and significance
+	AUrbanTraffic* manager = target->getTrafficManager();
+	if (manager && manager->isSensorScheduleEnabled()) {
+		for (UObstacleSensorComponent* sensor : { headSensor, rightSensor, leftSensor, leftLaneSensor, rightLaneSensor }) {
+			manager->registerSensor(sensor, target);
+		}
+	}
+
 	// draw sensor debug
 	if (target->DrawObstacleSensors) {
 		headSensor->bVisible = true;
 		//backSensor->bVisible = true;
 		rightSensor->bVisible = true;
 		leftSensor->bVisible = true;
-		//laneSensor->bVisible = true;
+		//leftLaneSensor->bVisible = true;
+		//rightLaneSensor->bVisible = true;
 	}
 
 	// assign vehicle pointer
@@ -116,12 +148,20 @@ void IVehicleControllerInterface::bindVehicle(AVehicleBase* target) {
 
 void IVehicleControllerInterface::unbindVehicle() {
 	if (vehicle) {
+		setUpcomingTurn(nullptr);
+		AUrbanTraffic* manager = vehicle->getTrafficManager();
+		if (manager) {
+			for (UObstacleSensorComponent* sensor : { headSensor, rightSensor, leftSensor, leftLaneSensor, rightLaneSensor }) {
+				manager->unregisterSensor(sensor);
+			}
+		}
 		vehicle = nullptr;
 		headSensor->DestroyComponent();
 		backSensor->DestroyComponent();
 		rightSensor->DestroyComponent();
 		leftSensor->DestroyComponent();
-		laneSensor->DestroyComponent();
+		leftLaneSensor->DestroyComponent();
+		rightLaneSensor->DestroyComponent();
 	}
 }
 
@@ -129,7 +169,11 @@ void IVehicleControllerInterface::unbindVehicle() {
 // ===                      AUTO CONTROLLER                     ===
 // ================================================================
 
+DECLARE_CYCLE_STAT(TEXT("Compute Driving Input"), STAT_UrbanTrafficDrivingInput, STATGROUP_UrbanTraffic);
+
 void IVehicleControllerInterface::computeDrivingInput(float deltaSeconds) {
+	SCOPE_CYCLE_COUNTER(STAT_UrbanTrafficDrivingInput);
+	TRAFFIC_TRACE_SCOPE(ComputeDrivingInput);
 	if (vehicle) {
 		bool targetReached = FVector::Dist(vehicle->GetActorLocation(), currentTarget) < 300;
 		if (targetReached) {
@@ -138,21 +182,28 @@ void IVehicleControllerInterface::computeDrivingInput(float deltaSeconds) {
 				vehicle->SetThrottle(0);
 				vehicle->SetSteering(0);
 				vehicle->SetHandBrake(false);
+				if (destinationReached) {
+					// listeners may despawn the vehicle, so they are notified once the path is consistent
+					destinationReached = false;
+					vehicle->OnDestinationReached.Broadcast(vehicle);
+				}
 			}
 		}
 		else {
+			bool useDriverModel = isDriverModelActive();
+
 			if (!switchingLane && !nextNode->getSegment()->getCrossNode()
 				&& vehicle->GetSideLightState() == SideLightState::None
-				&& headSensor->IsObstacleDetected()) {
+				&& isHeadBlocked()) {
 				float remainLength = nextNode->getLengthOnSegment(!invertPath);
 				if (remainLength > 1400) {
 					if (canSwitchRight()) {
-						float targetDst = FMath::Min(remainLength, laneSensor->GetNearestDistance());
+						float targetDst = FMath::Min(remainLength, rightLaneSensor->GetNearestDistance());
 						switchLane(currentLane + 1, targetDst);
 						return;
 					}
 					else if (canSwitchLeft()) {
-						float targetDst = FMath::Min(remainLength, laneSensor->GetNearestDistance());
+						float targetDst = FMath::Min(remainLength, leftLaneSensor->GetNearestDistance());
 						switchLane(currentLane - 1, targetDst);
 						return;
 					}
@@ -169,16 +220,47 @@ void IVehicleControllerInterface::computeDrivingInput(float deltaSeconds) {
 			float cosForward = FVector::DotProduct(vehicle->GetActorForwardVector(), targetDir);
 			float cosRight = FVector::DotProduct(vehicle->GetActorRightVector(), targetDir);
 			
-			// speed limit by collision detectors or nodes
-			speedLimit = headSensor->GetNormalizedValue();
+			// speed limit by collision detectors or nodes,
+			// the driver model keeps distance by itself so only nodes limit it
+			speedLimit = useDriverModel ? 1.0f : headSensor->GetNormalizedValue();
 			if (nextNode && nextNode->speedLimit < speedLimit) {
 				speedLimit = nextNode->speedLimit;
 			}
+
+			// stop at the stop line while the crossing is not reserved or the signal stops the turn
+			float stopDistance = 0;
+			bool stopAtLine = !updateReservation(stopDistance);
+			float signalDistance = 0;
+			if (!updateSignal(signalDistance)) {
+				stopDistance = stopAtLine ? FMath::Min(stopDistance, signalDistance) : signalDistance;
+				stopAtLine = true;
+			}
+			if (stopAtLine && !useDriverModel) {
+				float stopLimit = FMath::GetMappedRangeValueClamped(headSensor->TraceLength, headSensor->NormalizeRange, stopDistance);
+				speedLimit = FMath::Min(speedLimit, stopLimit);
+			}
 			maxSpeed = vehicle->MaxSpeedLimit * speedLimit * cosForward;
 
+			// acceleration from the driver model, in m/s^2
+			const FDriverModelParams &driverParams = vehicle->DriverModel;
+			float acceleration = useDriverModel ?
+				vehicle->getTrafficManager()->getDriverAcceleration(vehicle) : 0;
+			if (stopAtLine && useDriverModel) {
+				float stopAcceleration = FDriverModelBatch::computeSingle(vehicle->Speed, maxSpeed, stopDistance, vehicle->Speed, driverParams);
+				acceleration = FMath::Min(acceleration, stopAcceleration);
+			}
+			float obstacleDistance;
+			if (useDriverModel && getObstacleDistance(obstacleDistance)) {
+				// obstacles which are not ordered in lanes are followed as standing leaders
+				float obstacleAcceleration = FDriverModelBatch::computeSingle(vehicle->Speed, maxSpeed, obstacleDistance, vehicle->Speed, driverParams);
+				acceleration = FMath::Min(acceleration, obstacleAcceleration);
+			}
+
 			// hand brake
-			bool needBrake = (vehicle->Speed > 0.2f && speedLimit < 0.24f) ||
-				(vehicle->Speed < -2 && backSensor->DoCollisionTest());
+			bool needBrake = useDriverModel ?
+				(vehicle->Speed < 1 && acceleration < 0) || (acceleration < -2 * driverParams.ComfortDeceleration) :
+				(vehicle->Speed > 0.2f && speedLimit < 0.24f);
+			needBrake = needBrake || (vehicle->Speed < -2 && backSensor->RequestCollisionTest());
 
 			// steering
 			if (rightSensor->IsObstacleDetected()) {
@@ -209,6 +291,9 @@ void IVehicleControllerInterface::computeDrivingInput(float deltaSeconds) {
 				steering = 0;
 			}
 
+			// the driver model reads desired speed on next frame
+			desiredSpeed = FMath::Max(0.0f, maxSpeed);
+
 			// throttle
 			float deltaSpeed = maxSpeed - vehicle->Speed;
 			if (forceBackward >= 0) {
@@ -223,6 +308,18 @@ void IVehicleControllerInterface::computeDrivingInput(float deltaSeconds) {
 					forceBackward = 1.2f; // secs at least
 				}
 			}
+			else if (useDriverModel) {
+				if (acceleration > 0) {
+					throttle = FMath::Min(acceleration / driverParams.MaxAcceleration, 1.0f);
+				}
+				else if (vehicle->Speed > 1 && !needBrake) {
+					// negative throttle works as brake while moving forward
+					throttle = FMath::Max(acceleration / driverParams.ComfortDeceleration, -1.0f) * 0.68f;
+				}
+				else {
+					throttle = 0;
+				}
+			}
 			else if (deltaSpeed > 0.2f && speedLimit > 0.24f && !needBrake) {
 				throttle = FMath::Min(deltaSpeed, 1.0f) * 0.68f;
 			}
@@ -254,7 +351,11 @@ bool IVehicleControllerInterface::updatePathTarget() {
 			float lengthToEnd = nextNode->getLengthOnSegment(!invertPath);
 			if (lengthToEnd < 6000 && endPort->getSegment() == curSegment) {
 				//DrawDebugPoint(GetWorld(), GetActorLocation() + FVector(0, 0, 20), 6, FColor::Red, true);
-				switch (startPort->appendRoadNodes(roadNodes)) {
+				URoadTurn* turn = popPlannedTurn(startPort);
+				RoadTurnType turnType = startPort->appendRoadNodes(roadNodes, vehicle->getRandomStream(), turn);
+				setUpcomingTurn(turn);
+				TRAFFIC_TRACE_DECISION(vehicle, Turn);
+				switch (turnType) {
 				case RoadTurnType::Left:
 					nextLane = startPort->getMinRight();
 					vehicle->SetSideLightState(SideLightState::Left);
@@ -270,7 +371,12 @@ bool IVehicleControllerInterface::updatePathTarget() {
 		}
 		// append nodes when current nodes running out (usually crossing segment)
 		if (!roadNodes.Num()) {
-			startPort->appendRoadNodes(roadNodes);
+			URoadTurn* turn = popPlannedTurn(startPort);
+			startPort->appendRoadNodes(roadNodes, vehicle->getRandomStream(), turn);
+			if (turn) {
+				setUpcomingTurn(turn);
+				TRAFFIC_TRACE_DECISION(vehicle, Turn);
+			}
 			switch (nextNode->getTurnType()) {
 			case RoadTurnType::Left:
 				nextLane = startPort->getMinRight();
@@ -279,7 +385,7 @@ bool IVehicleControllerInterface::updatePathTarget() {
 				nextLane = FMath::Max(endPort->getMaxLeft(), startPort->getMaxRight());
 				break;
 			case RoadTurnType::None:
-				nextLane = startPort->randomRightLane(currentLane);
+				nextLane = startPort->randomRightLane(currentLane, vehicle->getRandomStream());
 				break;
 			}
 			vehicle->SetSideLightState(SideLightState::None);
@@ -289,6 +395,14 @@ bool IVehicleControllerInterface::updatePathTarget() {
 			//DrawDebugPoint(GetWorld(), GetActorLocation() + FVector(0, 0, 40), 6, FColor::Blue, true);
 		}
 	}
+	if (replanRoute) {
+		replanRoute = false;
+		AUrbanTraffic* manager = vehicle->getTrafficManager();
+		if (manager) {
+			manager->RequestVehicleRoute(vehicle, routeDestination);
+			TRAFFIC_TRACE_DECISION(vehicle, Reroute);
+		}
+	}
 	if (roadNodes.Num()) {
 		// remember previous node
 		vehicle->prevNode = nextNode;
@@ -321,6 +435,14 @@ bool IVehicleControllerInterface::updatePathTarget() {
 }
 
 void IVehicleControllerInterface::switchLane(int targetLane, float forwardDistance) {
+#if URBANTRAFFIC_TRACE
+	if (targetLane < currentLane) {
+		TRAFFIC_TRACE_DECISION(vehicle, SwitchLeft);
+	}
+	else if (targetLane > currentLane) {
+		TRAFFIC_TRACE_DECISION(vehicle, SwitchRight);
+	}
+#endif
 	URoadSegment* segment = nextNode->getSegment();
 	float currentLength = segment->getLengthOnSegment(vehicle->GetActorLocation(), invertPath);
 	float targetLength = FMath::Min(currentLength + forwardDistance, segment->getSegmentLength());
@@ -373,24 +495,276 @@ void IVehicleControllerInterface::switchLane(int targetLane, float forwardDistan
 
 bool IVehicleControllerInterface::canSwitchLeft() {
 	if (currentLane > inPort->getMinRight()) {
-		//laneSensor->RelativeRotation.Yaw = headSensor->RelativeRotation.Yaw;
-		laneSensor->RelativeLocation.Y = -500;
-		laneSensor->DoCollisionTest();
-		return laneSensor->GetNearestDistance() > headSensor->GetNearestDistance() + 400;
+		leftLaneSensor->RequestCollisionTest();
+		return leftLaneSensor->GetNearestDistance() > getHeadDistance() + 400;
 	}
 	return false;
 }
 
 bool IVehicleControllerInterface::canSwitchRight() {
 	if (currentLane < inPort->getMaxRight()) {
-		//laneSensor->RelativeRotation.Yaw = headSensor->RelativeRotation.Yaw;
-		laneSensor->RelativeLocation.Y = 500;
-		laneSensor->DoCollisionTest();
-		return laneSensor->GetNearestDistance() > headSensor->GetNearestDistance() + 400;
+		rightLaneSensor->RequestCollisionTest();
+		return rightLaneSensor->GetNearestDistance() > getHeadDistance() + 400;
 	}
 	return false;
 }
 
+/* Distance before the stop line where a vehicle starts requesting its slot, in centimeters. */
+static const float RESERVATION_DISTANCE = 3000;
+
+bool IVehicleControllerInterface::updateReservation(float &stopDistance) {
+	AUrbanTraffic* manager = vehicle->getTrafficManager();
+	bool canEnter = true;
+	bool holding = false;
+	if (upcomingTurn && manager && manager->isReservationEnabled()) {
+		URoadNodeCross* crossNode = upcomingTurn->getCrossNode();
+		URoadNodePort* startPort = upcomingTurn->getStartPort();
+		float now = vehicle->GetWorld()->GetTimeSeconds();
+		float vehicleLength = vehicle->Bounding->GetScaledBoxExtent().X * 2;
+		// speeds are in km/h, 1 km/h = 1 / 0.036 cm/s
+		float crossSpeed = FMath::Max(vehicle->MaxSpeedLimit * upcomingTurn->getSpeedLimit(), 10.0f) / 0.036f;
+		float crossTime = (upcomingTurn->getTurnLength() + vehicleLength) / crossSpeed;
+		if (nextNode->getSegment() == startPort->getSegment() && nextNode != startPort) {
+			// inside the crossing, keep the slot until leaving
+			crossEntered = true;
+			if (reservationGranted) {
+				crossNode->refreshReservation(vehicle, now + crossTime);
+				holding = true;
+			}
+		}
+		else if (crossEntered) {
+			// left the crossing
+			setUpcomingTurn(nullptr);
+		}
+		else {
+			stopDistance = FVector::DotProduct(startPort->position - vehicle->GetActorLocation(), vehicle->GetActorForwardVector())
+				- vehicleLength / 2;
+			if (stopDistance <= 0) {
+				// over the stop line, committed to the crossing, stopping now would block its mouth
+				if (reservationGranted) {
+					crossNode->refreshReservation(vehicle, now + crossTime);
+				}
+			}
+			else if (stopDistance < RESERVATION_DISTANCE) {
+				if (isHeadBlocked()) {
+					// queued behind another vehicle, do not hold a slot while waiting
+					crossNode->releaseReservation(vehicle);
+					reservationGranted = false;
+				}
+				else {
+					float approachSpeed = FMath::Max(vehicle->Speed, 10.0f) / 0.036f;
+					float enterTime = now + stopDistance / approachSpeed;
+					// a granted slot is kept and only stretched, requesting again would drop it first
+					bool granted = reservationGranted && crossNode->refreshReservation(vehicle, enterTime + crossTime);
+					if (!granted) {
+						granted = crossNode->requestReservation(upcomingTurn, vehicle, now, enterTime, enterTime + crossTime);
+					}
+					if (granted != reservationGranted) {
+						if (granted) {
+							TRAFFIC_TRACE_DECISION(vehicle, ReservationGranted);
+						}
+						else {
+							TRAFFIC_TRACE_DECISION(vehicle, ReservationDenied);
+						}
+					}
+					reservationGranted = granted;
+				}
+				canEnter = reservationGranted;
+			}
+		}
+	}
+	// side traces are not needed inside a reserved crossing
+	if (rightSensor->IsActive() == holding) {
+		rightSensor->SetActive(!holding);
+		leftSensor->SetActive(!holding);
+	}
+	return canEnter;
+}
+
+bool IVehicleControllerInterface::updateSignal(float &stopDistance) {
+	if (!upcomingTurn) {
+		return true;
+	}
+	TrafficLightState state = upcomingTurn->getSignalState();
+	if (state != TrafficLightState::Red && state != TrafficLightState::Yellow) {
+		return true;
+	}
+	URoadNodePort* startPort = upcomingTurn->getStartPort();
+	if (nextNode->getSegment() == startPort->getSegment() && nextNode != startPort) {
+		// already inside the crossing
+		return true;
+	}
+	float vehicleLength = vehicle->Bounding->GetScaledBoxExtent().X * 2;
+	stopDistance = FVector::DotProduct(startPort->position - vehicle->GetActorLocation(), vehicle->GetActorForwardVector())
+		- vehicleLength / 2;
+	if (stopDistance < 0) {
+		// over the stop line, or the turn is behind
+		return true;
+	}
+	if (state == TrafficLightState::Yellow) {
+		// pass at yellow when stopping would take more than comfortable braking, speeds in km/h
+		float speed = FMath::Max(0.0f, vehicle->Speed) / 0.036f;
+		float brakeDistance = speed * speed / (2 * vehicle->DriverModel.ComfortDeceleration * 100);
+		return stopDistance < brakeDistance;
+	}
+	return false;
+}
+
+void IVehicleControllerInterface::setUpcomingTurn(URoadTurn* turn) {
+	if (upcomingTurn) {
+		upcomingTurn->getCrossNode()->releaseReservation(vehicle);
+	}
+	upcomingTurn = turn;
+	reservationGranted = false;
+	crossEntered = false;
+}
+
+bool IVehicleControllerInterface::isDriverModelActive() {
+	return vehicle->LongitudinalModel == LongitudinalModelType::IntelligentDriver
+		&& vehicle->getTrafficManager();
+}
+
+bool IVehicleControllerInterface::isHeadBlocked() {
+	if (isDriverModelActive()) {
+		return getHeadDistance() < headSensor->TraceLength.Y;
+	}
+	return headSensor->IsObstacleDetected();
+}
+
+float IVehicleControllerInterface::getHeadDistance() {
+	if (isDriverModelActive()) {
+		float distance = headSensor->TraceLength.Y;
+		float gap, closingSpeed, obstacleDistance;
+		if (vehicle->getTrafficManager()->findLeadingVehicle(vehicle, gap, closingSpeed)) {
+			distance = FMath::Min(distance, gap);
+		}
+		if (getObstacleDistance(obstacleDistance)) {
+			distance = FMath::Min(distance, obstacleDistance);
+		}
+		return distance;
+	}
+	return headSensor->GetNearestDistance();
+}
+
+bool IVehicleControllerInterface::getObstacleDistance(float &distance) {
+	AUrbanTraffic* manager = vehicle->getTrafficManager();
+	return headSensor->findNearestHit([manager](AActor* actor) {
+		// gaps to vehicles ordered in lanes come from the leading vehicle
+		AVehicleBase* other = Cast<AVehicleBase>(actor);
+		return !other || !manager->isLaneOrdered(other);
+	}, distance);
+}
+
+bool IVehicleControllerInterface::getLanePosition(URoadNode* &laneNode, int &lane, float &remainLength) {
+	if (vehicle && nextNode) {
+		URoadSegment* segment = nextNode->getSegment();
+		FVector location = vehicle->GetActorLocation();
+		lane = currentLane;
+		if (segment->getCrossNode()) {
+			// vehicles inside crossing are ordered by the node they are heading to
+			laneNode = nextNode;
+			remainLength = FVector::Dist(location, nextNode->position);
+		}
+		else {
+			// vehicles on straight segment are ordered by the exit port
+			laneNode = segment->getExitPort(invertPath);
+			remainLength = segment->getLengthOnSegment(location, !invertPath);
+		}
+		return laneNode != nullptr;
+	}
+	return false;
+}
+
+float IVehicleControllerInterface::getDesiredSpeed() {
+	return desiredSpeed;
+}
+
+URoadNode* IVehicleControllerInterface::getNextLaneNode(URoadNode* laneNode) {
+	bool invert = invertPath;
+	for (URoadNode* node : roadNodes) {
+		URoadSegment* segment = node->getSegment();
+		URoadNode* nextLaneNode = node;
+		if (!segment->getCrossNode()) {
+			// straight segments are entered by a port, which tells the direction
+			if (node->getNodeType() == RoadNodeType::Port) {
+				invert = node->nextIndex < 0;
+			}
+			nextLaneNode = segment->getExitPort(invert);
+		}
+		if (nextLaneNode && nextLaneNode != laneNode) {
+			return nextLaneNode;
+		}
+	}
+	return nullptr;
+}
+
+URoadNodePort* IVehicleControllerInterface::getPlanningPort() {
+	return endPort ? endPort->getConnectedPort() : nullptr;
+}
+
+void IVehicleControllerInterface::setRouteDestination(FVector destination) {
+	routeDestination = destination;
+	hasDestination = true;
+	destinationReached = false;
+	destinationZone = -1;
+}
+
+void IVehicleControllerInterface::setPlannedRoute(const TArray<URoadTurn*> &turns) {
+	plannedTurns = turns;
+	if (!plannedTurns.Num()) {
+		// destination is reachable without any turn
+		reachDestination();
+	}
+}
+
+bool IVehicleControllerInterface::hasPlannedRoute() {
+	return plannedTurns.Num() > 0 || destinationZone >= 0;
+}
+
+void IVehicleControllerInterface::setDestinationZone(int zone) {
+	plannedTurns.Reset();
+	destinationZone = zone;
+}
+
+URoadTurn* IVehicleControllerInterface::popPlannedTurn(URoadNodePort* port) {
+	URoadNodeCross* crossNode = port->getSegment()->getCrossNode();
+	if (destinationZone >= 0 && crossNode) {
+		// one table lookup, null inside the destination zone
+		URoadTurn* turn = crossNode->getZoneTurn(port, destinationZone);
+		AUrbanTraffic* manager = vehicle->getTrafficManager();
+		if (!turn && manager && manager->getSegmentZone(port->getSegment()) == destinationZone) {
+			reachDestination();
+		}
+		return turn;
+	}
+	if (plannedTurns.Num() && crossNode) {
+		// skip turns which were passed while the route was being planned
+		int index = plannedTurns.IndexOfByPredicate([port](URoadTurn* turn) {
+			return turn->getStartPort() == port;
+		});
+		if (index != INDEX_NONE) {
+			URoadTurn* turn = plannedTurns[index];
+			plannedTurns.RemoveAt(0, index + 1);
+			if (!plannedTurns.Num()) {
+				// the last turn leads to the destination segment
+				reachDestination();
+			}
+			return turn;
+		}
+		// vehicle left the planned route, plan again when the path is appended
+		plannedTurns.Reset();
+		replanRoute = hasDestination;
+	}
+	return nullptr;
+}
+
+void IVehicleControllerInterface::reachDestination() {
+	hasDestination = false;
+	destinationZone = -1;
+	plannedTurns.Reset();
+	destinationReached = true;
+}
+
 void IVehicleControllerInterface::setNewTarget(FVector newTarget) {
 	if (vehicle->DrawTargetHistory) {
 		DrawDebugLine(vehicle->GetWorld(), currentTarget, newTarget, FColor::Cyan, true);
@@ -38,7 +38,7 @@ void UVehicleHardwareComponent::BeginPlay()
 	Super::BeginPlay();
 	// auto connect
 	if (bAutoActivate) {
-		arduino.open(TCHAR_TO_ANSI(*SerialPort), Baudrate);
+		arduino = MakeUnique<FSerialWriter>(SerialPort, Baudrate);
 	}
 	// register handling events
 	AVehicleBase* vehicle = Cast<AVehicleBase>(GetOwner());
@@ -64,9 +64,14 @@ void UVehicleHardwareComponent::BeginPlay()
 	}
 }
 
+void UVehicleHardwareComponent::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	arduino.Reset();
+	Super::EndPlay(EndPlayReason);
+}
+
 void UVehicleHardwareComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) {
 	AVehicleBase* vehicle = Cast<AVehicleBase>(GetOwner());
-	if (vehicle) {
+	if (vehicle && arduino) {
 		// steering
 		float wheelAngle = vehicle->WheelAngle * 2.0f;
 		uint16_t steeringPulse = (uint16_t)FMath::GetMappedRangeValueClamped(FVector2D(-70, 70), FVector2D(WHEEL_PULSE_MIN, WHEEL_PULSE_MAX), wheelAngle);
@@ -84,7 +89,7 @@ void UVehicleHardwareComponent::TickComponent(float DeltaTime, ELevelTick TickTy
 			controlData[ARDUINO_OFFSET_THROTTLE] |= ARDUINO_FLAG_THROTTLE_BACKWARD;
 		}
 		// send data
-		arduino.write(controlData, 8);
+		arduino->enqueue(SerialPacketKind::Control, controlData, 8);
 		//UE_LOG(LogTemp, Warning, TEXT("%s"), *FString((const char*)controlData));
 
 		if (IncludeSensorData) {
@@ -94,7 +99,7 @@ void UVehicleHardwareComponent::TickComponent(float DeltaTime, ELevelTick TickTy
 				sensorData[i] = (uint8_t)sensor->GetNormalizedValue();
 			}
 			// send data
-			arduino.write(controlData, 16);
+			arduino->enqueue(SerialPacketKind::Sensor, sensorData, 16);
 			//UE_LOG(LogTemp, Warning, TEXT("%s"), *FString((const char*)sensorData));
 		}
 	}
@@ -103,12 +108,13 @@ void UVehicleHardwareComponent::TickComponent(float DeltaTime, ELevelTick TickTy
 void UVehicleHardwareComponent::Connect(FString port, int baud) {
 	this->SerialPort = port;
 	this->Baudrate = baud;
-	arduino.close();
-	arduino.open(TCHAR_TO_ANSI(*port), baud);
+	// the old writer releases the port before the new one opens it
+	arduino.Reset();
+	arduino = MakeUnique<FSerialWriter>(port, baud);
 }
 
 void UVehicleHardwareComponent::Disconnect() {
-	arduino.close();
+	arduino.Reset();
 }
 
 void UVehicleHardwareComponent::OnGearChanged_Implementation(int value) {
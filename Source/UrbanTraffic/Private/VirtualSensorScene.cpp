@@ -0,0 +1,203 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "VirtualSensorScene.h"
+
+void FVirtualBoxArray::reset() {
+	for (TArray<float>* values : {
+		&centerX, &centerY, &centerZ,
+		&axisXX, &axisXY, &axisXZ, &axisYX, &axisYY, &axisYZ, &axisZX, &axisZY, &axisZZ,
+		&extentX, &extentY, &extentZ }) {
+		values->Reset();
+	}
+	actors.Reset();
+}
+
+int FVirtualBoxArray::add(AActor* actor, FVector center, FQuat rotation, FVector extent) {
+	FVector axisX = rotation.GetAxisX();
+	FVector axisY = rotation.GetAxisY();
+	FVector axisZ = rotation.GetAxisZ();
+	centerX.Add(center.X);
+	centerY.Add(center.Y);
+	centerZ.Add(center.Z);
+	axisXX.Add(axisX.X);
+	axisXY.Add(axisX.Y);
+	axisXZ.Add(axisX.Z);
+	axisYX.Add(axisY.X);
+	axisYY.Add(axisY.Y);
+	axisYZ.Add(axisY.Z);
+	axisZX.Add(axisZ.X);
+	axisZY.Add(axisZ.Y);
+	axisZZ.Add(axisZ.Z);
+	extentX.Add(extent.X);
+	extentY.Add(extent.Y);
+	extentZ.Add(extent.Z);
+	return actors.Add(actor);
+}
+
+void FVirtualBoxArray::addFrom(const FVirtualBoxArray &other, int i) {
+	centerX.Add(other.centerX[i]);
+	centerY.Add(other.centerY[i]);
+	centerZ.Add(other.centerZ[i]);
+	axisXX.Add(other.axisXX[i]);
+	axisXY.Add(other.axisXY[i]);
+	axisXZ.Add(other.axisXZ[i]);
+	axisYX.Add(other.axisYX[i]);
+	axisYY.Add(other.axisYY[i]);
+	axisYZ.Add(other.axisYZ[i]);
+	axisZX.Add(other.axisZX[i]);
+	axisZY.Add(other.axisZY[i]);
+	axisZZ.Add(other.axisZZ[i]);
+	extentX.Add(other.extentX[i]);
+	extentY.Add(other.extentY[i]);
+	extentZ.Add(other.extentZ[i]);
+	actors.Add(other.actors[i]);
+}
+
+/* Slab test of one box axis, narrows the [near, far] interval of the ray. */
+static FORCEINLINE void intersectSlab(float offset, float direction, float extent, float &nearT, float &farT) {
+	// avoid division by zero without branching
+	float safeDirection = FMath::Abs(direction) < 1e-6f ? 1e-6f : direction;
+	float inverse = 1 / safeDirection;
+	float t1 = (-extent - offset) * inverse;
+	float t2 = (extent - offset) * inverse;
+	nearT = FMath::Max(nearT, FMath::Min(t1, t2));
+	farT = FMath::Min(farT, FMath::Max(t1, t2));
+}
+
+void FVirtualBoxArray::intersectRay(FVector origin, FVector direction, float length, float padding, float* distances) const {
+	const int count = num();
+	const float missed = length + 1;
+	// raw pointers skip range checks of TArray indexing inside the loop
+	const float* cx = centerX.GetData();
+	const float* cy = centerY.GetData();
+	const float* cz = centerZ.GetData();
+	const float* xx = axisXX.GetData();
+	const float* xy = axisXY.GetData();
+	const float* xz = axisXZ.GetData();
+	const float* yx = axisYX.GetData();
+	const float* yy = axisYY.GetData();
+	const float* yz = axisYZ.GetData();
+	const float* zx = axisZX.GetData();
+	const float* zy = axisZY.GetData();
+	const float* zz = axisZZ.GetData();
+	const float* ex = extentX.GetData();
+	const float* ey = extentY.GetData();
+	const float* ez = extentZ.GetData();
+	// plain loop without branches, so compilers can vectorize it
+	for (int i = 0; i < count; i++) {
+		// ray in box space
+		float dx = origin.X - cx[i];
+		float dy = origin.Y - cy[i];
+		float dz = origin.Z - cz[i];
+		float ox = dx * xx[i] + dy * xy[i] + dz * xz[i];
+		float oy = dx * yx[i] + dy * yy[i] + dz * yz[i];
+		float oz = dx * zx[i] + dy * zy[i] + dz * zz[i];
+		float rx = direction.X * xx[i] + direction.Y * xy[i] + direction.Z * xz[i];
+		float ry = direction.X * yx[i] + direction.Y * yy[i] + direction.Z * yz[i];
+		float rz = direction.X * zx[i] + direction.Y * zy[i] + direction.Z * zz[i];
+		float nearT = 0;
+		float farT = length;
+		intersectSlab(ox, rx, ex[i] + padding, nearT, farT);
+		intersectSlab(oy, ry, ey[i] + padding, nearT, farT);
+		intersectSlab(oz, rz, ez[i], nearT, farT);
+		distances[i] = nearT <= farT ? nearT : missed;
+	}
+}
+
+void FVirtualSensorScene::reset(float newCellSize) {
+	boxes.reset();
+	cells.Reset();
+	boxStamps.Reset();
+	cellSize = newCellSize;
+}
+
+void FVirtualSensorScene::addBox(AActor* actor, FVector center, FQuat rotation, FVector extent) {
+	int index = boxes.add(actor, center, rotation, extent);
+	boxStamps.Add(traceStamp);
+	// bucket by bounding circle
+	float radius = extent.Size();
+	int minX = FMath::FloorToInt((center.X - radius) / cellSize);
+	int maxX = FMath::FloorToInt((center.X + radius) / cellSize);
+	int minY = FMath::FloorToInt((center.Y - radius) / cellSize);
+	int maxY = FMath::FloorToInt((center.Y + radius) / cellSize);
+	for (int x = minX; x <= maxX; x++) {
+		for (int y = minY; y <= maxY; y++) {
+			cells.FindOrAdd(FIntPoint(x, y)).Add(index);
+		}
+	}
+}
+
+bool FVirtualSensorScene::traceRays(const TArray<FVector> &starts, const TArray<FVector> &ends, const AActor* ignored,
+	TArray<float> &distances, TArray<AActor*> &hitActors, float padding) {
+	int numRays = starts.Num();
+	distances.SetNum(numRays);
+	hitActors.SetNum(numRays);
+	// gather boxes from cells covered by the fan
+	FBox2D bounds(ForceInit);
+	for (int i = 0; i < numRays; i++) {
+		bounds += FVector2D(starts[i]);
+		bounds += FVector2D(ends[i]);
+		distances[i] = FVector::Dist(starts[i], ends[i]);
+		hitActors[i] = nullptr;
+	}
+	bounds = bounds.ExpandBy(padding);
+	candidates.reset();
+	traceStamp++;
+	int minX = FMath::FloorToInt(bounds.Min.X / cellSize);
+	int maxX = FMath::FloorToInt(bounds.Max.X / cellSize);
+	int minY = FMath::FloorToInt(bounds.Min.Y / cellSize);
+	int maxY = FMath::FloorToInt(bounds.Max.Y / cellSize);
+	for (int x = minX; x <= maxX; x++) {
+		for (int y = minY; y <= maxY; y++) {
+			const TArray<int>* cell = cells.Find(FIntPoint(x, y));
+			if (cell) {
+				for (int index : *cell) {
+					if (boxStamps[index] != traceStamp && boxes.actors[index] != ignored) {
+						boxStamps[index] = traceStamp;
+						candidates.addFrom(boxes, index);
+					}
+				}
+			}
+		}
+	}
+	// run the kernel per ray, keep the nearest hit
+	bool detected = false;
+	int numCandidates = candidates.num();
+	rayDistances.SetNum(numCandidates);
+	for (int i = 0; numCandidates && i < numRays; i++) {
+		FVector direction = ends[i] - starts[i];
+		float length = distances[i];
+		direction /= FMath::Max(length, KINDA_SMALL_NUMBER);
+		candidates.intersectRay(starts[i], direction, length, padding, rayDistances.GetData());
+		for (int c = 0; c < numCandidates; c++) {
+			if (rayDistances[c] < distances[i]) {
+				distances[i] = rayDistances[c];
+				hitActors[i] = candidates.actors[c];
+				detected = true;
+			}
+		}
+	}
+	return detected;
+}
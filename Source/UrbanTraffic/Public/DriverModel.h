@@ -0,0 +1,92 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DriverModel.generated.h"
+
+UENUM(BlueprintType)
+enum class LongitudinalModelType : uint8 {
+	Sensor				UMETA(DisplayName = "Obstacle Sensor"),
+	IntelligentDriver	UMETA(DisplayName = "Intelligent Driver Model")
+};
+
+/**
+ * Per-vehicle-type parameters of the Intelligent Driver Model.
+ */
+USTRUCT(BlueprintType)
+struct URBANTRAFFIC_API FDriverModelParams
+{
+	GENERATED_BODY()
+
+	/* Desired time gap to the leading vehicle, in seconds. */
+	UPROPERTY(EditAnywhere, meta = (UIMin = "0.5", UIMax = "3", ClampMin = "0.1"))
+	float TimeHeadway = 1.5f;
+
+	/* Bumper-to-bumper gap kept when standing in a queue, in centimeters. */
+	UPROPERTY(EditAnywhere, meta = (UIMin = "100", UIMax = "500", ClampMin = "0"))
+	float MinimumGap = 200;
+
+	/* Maximum acceleration, in m/s^2. */
+	UPROPERTY(EditAnywhere, meta = (UIMin = "0.5", UIMax = "5", ClampMin = "0.1"))
+	float MaxAcceleration = 1.5f;
+
+	/* Comfortable deceleration, in m/s^2. */
+	UPROPERTY(EditAnywhere, meta = (UIMin = "0.5", UIMax = "5", ClampMin = "0.1"))
+	float ComfortDeceleration = 2.0f;
+};
+
+/**
+ * Structure-of-arrays input and output of the Intelligent Driver Model.
+ * All vehicles of a frame are evaluated in one branch-free loop,
+ * all values are in SI units (m, m/s, m/s^2).
+ */
+struct URBANTRAFFIC_API FDriverModelBatch
+{
+	TArray<float> speeds;
+	TArray<float> desiredSpeeds;
+	TArray<float> gaps;
+	TArray<float> closingSpeeds;
+	TArray<float> timeHeadways;
+	TArray<float> minimumGaps;
+	TArray<float> maxAccelerations;
+	TArray<float> comfortDecelerations;
+	TArray<float> accelerations;
+
+	/* Clears all arrays but keeps their memory. */
+	void reset();
+
+	/* Appends a vehicle, returns its index in the batch. */
+	int add(float speed, float desiredSpeed, float gap, float closingSpeed, const FDriverModelParams &params);
+
+	/* Computes accelerations for all vehicles in the batch. */
+	void compute();
+
+	/* Number of vehicles in the batch. */
+	int num() const { return speeds.Num(); }
+
+	/* Computes acceleration of one vehicle outside the batch, such as stopping at a line. Same units as add. */
+	static float computeSingle(float speed, float desiredSpeed, float gap, float closingSpeed, const FDriverModelParams &params);
+};
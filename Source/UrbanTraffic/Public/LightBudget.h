@@ -0,0 +1,119 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class USceneComponent;
+class ULightComponent;
+class UPrimitiveComponent;
+
+/* Light container tracked by the light budget, a street lamp light or the headlights of a vehicle. */
+struct FBudgetLight
+{
+	USceneComponent* container;
+
+	/* Light components, rendered only while promoted. */
+	TArray<ULightComponent*> lightComponents;
+
+	/* Meshes showing the emissive proxy while demoted. */
+	TArray<UPrimitiveComponent*> meshComponents;
+
+	/* Grid cell containing the light. */
+	FIntPoint cell;
+
+	/* Is the container moving with a vehicle, rechecked every update. */
+	bool isMoving;
+
+	/* Is the light a real dynamic light. */
+	bool isReal;
+};
+
+/**
+ * Keeps the most significant lights as real dynamic lights, the others are demoted to emissive proxies.
+ * Lights are binned in grid cells around the camera: cells within the promote ring are real, cells beyond
+ * one more ring are demoted, and the ring shrinks or grows to fit the budget. Updates only visit cells
+ * crossing the rings when the camera enters another cell, so static lights cost nothing in between.
+ */
+struct URBANTRAFFIC_API FLightBudget
+{
+	FLightBudget(float gridCellSize = 5000);
+
+	/* Starts tracking a light container, it is promoted if its cell is within the ring. */
+	void addLight(USceneComponent* container, bool isMoving);
+
+	/* Stops tracking a light container, its lights are left as they are. */
+	void removeLight(USceneComponent* container);
+
+	/* Fits the ring to the budget, then promotes and demotes lights of cells which crossed the rings. */
+	void update(FVector viewLocation);
+
+	/* Stops tracking all lights. */
+	void empty();
+
+	/* Number of real dynamic lights. */
+	int getNumReal() const { return numReal; }
+
+	/* Number of containers kept as real lights at most, unless the camera cell alone has more. */
+	int maxRealLights = 64;
+
+	/* Scalar material parameter set to 1 on meshes of demoted lights, none to skip. */
+	FName proxyParameter = TEXT("LightProxy");
+
+private:
+	/* Gets the grid cell of a location. */
+	FIntPoint getCell(FVector location) const;
+
+	/* Gets ring of a cell around the view cell, in cells. */
+	int getRing(FIntPoint cell) const;
+
+	/* Promotes within the ring, demotes beyond the hysteresis ring, keeps lights in between. */
+	void refreshLight(FBudgetLight &light);
+
+	/* Refreshes lights of all cells around a center cell whose ring matches a filter. */
+	void refreshCells(FIntPoint center, int radius, TFunctionRef<bool(FIntPoint)> filter);
+
+	/* Renders the lights of a container or shows its emissive proxy. */
+	void setReal(FBudgetLight &light, bool isReal);
+
+	/* Tracked lights, removed slots are reused. */
+	TArray<FBudgetLight> lights;
+	TArray<int> freeSlots;
+	TMap<USceneComponent*, int> slots;
+
+	/* Lights in each grid cell. */
+	TMap<FIntPoint, TArray<int>> cells;
+
+	/* Lights of vehicles. */
+	TArray<int> movingLights;
+
+	/* Cells within this ring around the view cell are real. */
+	int promoteRing = 2;
+
+	FIntPoint viewCell = FIntPoint::ZeroValue;
+	bool hasView = false;
+	int numReal = 0;
+	float cellSize;
+};
@@ -24,10 +24,28 @@
 
 #pragma once
 
+#include "SensorResultBuffer.h"
 #include "CoreMinimal.h"
 #include "Components/SceneComponent.h"
+#include "Components/LineBatchComponent.h"
 #include "ObstacleSensorComponent.generated.h"
 
+class AUrbanTraffic;
+
+UENUM(BlueprintType)
+enum class SensorBackendType : uint8 {
+	Physics		UMETA(DisplayName = "Physics Scene"),
+	Virtual		UMETA(DisplayName = "Virtual Traffic"),
+	Hybrid		UMETA(DisplayName = "Virtual Traffic + Static Physics")
+};
+
+UENUM(BlueprintType)
+enum class SensorShapeType : uint8 {
+	RayFan			UMETA(DisplayName = "Ray Fan"),
+	BoxSweep		UMETA(DisplayName = "Box Sweep"),
+	CapsuleSweep	UMETA(DisplayName = "Capsule Sweep")
+};
+
 /**
  * 
  */
@@ -39,6 +57,7 @@ class URBANTRAFFIC_API UObstacleSensorComponent : public USceneComponent
 public:
 	UObstacleSensorComponent();
 	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
 	virtual void SetActive(bool bNewActive, bool bReset = false) override;
 	
@@ -62,6 +81,35 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool DoCustomCollisionTest(float CustomTraceLength, float &ObstacleDistance);
 
+	/* Requests a collision test. Same as DoCollisionTest in sync mode. In async mode, it consumes rays
+	submitted on previous frame and submits new ones, rays are traced synchronously when there are
+	no previous ones, so callers never act on unknown space. Active scheduled sensors return their
+	latest results, see GetResultAge. */
+	UFUNCTION(BlueprintCallable)
+	bool RequestCollisionTest();
+
+	/* Gets age of current results in seconds, zero when traced this frame. */
+	UFUNCTION(BlueprintCallable)
+	float GetResultAge();
+
+	/* Hands tracing over to a scheduler, the sensor stops tracing by itself every tick. */
+	void setScheduled(bool scheduled);
+
+	/* Performs one scheduled update: traces in sync mode, or consumes and submits in async mode. */
+	void updateTraces();
+
+	/* Gets number of queries of one update: rays of the fan, or one sweep. */
+	int getQueryCount();
+
+	/* Sets the manager providing virtual traffic boxes and result slots, physics and own slots are used without it. */
+	void setTrafficManager(AUrbanTraffic* manager);
+
+	/* Gets actor hit by a ray of current results, null when missed or anonymous. */
+	AActor* getHitActor(int ray);
+
+	/* Finds nearest blocking hit of current results whose actor passes the filter, returns false if none. */
+	bool findNearestHit(TFunctionRef<bool(AActor*)> filter, float &distance);
+
 	/* Number of testing rays. */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, meta = (UIMin = "1", UIMax = "11", ClampMin = "1", ClampMax = "11"))
 	int RayQuantity = 1;
@@ -89,10 +137,148 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	int SensorDataOrder;
 
+	/* Submits rays without waiting for the physics scene. Results are one frame late. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool AsyncTrace = false;
+
+	/* Virtual backend tests rays against traffic vehicles and stop lines known by the manager,
+	hybrid adds physics traces of static world geometry. Full physics is used near the player. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	SensorBackendType Backend = SensorBackendType::Physics;
+
+	/* Ray fan traces RayQuantity rays, sweeps trace one shape as wide as TraceWidth. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	SensorShapeType Shape = SensorShapeType::RayFan;
+
+	/* Updates extrapolated from the nearest hit while the hit actor keeps its relative pose, 0 always traces.
+	Rays are traced again after this many updates, or when traffic lights or their stop lines change. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", ClampMax = "60"))
+	int CoherenceFrames = 0;
+
+	/* Relative location change of the hit actor which invalidates extrapolation, in centimeters. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+	float CoherenceTolerance = 50;
+
+	/* Relative rotation change of the hit actor which invalidates extrapolation, in degrees. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", ClampMax = "90"))
+	float CoherenceAngle = 5;
+
 private:
 	bool obstacleDetected;
 
 	float nearestDistance;
 
-	TArray<FHitResult> hitResults;
+	/* Results of the rays, slots of the manager buffer or of the own one. */
+	FSensorResultBuffer* results = &localResults;
+
+	/* First result slot of this sensor. */
+	int resultOffset = 0;
+
+	/* Own result slots, used without a manager. */
+	FSensorResultBuffer localResults;
+
+	/* Takes result slots from the manager buffer, or allocates own ones without it. */
+	void allocateResults();
+
+	/* Gives result slots back. */
+	void releaseResults();
+
+	/* Computes start and end points of a ray. */
+	void computeRay(int index, float length, FVector &start, FVector &end);
+
+	/* Computes start and end points of all rays, or of the single sweep. */
+	void prepareRays(float length);
+
+	/* Gets sweep shape sized from trace width. */
+	FCollisionShape getSweepShape();
+
+	/* Traces a prepared ray or sweep through physics, static geometry only or by collision channel.
+	Writes the result slot of the ray. */
+	bool traceQuery(int index, bool staticOnly, const FCollisionQueryParams &query);
+
+	/* Submits a prepared ray or sweep as an async trace. */
+	FTraceHandle submitQuery(int index, bool staticOnly, const FCollisionQueryParams &query);
+
+	/* Checks whether rays go through the physics scene with the collision channel. */
+	bool isPhysicsRequired();
+
+	/* Merges hits of virtual traffic boxes into result slots. */
+	void mergeVirtualHits();
+
+	/* Finds nearest blocking hit, returns true if any. */
+	bool collectHits(float length, float &distance);
+
+	/* Manager providing virtual traffic boxes and result slots. */
+	TWeakObjectPtr<AUrbanTraffic> trafficManager;
+
+	/* Start and end points of current rays. */
+	TArray<FVector> rayStarts, rayEnds;
+
+	/* Scratch results of virtual traces. */
+	TArray<float> virtualDistances;
+	TArray<AActor*> virtualActors;
+
+	/* Are there submitted rays waiting to be consumed. */
+	bool pendingTraces = false;
+
+	/* Were submitted rays traced with the full physics scene. */
+	bool submittedPhysics = true;
+
+	/* Submits all rays as async traces. */
+	void submitAsyncTraces();
+
+	/* Reads results of rays submitted on previous frame. Returns false when there is no result. */
+	bool consumeAsyncTraces();
+
+	/* Handles of submitted async traces, one per ray. */
+	TArray<FTraceHandle> traceHandles;
+
+	/* Frame number when async traces were submitted. */
+	uint64 submitFrame = 0;
+
+	/* World time when async traces were submitted. */
+	float submitTime = 0;
+
+	/* World time of the rays which current results come from. */
+	float resultTime = 0;
+
+	/* Is tracing driven by a scheduler. */
+	bool scheduled = false;
+
+	/* Keeps nearest hit of current results for extrapolation. */
+	void storeCoherentHit();
+
+	/* Extrapolates the kept hit from velocities. Returns false when the hit is invalid or expired. */
+	bool updateCoherentHit();
+
+	/* Checks whether the kept hit covers the next update as well. */
+	bool isCoherenceKept();
+
+	/* Gets revision of the traffic scene, zero without a manager. */
+	uint32 getSceneRevision();
+
+	/* Actor of the kept hit, null when nothing is kept. */
+	TWeakObjectPtr<AActor> coherentActor;
+
+	/* Transform of the kept actor relative to the sensor. */
+	FTransform coherentPose;
+
+	/* Distance and world time of the kept hit. */
+	float coherentDistance = 0, coherentTime = 0;
+
+	/* Number of updates served by the kept hit. */
+	int coherentUpdates = 0;
+
+	/* Scene revision when the hit was kept. */
+	uint32 coherentRevision = 0;
+
+	/* Reads or extrapolates results, then submits rays unless extrapolation covers next update.
+	Returns false when nothing is known. */
+	bool cycleAsyncTraces();
+
+	/* Draws current rays in one batch. */
+	void drawRays();
+
+	/* Scratch lines of debug drawing. */
+	TArray<FBatchedLine> debugLines;
 };
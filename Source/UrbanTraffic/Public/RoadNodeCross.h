@@ -25,9 +25,22 @@
 #pragma once
 
 #include "RoadNodePort.h"
+#include "TrafficLight.h"
 #include "CoreMinimal.h"
 
 class URoadTurn;
+class AVehicleBase;
+
+#define ZONE_TURN_NONE 255
+
+/* Time slot of a turn held by a vehicle, in world seconds. */
+struct FRoadReservation
+{
+	AVehicleBase* owner;
+	int turnIndex;
+	float enterTime;
+	float exitTime;
+};
 
 /**
  * 
@@ -43,6 +56,44 @@ public:
 
 	TArray<URoadTurn*> getPortTurns(URoadNodePort* port);
 
+	/* Stores next-hop table of an entry port: index of the turn to take for each routing zone. */
+	void setZoneTurns(URoadNodePort* port, TArray<uint8> &&turnIndices);
+
+	/* Gets the turn leading to a routing zone, null when there is no table entry. */
+	URoadTurn* getZoneTurn(URoadNodePort* port, int zone);
+
+	/* Gets signal state of the turn of a type from an entry port, green when the turn is not signalized or not found. */
+	TrafficLightState getSignalState(URoadNodePort* port, RoadTurnType turnType);
+
+	/* Checks whether any turn of this crossing is signalized. */
+	bool isSignalized();
+
+	/* Checks whether two turns of this crossing cross or merge into each other. */
+	bool isConflicted(URoadTurn* a, URoadTurn* b);
+
+	/* Requests a time slot for a turn. Granted when no conflicting turn is reserved in that slot,
+	replaces previous slot of the owner. */
+	bool requestReservation(URoadTurn* turn, AVehicleBase* owner, float now, float enterTime, float exitTime);
+
+	/* Extends slot of an owner which is committed to the crossing, without checking conflicts.
+	Returns false when the owner has no slot. */
+	bool refreshReservation(AVehicleBase* owner, float exitTime);
+
+	/* Releases slot held by an owner. */
+	void releaseReservation(AVehicleBase* owner);
+
 private:
 	TMap<URoadNodePort*, TArray<URoadTurn*>> portTurns;
+
+	/* Index of each turn in the conflict matrix. */
+	TMap<URoadTurn*, int> turnIndices;
+
+	/* Precomp, conflict matrix: a bit per pair of turns. */
+	TArray<TBitArray<>> turnConflicts;
+
+	/* Active slots, expired ones are dropped on next request. */
+	TArray<FRoadReservation> reservations;
+
+	/* Next-hop tables per entry port. */
+	TMap<URoadNodePort*, TArray<uint8>> zoneTurns;
 };
@@ -27,6 +27,8 @@
 #include "RoadNode.h"
 #include "CoreMinimal.h"
 
+class URoadTurn;
+
 /**
  * 
  */
@@ -39,11 +41,13 @@ public:
 	virtual void drawDebug(UWorld* world, uint8 debugFlags) override;
 	virtual FVector computeTarget(int lane, bool invert) override;
 
-	/* Appends collection of nodes which start from this port. */
-	RoadTurnType appendRoadNodes(TArray<URoadNode*> &roadNodes);
+	/* Appends collection of nodes which start from this port.
+	On crossing segment, takes the given turn when it starts from this port, or a random turn.
+	The taken turn is written back, null on straight segment. */
+	RoadTurnType appendRoadNodes(TArray<URoadNode*> &roadNodes, FRandomStream &stream, URoadTurn* &turn);
 
 	/* Maintains current vehicle lane, or selects new valid right lane. */
-	int randomRightLane(int vehicleLane);
+	int randomRightLane(int vehicleLane, FRandomStream &stream);
 
 	/* Gets min index of left lanes. */
 	int getMinLeft();
@@ -0,0 +1,61 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "RoadNode.h"
+#include "CoreMinimal.h"
+
+class URoadTurn;
+
+/* A link of the port graph: travels the segment entered by a port, then enters the next segment. */
+struct FRoadPlanEdge
+{
+	/* Entry port of the next segment. */
+	URoadNodePort* nextPort;
+
+	/* Taken turn when the travelled segment is a crossing, null on straight segment. */
+	URoadTurn* turn;
+
+	/* Travel cost, length scaled by speed limit. */
+	float cost;
+};
+
+/**
+ * Route planner over the connected port and turn graph.
+ * It only reads precomputed road data, so it can run off the game thread
+ * as long as the road system is not rebuilt meanwhile.
+ */
+class URBANTRAFFIC_API URoadPlanner
+{
+public:
+	/* Collects links leaving the segment which is entered through a port. */
+	static void collectEdges(URoadNodePort* entryPort, TArray<FRoadPlanEdge> &edges);
+
+	/* Finds the fastest turn sequence from an entry port to a goal segment (A* search). */
+	static bool findRoute(URoadNodePort* startPort, URoadSegment* goalSegment, TArray<URoadTurn*> &turns);
+
+	/* Builds next-hop tables on crossings by a reverse Dijkstra search from every zone. Returns table size in bytes. */
+	static int buildZoneTables(const TArray<URoadNodePort*> &ports, const TMap<URoadSegment*, int> &segmentZones, int numZones);
+};
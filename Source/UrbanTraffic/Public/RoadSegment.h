@@ -63,9 +63,15 @@ public:
 	/* Collects all entry (can enter from outside) ports in this segment. */
 	TArray<URoadNodePort*> collectEntryPorts();
 
+	/* Gets the port where a straight segment is left in the given direction. */
+	URoadNodePort* getExitPort(bool invert);
+
 	/* Gets total length of this segment. */
 	float getSegmentLength();
 
+	/* Gets travel cost, the segment length scaled by speed limit of nodes. */
+	float getTravelCost();
+
 	/* Gets length of a point on segment. */
 	float getLengthOnSegment(FVector position, bool invert);
 
@@ -87,4 +93,7 @@ private:
 
 	/* Precomp, total length of segment. */
 	float segmentLength = 0;
+
+	/* Precomp, travel cost of segment. */
+	float travelCost = 0;
 };
@@ -25,7 +25,9 @@
 #pragma once
 
 #include "RoadNodeGuide.h"
+#include "TrafficLight.h"
 #include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
 
 /**
  * 
@@ -50,11 +52,44 @@ public:
 	/* Gets end port. */
 	URoadNodePort* getEndPort();
 
+	/* Gets the cross node which holds this turn. */
+	URoadNodeCross* getCrossNode();
+
+	/* Gets path length from start port to end port. */
+	float getTurnLength();
+
+	/* Gets travel cost, the path length scaled by speed limit. */
+	float getTravelCost();
+
+	/* Gets lowest speed limit along the turn. */
+	float getSpeedLimit();
+
+	/* Collects lane points driven through the crossing, from start port to end port. */
+	TArray<FVector> collectPathPoints();
+
+	/* Sets the traffic light governing this turn at the stop line of its start port. */
+	void setSignal(ATrafficLight* light);
+
+	/* Gets the traffic light governing this turn, null when not signalized. */
+	ATrafficLight* getSignal();
+
+	/* Gets signal state of this turn, green when not signalized. */
+	TrafficLightState getSignalState();
+
 private:
+	/* Precomp, path length from start port to end port. */
+	float turnLength = 0;
+
+	/* Precomp, lowest speed limit along the turn. */
+	float turnSpeedLimit = 1;
+
 	RoadTurnType turnType;
 	URoadSegment* segment;
 	TArray<URoadNodeGuide*> guideNodes;
 	URoadNodePort* startPort;
 	URoadNodeCross* crossNode;
 	URoadNodePort* endPort;
+
+	/* Traffic light governing this turn. */
+	TWeakObjectPtr<ATrafficLight> signal;
 };
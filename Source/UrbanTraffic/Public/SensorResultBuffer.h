@@ -0,0 +1,78 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+
+class AActor;
+
+/**
+ * Compact sensor results in structure-of-arrays layout, one slot per ray.
+ * Sensors own a range of slots, the traffic manager keeps ranges of all its sensors contiguous.
+ */
+struct URBANTRAFFIC_API FSensorResultBuffer
+{
+	/* Hit distance of each slot, meaningful when blocking. */
+	TArray<float> distances;
+
+	/* Blocking bit of each slot. */
+	TBitArray<> blocking;
+
+	/* Hit actor of each slot, null for anonymous geometry. */
+	TArray<TWeakObjectPtr<AActor>> actors;
+
+	/* Allocates a range of cleared slots, reusing a released range of the same size. Returns offset of the range. */
+	int allocate(int count);
+
+	/* Returns a range of slots for later allocations. */
+	void release(int offset, int count);
+
+	/* Removes all slots and released ranges. */
+	void empty();
+
+	/* Marks a slot as not blocking. */
+	FORCEINLINE void clearHit(int index) {
+		blocking[index] = false;
+		actors[index] = nullptr;
+	}
+
+	/* Marks a slot as blocking at a distance. */
+	FORCEINLINE void setHit(int index, float distance, AActor* actor) {
+		blocking[index] = true;
+		distances[index] = distance;
+		actors[index] = actor;
+	}
+
+	/* Finds nearest blocking distance of a range, returns its slot or INDEX_NONE when no slot blocks. */
+	int findNearest(int offset, int count, float &distance) const;
+
+	/* Number of slots. */
+	int num() const { return distances.Num(); }
+
+private:
+	/* Offsets of released ranges, by range size. */
+	TMap<int, TArray<int>> freeRanges;
+};
@@ -0,0 +1,78 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+
+class ATrafficLight;
+
+/* Light waiting in a slot of the timing wheel. */
+struct FSignalWheelEntry
+{
+	TWeakObjectPtr<ATrafficLight> light;
+
+	/* Full turns of the wheel left before the light is due. */
+	int rounds;
+};
+
+/**
+ * Hashed timing wheel of traffic lights keyed by their next signal change.
+ * Each slot covers a fixed resolution, advancing costs one slot visit per elapsed resolution
+ * plus the lights found there, so lights between changes cost nothing.
+ */
+struct URBANTRAFFIC_API FSignalTimingWheel
+{
+	FSignalTimingWheel(float slotSeconds = 0.1f, int numSlots = 256);
+
+	/* Schedules a light to change after a delay, in seconds. */
+	void schedule(ATrafficLight* light, float delay);
+
+	/* Removes a scheduled light, so it can be scheduled again. */
+	void remove(ATrafficLight* light);
+
+	/* Advances time, appends lights which are due. */
+	void advance(float deltaSeconds, TArray<ATrafficLight*> &dueLights);
+
+	/* Removes all scheduled lights. */
+	void empty();
+
+	/* Number of scheduled lights. */
+	int num() const { return numEntries; }
+
+private:
+	TArray<TArray<FSignalWheelEntry>> slots;
+
+	/* Seconds per slot. */
+	float resolution;
+
+	/* Slot of the current time. */
+	int cursor = 0;
+
+	/* Time passed since the cursor moved. */
+	float elapsed = 0;
+
+	int numEntries = 0;
+};
@@ -0,0 +1,137 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "SimTrafficModel.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Mesoscopic traffic model over a compiled road graph.
+ * Every link is a first-in first-out queue. A vehicle may leave a link once its travel time has passed,
+ * the entry signal of the next link is green, the next link has room and the link still has discharge
+ * capacity. Travel time is the free flow time raised by the occupancy of the link (BPR function).
+ * Lane positions are derived from the queue every step, so vehicles can be turned into actors at places
+ * consistent with their neighbours. A step costs O(links + vehicles).
+ */
+class FSimMesoTraffic : public FSimTrafficModel
+{
+public:
+	FSimMesoTraffic(const FSimRoadGraph &roadGraph, uint32_t seed = 0);
+
+	/* Adds a vehicle at a lane position, returns its id. */
+	virtual int addVehicle(int link, int lane, float position, float speed, const FSimDriverParams &params) override;
+
+	/* Adds a vehicle at a random place of a link with room, returns its id or -1 when none is found. */
+	virtual int addRandomVehicle(const FSimDriverParams &params) override;
+
+	/* Removes a vehicle, its id may be reused. */
+	virtual void removeVehicle(int id) override;
+
+	/* Removes all vehicles and restarts the clock. */
+	virtual void clear() override;
+
+	/* Advances all vehicles by a time step, in seconds. */
+	virtual void step(float deltaSeconds) override;
+
+	/* Vehicle state, see FSimTrafficModel. */
+	virtual bool isAlive(int id) const override { return id >= 0 && id < (int)alive.size() && alive[id]; }
+	virtual int getCapacity() const override { return (int)alive.size(); }
+	virtual int getLink(int id) const override { return links[id]; }
+	virtual int getLane(int id) const override { return lanes[id]; }
+	virtual float getPosition(int id) const override { return positions[id]; }
+	virtual float getSpeed(int id) const override { return speeds[id]; }
+
+	/* Gets travel time of a link at its current occupancy, in seconds. */
+	float getTravelTime(int link) const;
+
+	/* Gets occupied fraction of the storage of a link, the sum of its lane lengths. */
+	float getOccupancy(int link) const;
+
+	/* Parameters of the BPR function, travel time = free time * (1 + alpha * occupancy ^ beta). */
+	float bprAlpha = 0.15f;
+	float bprBeta = 4;
+
+	/* Vehicles a lane lets go per second at saturation. */
+	float saturationFlow = 0.5f;
+
+private:
+	/* Puts a vehicle into the queue of a link, progress is the travelled fraction of the link. */
+	void enterLink(int id, int link, int lane, float progress);
+
+	/* Removes a vehicle from the queue of its link. */
+	void leaveLink(int id);
+
+	/* Derives lane positions and speeds from queues. */
+	void updatePositions();
+
+	/* Puts a vehicle at the start of a random link with room, returns false when none is found. */
+	bool respawn(int id);
+
+	/* Checks whether a link can store a vehicle occupying some space. */
+	bool hasRoom(int link, float space) const;
+
+	/* Chooses the link a vehicle takes after its current one. */
+	int chooseNextLink(int id, int link);
+
+	/* Chooses a random link which is not a turn. */
+	int randomStraightLink();
+
+	std::vector<uint8_t> alive;
+	std::vector<int> links, lanes, nextLinks;
+
+	/* When the vehicle entered its link, and when it may leave it at the earliest. */
+	std::vector<double> entryTimes, exitTimes;
+
+	/* Vehicle length plus the standstill gap. */
+	std::vector<float> spaces;
+
+	std::vector<float> speedFactors;
+
+	/* Lane position and speed, derived every step. */
+	std::vector<float> positions, speeds;
+
+	std::vector<uint32_t> randomStates;
+
+	/* Released vehicle ids. */
+	std::vector<int> freeIds;
+
+	/* Vehicle queue of each link from the front, entries before the head index have left. */
+	std::vector<std::vector<int>> queues;
+	std::vector<int> queueHeads;
+
+	/* Space taken by the vehicles of each link. */
+	std::vector<float> occupiedSpaces;
+
+	/* Vehicles each link may still let go, refilled by the saturation flow. */
+	std::vector<float> dischargeCredits;
+
+	/* Back of the queue of each lane while deriving positions. */
+	std::vector<float> laneBacks;
+
+	/* Random state of spawning. */
+	uint32_t spawnState;
+};
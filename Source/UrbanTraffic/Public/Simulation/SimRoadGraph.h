@@ -0,0 +1,124 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+// The simulation core uses the standard library only, so it builds without the engine.
+#include <utility>
+#include <vector>
+
+/**
+ * A directed lane group of the simulation graph, one direction of a straight segment or one turn of a crossing.
+ * All lengths are in meters and speeds in m/s.
+ */
+struct FSimLink
+{
+	/* Length along the polyline. */
+	float length = 0;
+
+	/* Speed vehicles accelerate to on this link. */
+	float speedLimit = 14;
+
+	/* Number of lanes, lane 0 is the innermost. */
+	int numLanes = 1;
+
+	/* Width of one lane, lanes are offset to the right of the polyline. */
+	float laneWidth = 3.5f;
+
+	/* Lateral origin of lane 0 in lane widths, negative when lanes are centred on the polyline.
+	Lane i lies (i + laneOffset + 0.5) lane widths to the right. */
+	int laneOffset = 0;
+
+	/* Signal group that controls entering this link, -1 when the entry is free. */
+	int signal = -1;
+
+	/* Range of successor links in FSimRoadGraph::nextLinks. */
+	int firstNext = 0, numNext = 0;
+
+	/* Range of polyline points. */
+	int firstPoint = 0, numPoints = 0;
+
+	/* Index of lane 0 among lanes of all links. */
+	int firstLane = 0;
+
+	/* Is this link a turn inside a crossing. */
+	bool isTurn = false;
+};
+
+/**
+ * Fixed-time signal group. Green starts at the offset of every cycle, followed by yellow then red.
+ */
+struct FSimSignal
+{
+	float cycle = 60;
+	float offset = 0;
+	float green = 27;
+	float yellow = 3;
+
+	/* Gets 0 for green, 1 for yellow and 2 for red at a simulation time. */
+	int getState(double time) const;
+};
+
+/**
+ * Compiled road graph consumed by the simulation core.
+ * Points are in the frame of the caller (right-handed or not), lateral offset of lanes is
+ * taken toward (-dy, dx) of the polyline direction, which is the right side in a Z-up left-handed frame.
+ */
+struct FSimRoadGraph
+{
+	std::vector<FSimLink> links;
+
+	/* Successor links of all links, ranged by FSimLink::firstNext. */
+	std::vector<int> nextLinks;
+
+	std::vector<FSimSignal> signals;
+
+	/* Polyline points of all links and their distance from the link start. */
+	std::vector<float> pointX, pointY, pointZ, pointDistance;
+
+	/* Total number of lanes of all links. */
+	int numLanes = 0;
+
+	/* Adds a link along a polyline of numPoints xyz triples, returns its index. */
+	int addLink(const float* points, int numPoints, int laneCount, float laneWidth, float speedLimit, bool isTurn, int signal = -1);
+
+	/* Adds a signal group, returns its index. */
+	int addSignal(const FSimSignal &signal);
+
+	/* Allows vehicles to move from the end of a link to the start of another. */
+	void connect(int fromLink, int toLink);
+
+	/* Builds successor ranges and lane indices, must be called after all links and connections are added. */
+	void finalize();
+
+	/* Removes all links, signals and connections. */
+	void clear();
+
+	/* Computes location and heading (radians, from the polyline direction) of a lane position. */
+	void locate(int link, int lane, float distance, float &x, float &y, float &z, float &heading) const;
+
+private:
+	/* Pending connections, compiled by finalize. */
+	std::vector<std::pair<int, int>> connections;
+};
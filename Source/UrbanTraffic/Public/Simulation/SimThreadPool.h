@@ -0,0 +1,77 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal worker pool of the simulation core, the calling thread joins every parallel loop.
+ */
+class FSimThreadPool
+{
+public:
+	/* Starts numThreads - 1 workers, 0 uses all hardware threads. */
+	explicit FSimThreadPool(int numThreads = 0);
+	~FSimThreadPool();
+
+	FSimThreadPool(const FSimThreadPool&) = delete;
+	FSimThreadPool& operator=(const FSimThreadPool&) = delete;
+
+	/* Calls body(begin, end) over chunks of [0, count) and returns when all chunks are done. */
+	void parallelFor(int count, int grain, const std::function<void(int, int)> &body);
+
+	/* Number of threads taking part in a loop, including the caller. */
+	int num() const { return (int)workers.size() + 1; }
+
+private:
+	/* Takes chunks of the current loop until none is left. */
+	void runChunks();
+
+	/* Waits for loops and runs them. */
+	void workerMain();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeup, finished;
+
+	/* Current loop, valid while busy workers are above zero. */
+	const std::function<void(int, int)>* loopBody = nullptr;
+	int loopCount = 0, loopGrain = 1;
+	std::atomic<int> nextChunk{0};
+
+	/* Loop generation, workers run each generation once. */
+	uint64_t generation = 0;
+
+	/* Workers still running the current loop. */
+	int busyWorkers = 0;
+
+	bool stopping = false;
+};
@@ -0,0 +1,143 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "SimThreadPool.h"
+#include "SimTrafficModel.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Microscopic traffic simulation over a compiled road graph.
+ * Vehicles follow their lane with the Intelligent Driver Model, change lanes when the neighbour lane
+ * is faster and safe, take random turns at link ends and stop at red signals. Conflicts inside
+ * crossings are left to the signals.
+ * Vehicle state is kept in structure-of-arrays, ids stay valid until the vehicle is removed.
+ */
+class FSimTraffic : public FSimTrafficModel
+{
+public:
+	FSimTraffic(const FSimRoadGraph &roadGraph, int numThreads = 0, uint32_t seed = 0);
+
+	/* Adds a vehicle at a lane position, returns its id. */
+	virtual int addVehicle(int link, int lane, float position, float speed, const FSimDriverParams &params) override;
+
+	/* Adds a vehicle at a random lane position with enough room, returns its id or -1 when none is found. */
+	virtual int addRandomVehicle(const FSimDriverParams &params) override;
+
+	/* Removes a vehicle, its id may be reused. */
+	virtual void removeVehicle(int id) override;
+
+	/* Removes all vehicles. */
+	virtual void clear() override;
+
+	/* Advances all vehicles by a time step, in seconds. */
+	virtual void step(float deltaSeconds) override;
+
+	/* Vehicle state, see FSimTrafficModel. */
+	virtual bool isAlive(int id) const override { return id >= 0 && id < (int)alive.size() && alive[id]; }
+	virtual int getCapacity() const override { return (int)alive.size(); }
+	virtual int getLink(int id) const override { return links[id]; }
+	virtual int getLane(int id) const override { return lanes[id]; }
+	virtual float getPosition(int id) const override { return positions[id]; }
+	virtual float getSpeed(int id) const override { return speeds[id]; }
+
+	float getAcceleration(int id) const { return accelerations[id]; }
+	const FSimDriverParams& getParams(int id) const { return params[id]; }
+
+	/* Link the vehicle moves to after its current one, -1 at dead ends. */
+	int getNextLink(int id) const { return nextLinks[id]; }
+
+	/* Vehicle ids of a lane, from the front to the back. */
+	const std::vector<int>& getLaneVehicles(int link, int lane) const { return laneVehicles[graph.links[link].firstLane + lane]; }
+
+	/* Checks whether a lane has room for a vehicle at a position. */
+	bool hasRoom(int link, int lane, float position, float length) const;
+
+private:
+	/* Computes accelerations and lane change wishes of the vehicles of a lane. */
+	void updateLane(int laneIndex);
+
+	/* Computes acceleration of a vehicle behind a leader, gap in meters. */
+	float computeAcceleration(int id, float desiredSpeed, float gap, float leaderSpeed) const;
+
+	/* Finds gap and speed of the obstacle beyond the end of a link for a vehicle at the front of a lane. */
+	void findObstacleAhead(int id, int lane, float &gap, float &obstacleSpeed) const;
+
+	/* Gets speed a vehicle accelerates to, slowing down for the next link near the end of the current one. */
+	float getDesiredSpeed(int id) const;
+
+	/* Puts a vehicle at the start of a random lane with room, returns false when none is found. */
+	bool respawn(int id);
+
+	/* Finds the vehicles around a position on a lane, -1 when none. */
+	void findNeighbours(int laneIndex, float position, int &leader, int &follower) const;
+
+	/* Moves vehicles between lanes and links after integration. */
+	void applyTransitions();
+
+	/* Inserts a vehicle into its lane, keeping order by position. */
+	void insertIntoLane(int id);
+
+	/* Removes a vehicle from its lane. */
+	void removeFromLane(int id);
+
+	/* Chooses the link a vehicle takes after its current one. */
+	int chooseNextLink(int id, int link);
+
+	/* Advances the random state of a vehicle, returns a number in [0, 1). */
+	float randomFloat(int id);
+
+	FSimThreadPool pool;
+
+	std::vector<uint8_t> alive;
+	std::vector<int> links, lanes, nextLinks;
+	std::vector<float> positions, speeds, accelerations;
+	std::vector<FSimDriverParams> params;
+
+	/* Requested lane change of each vehicle, -1, 0 or +1. */
+	std::vector<int8_t> laneChanges;
+
+	/* Seconds until a vehicle may evaluate lane changes again. */
+	std::vector<float> laneChangeTimers;
+
+	std::vector<uint32_t> randomStates;
+
+	/* Vehicle ids of each lane of the graph, from the front to the back. */
+	std::vector<std::vector<int>> laneVehicles;
+
+	/* Vehicles requesting lane changes, reused every step. */
+	std::vector<int> laneChangers;
+
+	/* Released vehicle ids. */
+	std::vector<int> freeIds;
+
+	/* Random state of spawning. */
+	uint32_t spawnState;
+
+	/* Time step of the current step, read by lane updates. */
+	float stepSeconds = 0;
+};
@@ -0,0 +1,125 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "SimRoadGraph.h"
+
+#include <cstdint>
+
+/**
+ * Driver and vehicle parameters of a simulated vehicle, in SI units.
+ */
+struct FSimDriverParams
+{
+	/* Desired time gap to the leading vehicle. */
+	float timeHeadway = 1.5f;
+
+	/* Bumper-to-bumper gap kept when standing in a queue. */
+	float minimumGap = 2;
+
+	float maxAcceleration = 1.5f;
+
+	float comfortDeceleration = 2;
+
+	/* Vehicle length. */
+	float length = 4.5f;
+
+	/* Factor of the speed limit the driver accelerates to. */
+	float speedFactor = 1;
+
+	/* Acceleration advantage a lane change must bring. */
+	float laneChangeThreshold = 0.2f;
+};
+
+/**
+ * Common interface of traffic models running over a compiled road graph.
+ * Vehicles are addressed by ids which stay valid until the vehicle is removed.
+ */
+class FSimTrafficModel
+{
+public:
+	/* The graph must outlive the model and stay unchanged, except signals which may be updated between steps. */
+	explicit FSimTrafficModel(const FSimRoadGraph &roadGraph) : graph(roadGraph) {}
+	virtual ~FSimTrafficModel() {}
+
+	/* Adds a vehicle at a lane position, returns its id. */
+	virtual int addVehicle(int link, int lane, float position, float speed, const FSimDriverParams &params) = 0;
+
+	/* Adds a vehicle at a random lane position with enough room, returns its id or -1 when none is found. */
+	virtual int addRandomVehicle(const FSimDriverParams &params) = 0;
+
+	/* Removes a vehicle, its id may be reused. */
+	virtual void removeVehicle(int id) = 0;
+
+	/* Removes all vehicles. */
+	virtual void clear() = 0;
+
+	/* Advances all vehicles by a time step, in seconds. */
+	virtual void step(float deltaSeconds) = 0;
+
+	/* Checks whether a vehicle id is in use. */
+	virtual bool isAlive(int id) const = 0;
+
+	/* Upper bound of vehicle ids. */
+	virtual int getCapacity() const = 0;
+
+	/* Lane position and speed of a vehicle. */
+	virtual int getLink(int id) const = 0;
+	virtual int getLane(int id) const = 0;
+	virtual float getPosition(int id) const = 0;
+	virtual float getSpeed(int id) const = 0;
+
+	/* Computes world location and heading of a vehicle. */
+	void locate(int id, float &x, float &y, float &z, float &heading) const {
+		graph.locate(getLink(id), getLane(id), getPosition(id), x, y, z, heading);
+	}
+
+	/* Number of vehicles in the model. */
+	int num() const { return numVehicles; }
+
+	/* Simulation time, in seconds. */
+	double getTime() const { return time; }
+
+	/* Number of vehicles that left the road at dead ends since the start. */
+	int getNumExited() const { return numExited; }
+
+	/* Respawns vehicles leaving at dead ends at a random lane start, keeps the population steady. */
+	bool respawnExited = true;
+
+protected:
+	/* Advances a xorshift state, returns a number in [0, 1). */
+	static float nextRandom(uint32_t &state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216);
+	}
+
+	const FSimRoadGraph &graph;
+
+	int numVehicles = 0;
+	int numExited = 0;
+	double time = 0;
+};
@@ -28,6 +28,8 @@
 #include "Engine/StaticMeshActor.h"
 #include "StreetLamp.generated.h"
 
+class AUrbanTraffic;
+
 /**
  * 
  */
@@ -38,10 +40,15 @@ class URBANTRAFFIC_API AStreetLamp : public AStaticMeshActor
 	
 public:
 	AStreetLamp();
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	void collectLightComponents(TArray<USceneComponent*> &lightCollection);
 
 private:
 	/* Collection of light components managed by this lamp. */
 	USceneComponent* lights;
+
+	/* Traffic manager the lights are registered to. */
+	TWeakObjectPtr<AUrbanTraffic> manager;
 };
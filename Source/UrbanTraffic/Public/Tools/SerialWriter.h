@@ -0,0 +1,138 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "SimpleSerial.h"
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Containers/CircularQueue.h"
+#include <atomic>
+
+class FRunnableThread;
+class FEvent;
+
+/* Kind of packets, only the latest packet of each kind is worth sending. */
+enum class SerialPacketKind : uint8
+{
+	Control,
+	Sensor,
+	Count
+};
+
+/* Fixed size packet passed from the game thread to the writer thread. */
+struct FSerialPacket
+{
+	SerialPacketKind kind = SerialPacketKind::Control;
+	uint8 length = 0;
+	uint8 data[16];
+};
+
+/* Counters of a serial writer, read from any thread. */
+struct FSerialWriterStats
+{
+	/* Packets fully written to the port. */
+	uint32 sent = 0;
+
+	/* Packets superseded by a newer one of the same kind before being written. */
+	uint32 coalesced = 0;
+
+	/* Packets rejected because the ring buffer was full. */
+	uint32 dropped = 0;
+
+	/* Writes refused or cut short by a full device buffer. */
+	uint32 busyWrites = 0;
+
+	/* Attempts to reopen a lost port. */
+	uint32 reconnects = 0;
+};
+
+/**
+ * Owns a serial port on a dedicated thread, fed by a lock-free single-producer single-consumer ring.
+ * The game thread only enqueues, opening, writing and reconnecting never touch it.
+ */
+class FSerialWriter : public FRunnable
+{
+public:
+	/* Starts the writer thread, the port is opened from there. */
+	FSerialWriter(const FString &port, uint32 baud);
+	virtual ~FSerialWriter();
+
+	FSerialWriter(const FSerialWriter&) = delete;
+	FSerialWriter& operator=(const FSerialWriter&) = delete;
+
+	/* Queues a packet, returns false when the ring is full. Called from the producer thread only. */
+	bool enqueue(SerialPacketKind kind, const uint8* data, uint8 length);
+
+	/* Checks whether the port is currently open. */
+	bool isConnected() const { return connected; }
+
+	/* Takes a snapshot of the counters. */
+	FSerialWriterStats getStats() const;
+
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	/* Moves queued packets to the latest slots, counting the superseded ones. */
+	void drainQueue();
+
+	/* Takes the next latest packet to be written, returns false when none. */
+	bool takeLatest();
+
+	/* Writes the rest of the current packet, returns false when the device is busy or lost. */
+	bool writePending();
+
+	/* Opens the port, on failure the next attempt is delayed exponentially. */
+	void reconnect();
+
+	FString portName;
+	uint32 baudrate;
+
+	/* Accessed by the writer thread only. */
+	SimpleSerial serial;
+
+	/* Packets from the game thread. */
+	TCircularQueue<FSerialPacket> queue;
+
+	/* Latest unsent packet of each kind. */
+	FSerialPacket latest[(int)SerialPacketKind::Count];
+	bool hasLatest[(int)SerialPacketKind::Count] = {};
+
+	/* Packet being written, kept until fully sent so that framing is never broken. */
+	FSerialPacket pending;
+	int pendingOffset = 0;
+	bool hasPending = false;
+
+	/* Time of the next reconnect attempt and the current delay. */
+	double reconnectTime = 0;
+	float reconnectDelay = 0;
+
+	/* Wakes the thread up on new packets or stopping. */
+	FEvent* wakeup = nullptr;
+	FRunnableThread* thread = nullptr;
+
+	std::atomic<bool> running{true};
+	std::atomic<bool> connected{false};
+	std::atomic<uint32> sent{0}, coalesced{0}, dropped{0}, busyWrites{0}, reconnects{0};
+};
@@ -24,44 +24,40 @@
 
 #pragma once
 
-#include "Windows/AllowWindowsPlatformTypes.h"
-#include "Windows/MinWindows.h"
-#include "Windows/HideWindowsPlatformTypes.h"
+#include "CoreMinimal.h"
 #include <inttypes.h>
-//#include <Windows.h>
-//#include <stdio.h>
-//#include <stdlib.h>
-//#include <iostream>
-//#include <string>
-//#include <string.h>
-//#include <chrono>
-//#include <thread>
-//#include <time.h>
-//#include <fstream>
-
-using namespace std;
 
+/**
+ * Write-only serial port, 8 data bits, no parity, one stop bit.
+ * Windows opens COM ports, other platforms open any tty through termios, pseudo-terminals included.
+ * Writes never wait for a slow device, errors are reported to the log.
+ */
 class SimpleSerial {
 
 private:
 	bool comConnected = false;
-	HANDLE comHandler;
-	COMSTAT comStatus;
-	DWORD comErrors;
 
-	//string syntax_name_;
-	//char front_delimiter_;
-	//char end_delimiter_;
+#if PLATFORM_WINDOWS
+	/* Handle of the COM port. */
+	void* comHandler = nullptr;
+#else
+	/* File descriptor of the tty. */
+	int comDescriptor = -1;
+#endif
 
-	//void CustomSyntax(string syntax_type);
+	/* Port name, for log messages. */
+	FString comName;
 
 public:
 	~SimpleSerial();
 
-	void open(char* comPort, DWORD baudrate);
-	//string ReadSerialPort(int reply_wait_time, string syntax_type);
-	int write(uint8_t *data, uint32_t length);
+	/* Opens a port at a baud rate, the port stays disconnected on failure. */
+	void open(const char* comPort, uint32 baudrate);
+
+	/* Writes bytes, returns number of bytes written (0 when the device is busy), or -1 when disconnected. */
+	int write(const uint8_t *data, uint32_t length);
+
 	void close();
 	
 	bool isConnected();
-};
\ No newline at end of file
+};
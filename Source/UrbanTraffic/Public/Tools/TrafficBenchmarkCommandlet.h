@@ -0,0 +1,79 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "TrafficBenchmarkCommandlet.generated.h"
+
+class AUrbanTraffic;
+class FJsonObject;
+
+/**
+ * Headless benchmark of road building, graph queries and AI simulation, writes a JSON report.
+ * UE4Editor-Cmd <Project> -run=TrafficBenchmark -nullrhi -unattended [-RoadFiles=a.txt+b.txt]
+ * [-GridSize=24] [-GridSpacing=10000] [-Queries=10000] [-Routes=1000] [-Minutes=2] [-Seed=0]
+ * [-Vehicle=/UrbanTraffic/Vehicles/BP_VehicleBase.BP_VehicleBase_C] [-Report=<file>.json]
+ */
+UCLASS()
+class URBANTRAFFIC_API UTrafficBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTrafficBenchmarkCommandlet();
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	/* Writes road file of a grid city, returns its path relative to the project directory. */
+	FString writeGridCity(int size, float spacing);
+
+	/* Creates a game world without viewport and spawns a traffic manager on road files. */
+	AUrbanTraffic* createTraffic(const TArray<FString> &roadFiles);
+
+	/* Destroys world of a traffic manager. */
+	void destroyTraffic(AUrbanTraffic* manager);
+
+	/* Measures road building, nearest node queries, spawn volume expansion and route planning. */
+	TSharedPtr<FJsonObject> benchmarkGraph(const TArray<FString> &roadFiles);
+
+	/* Simulates AI traffic for some minutes with fixed time steps. */
+	TSharedPtr<FJsonObject> benchmarkSimulation(const TArray<FString> &roadFiles);
+
+	/* Number of timed nearest node queries and spawn volume updates. */
+	int numQueries = 10000;
+
+	/* Number of timed route searches. */
+	int numRoutes = 1000;
+
+	/* Simulated minutes of AI traffic. */
+	float simulationMinutes = 2;
+
+	/* Seed of query positions and traffic. */
+	int32 seed = 0;
+
+	/* Vehicle class spawned by simulation. */
+	FString vehicleClass = TEXT("/UrbanTraffic/Vehicles/BP_VehicleBase.BP_VehicleBase_C");
+};
@@ -0,0 +1,125 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimTrafficModel.h"
+#include "TrafficSignalOptimizerCommandlet.generated.h"
+
+class AUrbanTraffic;
+class ATrafficLight;
+
+/* Periods of a master traffic light in a signal plan, in seconds. */
+struct FSignalPlanPeriods
+{
+	int red;
+	int yellow;
+	int green;
+};
+
+/* Simulation signal showing a traffic light, retimed by each evaluated plan. */
+struct FSignalPlanBinding
+{
+	ATrafficLight* light;
+
+	/* Index in the simulation graph signals. */
+	int signal;
+
+	/* Index of the master light in the plan. */
+	int master;
+
+	/* Time of the master cycle at the start, keeps offsets between crossings. */
+	float phase;
+};
+
+/**
+ * Searches cycle lengths and green splits of traffic lights on the headless simulation core, much faster than real time.
+ * Candidate plans are evaluated in parallel, the best plan is written back onto the master lights.
+ * UE4Editor-Cmd <Project> -run=TrafficSignalOptimizer -Map=/Game/Maps/City -unattended [-Demand=1000+2500+1000]
+ * [-Minutes=15] [-Warmup=2] [-Objective=Delay|Throughput] [-Cycles=45+60+75+90] [-MinGreen=5]
+ * [-Generations=20] [-Candidates=16] [-Seed=0] [-Save] [-Report=<file>.json]
+ */
+UCLASS()
+class URBANTRAFFIC_API UTrafficSignalOptimizerCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTrafficSignalOptimizerCommandlet();
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	/* Loads a map, builds its road system, binds its lights and compiles the simulation graph. */
+	AUrbanTraffic* loadTraffic(const FString &mapName);
+
+	/* Simulates a plan on its own copy of the graph, returns the cost to minimize. Safe to call from worker threads. */
+	double evaluatePlan(const TArray<FSignalPlanPeriods> &plan) const;
+
+	/* Derives a candidate from a plan by changing the common cycle or some green splits. */
+	void mutatePlan(const TArray<FSignalPlanPeriods> &plan, FRandomStream &stream, TArray<FSignalPlanPeriods> &candidate) const;
+
+	/* Makes periods of a cycle, split is the share of the master green among both greens. */
+	FSignalPlanPeriods makePeriods(int cycle, float split, int yellow) const;
+
+	/* Gets the share of the master green among both greens. */
+	float getSplit(const FSignalPlanPeriods &periods) const;
+
+	/* Writes a plan onto the master lights, saves their levels when asked. */
+	bool applyPlan(const TArray<FSignalPlanPeriods> &plan, bool save);
+
+	/* Traffic manager of the loaded map. */
+	AUrbanTraffic* manager = nullptr;
+
+	/* Master lights, in plan order. */
+	TArray<ATrafficLight*> masters;
+
+	/* Simulation signals of all bound lights. */
+	TArray<FSignalPlanBinding> bindings;
+
+	/* Number of simulated vehicles in each equal period of the measured time. */
+	TArray<int> demand;
+
+	/* Driver parameters of simulated vehicles. */
+	FSimDriverParams driverParams;
+
+	/* Measured minutes of each evaluation, after the warmup. */
+	float simulationMinutes = 15;
+
+	/* Minutes simulated before measuring, so queues form. */
+	float warmupMinutes = 2;
+
+	/* Minimizes vehicle hours of delay, otherwise maximizes vehicle kilometers travelled. */
+	bool minimizeDelay = true;
+
+	/* Cycle lengths to choose from, in seconds. */
+	TArray<int> cycles;
+
+	/* Shortest green of both the master and the reversed lights. */
+	int minGreen = 5;
+
+	/* Seed of the search and of all evaluations, so candidates are compared on the same traffic. */
+	int32 seed = 0;
+};
@@ -27,13 +27,27 @@
 #include "CoreMinimal.h"
 #include "Engine/StaticMeshActor.h"
 #include "Components/BoxComponent.h"
+#include "RoadNode.h"
 #include "TrafficLight.generated.h"
 
+class URoadNodePort;
+class AUrbanTraffic;
+
 UENUM(BlueprintType)
 enum class TrafficLightState : uint8 {
 	Red, Yellow, Green, Blink
 };
 
+/* Demand on approaches of a signal group, measured by the traffic manager. */
+struct FSignalDemand
+{
+	/* Number of stopped vehicles near the stop lines. */
+	int queue = 0;
+
+	/* Moving vehicles expected at the stop lines, per second. */
+	float arrivalRate = 0;
+};
+
 /**
  * 
  */
@@ -46,6 +60,79 @@ public:
 	ATrafficLight();
 	virtual void Tick(float DeltaSeconds) override;
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/* Gets vehicle blocker while it stops vehicles (red or yellow), null otherwise. */
+	UBoxComponent* getActiveBlocker();
+
+	/* Gets number of times the vehicle blocker was switched. */
+	uint32 getBlockerRevision();
+
+	/* Checks whether this light runs its own signal, rather than following a master. */
+	bool isSignalMaster();
+
+	/* Hands the signal over to the traffic manager scheduler, which stops the tick. Returns delay until the first change. */
+	float scheduleSignal();
+
+	/* Moves the signal to its next change, appends lights whose visuals must be updated. Returns delay until the next change, in seconds. */
+	float advanceSignal(TArray<ATrafficLight*> &changedLights);
+
+	/* Applies light visibility and blocker collision of the current state. */
+	void applyVisualState();
+
+	/* Gets current light state. */
+	TrafficLightState getLightState();
+
+	/* Gets location of the stop line, where the vehicle blocker is. */
+	FVector getStopLocation();
+
+	/* Checks whether this light governs turns of a type. */
+	bool isControlledTurn(RoadTurnType turnType);
+
+	/* Binds this light to the crossing entry port it stands at, vehicles then stop from the road graph.
+	The light faces along the approach, its forward vector points the way vehicles enter the crossing. */
+	void bindSignal(URoadNodePort* port);
+
+	/* Gets the crossing entry port this light is bound to, null when vehicles rely on the blocker. */
+	URoadNodePort* getBoundPort();
+
+	/* Gets the light running the signal this light shows. */
+	ATrafficLight* getSignalMaster();
+
+	/* Gets length of the signal cycle, in seconds. */
+	int getCycleLength();
+
+	/* Gets when this light turns green, in seconds from the green start of its master. */
+	float getGreenStart();
+
+	/* Gets time of the master cycle, in seconds from its green start, given the seconds left until the master
+	changes next. A negative countdown reads the tick countdown of lights which are not scheduled. */
+	float getSignalPhase(float countdown = -1);
+
+	/* Gets green start, green and yellow of this light within the cycle of its master, false when blinking. */
+	bool getSignalWindow(float &greenStart, float &green, float &yellow);
+
+	/* Gets the same window for other periods of the master, for evaluating signal plans. */
+	void getSignalWindow(int masterRed, int masterYellow, int masterGreen, float &greenStart, float &green, float &yellow);
+
+	/* Moves the signal to a time of its cycle, counted from the green start. Returns delay until the next change, in seconds. */
+	float setSignalPhase(float phase, TArray<ATrafficLight*> &changedLights);
+
+	/* Sets periods of a standalone signal, the traffic manager coordinates it again. */
+	UFUNCTION(BlueprintCallable)
+	void SetSignalPeriods(int Red, int Yellow, int Green);
+
+	/* Checks whether the traffic manager decides green ends of this signal from live demand. */
+	bool isActuated();
+
+	/* Checks whether the next change ends a green, of this light or of its reversed lights. */
+	bool isGreenEnding();
+
+	/* Appends bound ports of lights in this signal group showing a state. */
+	void getGroupPorts(TrafficLightState state, TArray<URoadNodePort*> &ports);
+
+	/* Decides whether the ending green is extended. Returns the extension in seconds, 0 to end the green now. */
+	float actuateGreen(const FSignalDemand &served, const FSignalDemand &conflicting);
 
 protected:
 	/* When the master is set, this will follow its signal, standalone mode will be disabled. */
@@ -80,6 +167,30 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "StandaloneSignal")
 	int TickCountdown = 1;
 
+	/* Green ends are decided from queues and arrivals on the approaches, needs the traffic manager. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ActuatedSignal")
+	bool Actuated = false;
+
+	/* Shortest green of an actuated signal, for both this and the reversed lights. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ActuatedSignal", meta = (EditCondition = "Actuated", ClampMin = "1"))
+	int MinGreenPeriod = 5;
+
+	/* Longest green of an actuated signal while the other approaches are waiting. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ActuatedSignal", meta = (EditCondition = "Actuated", ClampMin = "1"))
+	int MaxGreenPeriod = 40;
+
+	/* Green added each time vehicles are still arriving. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ActuatedSignal", meta = (EditCondition = "Actuated", ClampMin = "1"))
+	int GreenExtension = 2;
+
+	/* Turns of the crossing entry governed by this light, empty for all turns. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SignalBinding")
+	TArray<RoadTurnType> ControlledTurns;
+
+	/* Keeps blocker collision even when the light is bound to the road graph, for vehicles not driven by the traffic manager. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SignalBinding")
+	bool UseVehicleBlocker = false;
+
 	UPROPERTY(VisibleDefaultsOnly, SimpleDisplay, BlueprintReadOnly)
 	UBoxComponent* VehicleBlocker;
 
@@ -99,12 +210,30 @@ private:
 	/* Precomputed reversed light state. */
 	TrafficLightState reversedState;
 
-	/* Sets new light state and adjust relevant properties. */
-	void setLightState(TrafficLightState newState, bool setCountdown = true);
+	/* Sets new light state, visuals follow by applyVisualState. */
+	void setLightState(TrafficLightState newState, TArray<ATrafficLight*> &changedLights);
+
+	/* Is the signal driven by the traffic manager instead of the tick. */
+	bool scheduled = false;
+
+	/* Time the current green has lasted at its next change, in seconds. */
+	float greenTime = 0;
+
+	/* Is this light waiting for applyVisualState. */
+	bool visualPending = false;
+
+	/* Crossing entry port governed by this light. */
+	URoadNodePort* boundPort = nullptr;
+
+	/* Number of times the vehicle blocker was switched. */
+	uint32 blockerRevision = 0;
 
 	/* Cached slaves which follow this light signal. */
 	TArray<ATrafficLight*> slaves;
 
+	/* Traffic manager the light is registered to. */
+	TWeakObjectPtr<AUrbanTraffic> manager;
+
 	/* Update light state of slaves. */
-	void updateSlaves();
+	void updateSlaves(TArray<ATrafficLight*> &changedLights);
 };
@@ -0,0 +1,103 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+#if URBANTRAFFIC_TRACE
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#endif
+
+class AActor;
+
+// ================================================================
+// ===                           STATS                          ===
+// ================================================================
+
+DECLARE_STATS_GROUP(TEXT("UrbanTraffic"), STATGROUP_UrbanTraffic, STATCAT_Advanced);
+
+/* Vehicles by significance tier: near the camera, inside significance radius, far. */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vehicles Near"), STAT_UrbanTrafficVehiclesNear, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vehicles Normal"), STAT_UrbanTrafficVehiclesNormal, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vehicles Far"), STAT_UrbanTrafficVehiclesFar, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+/* Sensor work of this frame. */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sensor Physics Queries"), STAT_UrbanTrafficPhysicsQueries, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sensor Virtual Rays"), STAT_UrbanTrafficVirtualRays, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sensor Coherent Updates"), STAT_UrbanTrafficCoherentUpdates, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+/* Spawning, measured over the last second. */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Spawns Per Second"), STAT_UrbanTrafficSpawnRate, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Despawns Per Second"), STAT_UrbanTrafficDespawnRate, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+/* Nodes visited by graph searches. */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Spawn Volume Nodes"), STAT_UrbanTrafficSpawnVolumeNodes, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Route Expanded Nodes"), STAT_UrbanTrafficRouteNodes, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+/* Lights and vehicles waiting for the day/night switch. */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pending Light Switches"), STAT_UrbanTrafficLightSwitches, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+/* Street lamp lights and vehicle headlights kept as dynamic lights by the budget. */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Dynamic Lights"), STAT_UrbanTrafficDynamicLights, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+/* Vehicles kept by the simulation core instead of actors. */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Simulated Vehicles"), STAT_UrbanTrafficSimulatedVehicles, STATGROUP_UrbanTraffic, URBANTRAFFIC_API);
+
+// ================================================================
+// ===                           TRACE                          ===
+// ================================================================
+
+/* AI decisions written to the trace channel. */
+enum class VehicleDecisionType : uint8 {
+	Turn,
+	SwitchLeft,
+	SwitchRight,
+	ReservationGranted,
+	ReservationDenied,
+	Reroute
+};
+
+#if URBANTRAFFIC_TRACE
+
+UE_TRACE_CHANNEL_EXTERN(UrbanTrafficChannel, URBANTRAFFIC_API);
+
+struct URBANTRAFFIC_API FTrafficTrace
+{
+	/* Writes an AI decision of a vehicle. */
+	static void vehicleDecision(const AActor* vehicle, VehicleDecisionType decision);
+};
+
+/* Timeline scope on the UrbanTraffic channel. */
+#define TRAFFIC_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL_STR("UrbanTraffic::" #Name, UrbanTrafficChannel)
+#define TRAFFIC_TRACE_DECISION(Vehicle, Decision) FTrafficTrace::vehicleDecision(Vehicle, VehicleDecisionType::Decision)
+
+#else
+
+#define TRAFFIC_TRACE_SCOPE(Name)
+#define TRAFFIC_TRACE_DECISION(Vehicle, Decision)
+
+#endif
@@ -26,12 +26,21 @@
 
 #include "StreetLamp.h"
 #include "RoadSegment.h"
+#include "DriverModel.h"
+#include "VirtualSensorScene.h"
+#include "SensorResultBuffer.h"
+#include "SignalTimingWheel.h"
+#include "LightBudget.h"
+#include "SimTraffic.h"
+#include "SimMesoTraffic.h"
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "GameFramework/PlayerStart.h"
 #include "Modules/ModuleManager.h"
 #include "UrbanTraffic.generated.h"
 
+DECLARE_LOG_CATEGORY_EXTERN(LogUrbanTraffic, Log, All);
+
 class FUrbanTrafficModule : public IModuleInterface
 {
 public:
@@ -42,12 +51,67 @@ public:
 };
 
 class AVehicleBase;
+class UObstacleSensorComponent;
+class ATrafficLight;
+class UTrafficBenchmarkCommandlet;
+
+/* Position of a vehicle in lane ordering. */
+struct FVehicleLaneEntry
+{
+	AVehicleBase* vehicle;
+	URoadNode* laneNode;
+	int lane;
+	float remainLength;
+	AVehicleBase* leader;
+	float gap;
+	float closingSpeed;
+	int batchIndex;
+};
+
+/* Turn link of the simulation graph, kept to follow traffic lights bound after compiling. */
+struct FSimTurnLink
+{
+	int link;
+	URoadTurn* turn;
+
+	/* Fixed-time signal used while the crossing has no bound light, -1 when free. */
+	int fixedSignal;
+};
+
+/* Street lamp light or vehicle waiting to switch between day and night. */
+struct FLightSwitchEntry
+{
+	TWeakObjectPtr<USceneComponent> light;
+	TWeakObjectPtr<AVehicleBase> vehicle;
+
+	/* Squared distance to the player when queued. */
+	float distance;
+};
+
+/* How vehicles are kept outside the spawn volume. */
+UENUM(BlueprintType)
+enum class OffscreenTrafficMode : uint8 {
+	Destroy		UMETA(DisplayName = "Destroy Vehicles"),
+	Microscopic	UMETA(DisplayName = "Simulation Core"),
+	Mesoscopic	UMETA(DisplayName = "Link Queues")
+};
+
+/* Obstacle sensor driven by the sensor scheduler. */
+struct FSensorScheduleEntry
+{
+	UObstacleSensorComponent* sensor;
+	AVehicleBase* vehicle;
+};
 
 UCLASS()
 class URBANTRAFFIC_API AUrbanTraffic : public AActor
 {
 	GENERATED_BODY()
 
+	/* Benchmarks drive road building and spawning directly. */
+	friend class UTrafficBenchmarkCommandlet;
+	friend class UTrafficSignalOptimizerCommandlet;
+
 public:
 	AUrbanTraffic();
 	virtual void OnConstruction(const FTransform& Transform) override;
@@ -61,12 +125,23 @@ public:
 // ================================================================
 
 public:
-	/* Collects lighting objects such as street lights. */
+	/* Applies the light state of the day clock again to all street lamps and vehicles. */
 	UFUNCTION(BlueprintCallable)
 	void RebuildLightSystem();
 
+	/* Adds lights of a street lamp to the group of its level and switches them to the light state. */
+	void registerStreetLamp(AStreetLamp* lamp);
+
+	/* Removes lights of a street lamp, or the whole group when its level is streamed out. */
+	void unregisterStreetLamp(AStreetLamp* lamp, bool levelRemoved);
+
+	/* Gets hour of the day clock, the simulated one or the last hour passed to UpdateLightSystem. */
+	UFUNCTION(BlueprintCallable)
+	float GetTimerHour();
+
 protected:
-	/* Updates lighting system based on day/night shifting. */
+	/* Updates lighting system based on day/night shifting. Once called, the caller drives the day clock
+	and the simulated one stops advancing. */
 	UFUNCTION(BlueprintCallable)
 	void UpdateLightSystem(float TimerHour, bool ForceUpdate = false);
 
@@ -76,13 +151,125 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Environment", meta = (UIMin = "1", UIMax = "2000", ClampMin = "1", ClampMax = "2000"))
 	float TimerSpeed = 100;
 
+	/* Lights and vehicles switched per frame when day and night shift, nearest to the player first. 0 switches all at once. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Environment", meta = (ClampMin = "0"))
+	int LightSwitchBudget = 64;
+
+	/* Street lamp lights and vehicle headlights kept as dynamic lights around the camera, the others only glow. 0 keeps all. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Environment", meta = (ClampMin = "0"))
+	int MaxDynamicLights = 64;
+
+	/* Grid cell of the light budget, lights are promoted and demoted by cell rings around the camera. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Environment", meta = (EditCondition = "MaxDynamicLights", ClampMin = "500"))
+	float LightBudgetCellSize = 5000;
+
+	/* Scalar parameter set to 1 on light meshes while their dynamic lights are demoted, so materials can fake the glow. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Environment", meta = (EditCondition = "MaxDynamicLights"))
+	FName LightProxyParameter = TEXT("LightProxy");
+
 private:
-	/* Collection of light components. */
-	TArray<USceneComponent*> timedLights;
+	/* Light components of registered street lamps, grouped by owning level. */
+	TMap<ULevel*, TArray<USceneComponent*>> lampLights;
 
 	/* Lighting system state: true at night, false at day. */
 	bool lightState;
 
+	/* Hour of the simulated day clock. */
+	float clockHour = 0;
+
+	/* Is the day clock driven by UpdateLightSystem calls instead of the simulated one. */
+	bool externalClock = false;
+
+	/* Switches lights to the state of an hour, spread over frames unless forced. */
+	void applyLightHour(float timerHour, bool forceUpdate);
+
+	/* Advances the simulated day clock, then switches pending lights within the budget. */
+	void updateDayClock(float deltaSeconds);
+
+	/* Queues lights and vehicles not in the light state yet, by distance to the player. */
+	void queueLightSwitches();
+
+	/* Lights and vehicles waiting to switch, the nearest at the end. */
+	TArray<FLightSwitchEntry> lightSwitches;
+
+	/* Checks whether the light budget demotes far lights. */
+	bool isLightBudgetEnabled();
+
+	/* Dynamic lights of street lamps and vehicles around the camera. */
+	FLightBudget lightBudget;
+
+// ================================================================
+// ===                       SIGNAL SYSTEM                      ===
+// ================================================================
+
+public:
+	/* Computes green wave offsets of signals along straight corridors and writes them onto the lights. */
+	UFUNCTION(BlueprintCallable, CallInEditor, Category = "Signal")
+	void CoordinateSignalCorridors();
+
+	/* Offsets signals into green waves at BeginPlay, and again whenever a cycle length changes. */
+	UPROPERTY(EditAnywhere, Category = "Signal")
+	bool CoordinateSignals = false;
+
+	/* Speed of platoons the green waves are timed for, in km/h. */
+	UPROPERTY(EditAnywhere, Category = "Signal", meta = (EditCondition = "CoordinateSignals", ClampMin = "5", ClampMax = "150"))
+	float DesignSpeed = 50;
+
+	/* Binds a traffic light to the road graph and takes over its signal, lights of streamed levels register when loaded. */
+	void registerTrafficLight(ATrafficLight* light);
+
+	/* Releases the road graph and the signal of a traffic light which ends play. */
+	void unregisterTrafficLight(ATrafficLight* light);
+
+private:
+	/* Registered traffic lights. */
+	TArray<TWeakObjectPtr<ATrafficLight>> trafficLights;
+
+	/* Binds a traffic light to the crossing entry port at its stop line and to its controlled turns. */
+	void bindTrafficLight(ATrafficLight* light);
+
+	/* Releases the entry port and the turns bound to a traffic light. */
+	void unbindTrafficLight(ATrafficLight* light);
+
+	/* Is coordination requested for the next signal update, after lights came in. */
+	bool coordinationPending = false;
+
+	/* Computes green start of each master light, in seconds, so platoons leaving one green meet the next. */
+	TMap<ATrafficLight*, float> computeSignalStarts();
+
+	/* Applies green wave offsets to running signals. */
+	void coordinateSignals();
+
+	/* Cycle length of each coordinated master light, a change triggers coordination again. */
+	TMap<ATrafficLight*, int> coordinatedCycles;
+
+	/* Advances due signals and applies visuals of all changed lights in one pass. */
+	void updateSignals(float deltaSeconds);
+
+	/* Measures queues and arrivals on approaches of lights in a signal group showing a state. */
+	FSignalDemand measureSignalDemand(ATrafficLight* master, TrafficLightState state);
+
+	/* Approach ports of a signal group, reused by demand measurement. */
+	TArray<URoadNodePort*> demandPorts;
+
+	/* Master lights keyed by their next signal change. */
+	FSignalTimingWheel signalWheel;
+
+	/* World time of the next change of each scheduled master light. */
+	TMap<ATrafficLight*, float> signalDueTimes;
+
+	/* Schedules the next change of a master light after a delay, in seconds. */
+	void scheduleSignalChange(ATrafficLight* master, float delay);
+
+	/* Gets seconds left until the master of a light changes next, negative when it is not scheduled. */
+	float getSignalCountdown(ATrafficLight* light);
+
+	/* Lights due this frame, reused every frame. */
+	TArray<ATrafficLight*> dueLights;
+
+	/* Lights whose visuals changed this frame, reused every frame. */
+	TArray<ATrafficLight*> changedLights;
+
 // ================================================================
 // ===                       VEHICLE SYSTEM                     ===
 // ================================================================
@@ -99,6 +286,23 @@ public:
 	/* Finds nearest road node to a position. */
 	URoadNode* findNearestRoadNode(FVector position);
 
+	/* Plans route for an AI vehicle on a worker thread and delivers it to its controller. */
+	UFUNCTION(BlueprintCallable)
+	void RequestVehicleRoute(AVehicleBase* Vehicle, FVector Destination);
+
+	/* Gets routing zone containing a position, -1 when routing tables are not built. */
+	int getRoutingZone(FVector position);
+
+	/* Gets routing zone of a segment, -1 when routing tables are not built. */
+	int getSegmentZone(URoadSegment* segment);
+
+	/* Checks whether AI vehicles reserve crossing turns before entering. */
+	bool isReservationEnabled();
+
+	/* Sets where vehicles are spawned around when there is no player vehicle, such as headless runs. */
+	UFUNCTION(BlueprintCallable)
+	void SetSpawnFocus(FVector Location);
+
 private:
 	/* Vehicle road data files. */
 	UPROPERTY(EditAnywhere, Category = "Vehicle")
@@ -112,6 +316,26 @@ private:
 	UPROPERTY(EditAnywhere, Category = "Vehicle", meta = (UIMin = "0", UIMax = "10", ClampMin = "0", ClampMax = "10"))
 	int VehicleDensity = 5;
 
+	/* Seed of all traffic decisions, same seed and inputs reproduce same traffic. */
+	UPROPERTY(EditAnywhere, Category = "Vehicle")
+	int32 TrafficSeed = 0;
+
+	/* AI vehicles reserve a time slot for their turn before entering a crossing. */
+	UPROPERTY(EditAnywhere, Category = "Vehicle")
+	bool UseIntersectionReservation = false;
+
+	/* Precomputes next-hop tables, so routed vehicles choose turns by lookup instead of searching. */
+	UPROPERTY(EditAnywhere, Category = "Vehicle")
+	bool UseRoutingTables = false;
+
+	/* Initial size of a routing zone, grown when there are too many zones. */
+	UPROPERTY(EditAnywhere, Category = "Vehicle", meta = (EditCondition = "UseRoutingTables", ClampMin = "1000"))
+	float RoutingZoneSize = 50000;
+
+	/* Bounds routing table memory: one byte per zone for each crossing entry port. */
+	UPROPERTY(EditAnywhere, Category = "Vehicle", meta = (EditCondition = "UseRoutingTables", ClampMin = "1", ClampMax = "1024"))
+	int MaxRoutingZones = 64;
+
 	/* Cleans previous compiled road path system. */
 	void cleanRoadSystem();
 
@@ -121,6 +345,9 @@ private:
 	/* Update spawn volume at specified node. */
 	void updateVehicleSpawnVolume(bool isBegin);
 
+	/* Root random stream, used for spawn choices and seeding vehicle streams. */
+	FRandomStream trafficStream;
+
 	/* Stores all computer controlled vehicles. */
 	TArray<AVehicleBase*> vehicles;
 
@@ -133,12 +360,244 @@ private:
 	/* Cached collection of vehicle nodes. */
 	TArray<URoadNode*> roadNodes;
 
+	/* Assigns segments to routing zones and builds next-hop tables. */
+	void buildRoutingTables();
+
+	/* Routing zone of each segment. */
+	TMap<URoadSegment*, int> segmentZones;
+
+	/* Number of routing zones, 0 when tables are not built. */
+	int numRoutingZones = 0;
+
+	/* Increased every build, for discarding routes planned on previous road system. */
+	uint32 roadGeneration = 0;
+
 	/* Only update spawn nodes when origin changed. */
-	URoadNode* spawnOrigin;
+	URoadNode* spawnOrigin = nullptr;
 
 	/* Cached data for collecting spawn volume nodes and distance from them to origin node. */
 	TMap<URoadNode*, float> spawnVolumeNodes;
 
+	/* Seconds since spawn volume was last updated. */
+	float spawnTimer = 0;
+
+	/* Spawn volume center used without a player vehicle. */
+	FVector spawnFocus;
+
+	/* Is spawn focus set. */
+	bool hasSpawnFocus = false;
+
+// ================================================================
+// ===                        DRIVER MODEL                      ===
+// ================================================================
+
+public:
+	/* Gets acceleration (m/s^2) computed by the driver model for this frame. */
+	float getDriverAcceleration(AVehicleBase* vehicle);
+
+	/* Finds the leading vehicle on the same lane, outputs gap (cm) and closing speed (km/h). */
+	AVehicleBase* findLeadingVehicle(AVehicleBase* vehicle, float &gap, float &closingSpeed);
+
+	/* Checks whether the vehicle is ordered in a lane, so followers take it from findLeadingVehicle. */
+	bool isLaneOrdered(AVehicleBase* vehicle);
+
+private:
+	/* Orders vehicles by lanes and evaluates the driver model, once per frame. */
+	void updateLaneOrdering();
+
+	/* Finds the rearmost entry of a lane, INDEX_NONE when the lane is empty. */
+	int findLaneRear(URoadNode* laneNode, int lane);
+
+	/* The frame which lane ordering was updated. */
+	uint64 laneOrderFrame = 0;
+
+	/* Cached lane positions, sorted by lane then by remaining length. */
+	TArray<FVehicleLaneEntry> laneEntries;
+
+	/* Index of vehicles in lane entries. */
+	TMap<AVehicleBase*, int> laneSlots;
+
+	/* Driver model inputs and outputs of all vehicles. */
+	FDriverModelBatch driverBatch;
+
+// ================================================================
+// ===                      SENSOR SCHEDULER                    ===
+// ================================================================
+
+public:
+	/* Lets the scheduler drive traces of a vehicle sensor. */
+	void registerSensor(UObstacleSensorComponent* sensor, AVehicleBase* vehicle);
+
+	/* Returns tracing back to the sensor itself. */
+	void unregisterSensor(UObstacleSensorComponent* sensor);
+
+	/* Checks whether vehicle sensors should be registered to the scheduler. */
+	bool isSensorScheduleEnabled();
+
+	/* Gets the result buffer shared by sensors of all vehicles. */
+	FSensorResultBuffer& getSensorResults();
+
+private:
+	/* Updates due sensors within the trace budget, in round-robin order. */
+	void updateSensorSchedule();
+
+	/* Computes update interval of a vehicle sensor from speed, stopping distance and significance. */
+	float computeSensorInterval(UObstacleSensorComponent* sensor, AVehicleBase* vehicle);
+
+	/* Schedules AI sensors instead of tracing every sensor every frame. */
+	UPROPERTY(EditAnywhere, Category = "Sensor")
+	bool ScheduleSensors = false;
+
+	/* Maximum queries (rays or sweeps) traced by scheduled sensors per frame, 0 for unlimited. */
+	UPROPERTY(EditAnywhere, Category = "Sensor", meta = (EditCondition = "ScheduleSensors", ClampMin = "0"))
+	int SensorTraceBudget = 600;
+
+	/* Longest update interval of a near sensor, in seconds. */
+	UPROPERTY(EditAnywhere, Category = "Sensor", meta = (EditCondition = "ScheduleSensors", ClampMin = "0", ClampMax = "2"))
+	float MaxSensorInterval = 0.5f;
+
+	/* Vehicles further than this from the viewer have lower significance, in centimeters. */
+	UPROPERTY(EditAnywhere, Category = "Sensor", meta = (EditCondition = "ScheduleSensors", ClampMin = "1000"))
+	float SensorSignificanceRadius = 10000;
+
+	/* Scheduled sensors. */
+	TArray<FSensorScheduleEntry> sensorEntries;
+
+	/* Result slots of vehicle sensors, kept contiguous for the AI reading them every frame. */
+	FSensorResultBuffer sensorResults;
+
+	/* Round-robin cursor, the first sensor checked on next frame. */
+	int sensorCursor = 0;
+
+	/* Player camera location of this frame. */
+	FVector viewLocation;
+
+	/* Is there a player camera this frame. */
+	bool hasViewLocation = false;
+
+// ================================================================
+// ===                      VIRTUAL SENSORS                     ===
+// ================================================================
+
+public:
+	/* Traces rays against boxes of traffic vehicles and blocking stop lines, padding makes them sweeps. */
+	bool traceVirtualRays(const TArray<FVector> &starts, const TArray<FVector> &ends, const AActor* ignored,
+		TArray<float> &distances, TArray<AActor*> &hitActors, float padding = 0);
+
+	/* Checks whether a sensor at this location must use the full physics scene. */
+	bool isPhysicsSensorRequired(FVector location);
+
+	/* Gets revision of the sensor scene, changed when traffic lights come or go and stop lines switch. */
+	uint32 getSceneRevision();
+
+private:
+	/* Collects vehicle and stop line boxes, once per frame. */
+	void updateVirtualScene();
+
+	/* Sensors nearer than this to the player camera always trace the physics scene, in centimeters. */
+	UPROPERTY(EditAnywhere, Category = "Sensor", meta = (ClampMin = "0"))
+	float PhysicsSensorRadius = 3000;
+
+	/* The frame which virtual scene was collected. */
+	uint64 virtualSceneFrame = 0;
+
+	/* Boxes of vehicles and stop lines. */
+	FVirtualSensorScene virtualScene;
+
+	/* Number of traffic light registrations and removals. */
+	uint32 signalRevision = 0;
+
+	/* Scene revision of this frame, see getSceneRevision. */
+	uint32 sceneRevision = 0;
+
+	/* The frame which scene revision was computed. */
+	uint64 sceneRevisionFrame = 0;
+
+// ================================================================
+// ===                      SIMULATION CORE                     ===
+// ================================================================
+
+public:
+	/* Keeps vehicles outside the spawn volume in the microscopic simulation core or in cheaper link queues,
+	only vehicles near the player are actors. */
+	UPROPERTY(EditAnywhere, Category = "Simulation")
+	OffscreenTrafficMode OffscreenTraffic = OffscreenTrafficMode::Destroy;
+
+	/* Number of vehicles simulated over the whole road network. */
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "0"))
+	int SimulatedVehicles = 2000;
+
+	/* Worker threads of the microscopic simulation, 0 uses all hardware threads. */
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "0", ClampMax = "64"))
+	int SimulationThreads = 0;
+
+	/* Simulated vehicles nearer than this to the player become actors, actors beyond 1.2 times return to the simulation. */
+	UPROPERTY(EditAnywhere, Category = "Simulation", meta = (ClampMin = "1000"))
+	float MirrorRadius = 15000;
+
+private:
+	/* Checks whether the simulation core keeps vehicles outside the spawn volume. */
+	bool isSimulationActive();
+
+	/* Compiles the road system into the simulation graph and populates it. */
+	void buildSimulation();
+
+	/* Compiles the road system and bound traffic lights into the simulation graph. */
+	void compileSimulationGraph();
+
+	/* Gets simulation signal showing a traffic light, added on first use, -1 when blinking. */
+	int getSimSignal(ATrafficLight* light);
+
+	/* Takes phases of traffic lights again and assigns signals of turn links, keeps the links and vehicles. */
+	void updateSimSignals();
+
+	/* Turns simulated vehicles near the focus into actors, and far actors back into simulated vehicles. */
+	void updateSimulationMirror(FVector focus, AVehicleBase* playerVehicle);
+
+	/* Spawns an actor at the lane position of a simulated vehicle, removes it from the simulation on success. */
+	bool materializeVehicle(int id);
+
+	/* Hands an actor over to the simulation, returns false when it is not on a straight lane. */
+	bool dematerializeVehicle(AVehicleBase* vehicle);
+
+	/* Gets simulation parameters of a vehicle type. */
+	FSimDriverParams getSimDriverParams(AVehicleBase* vehicle);
+
+	/* Graph compiled from the road system, in meters. */
+	FSimRoadGraph simGraph;
+
+	/* Traffic model of the simulation core, null when inactive. */
+	TUniquePtr<FSimTrafficModel> simTraffic;
+
+	/* Straight links by their entry and exit ports. */
+	TMap<URoadNodePort*, int> simLinksByEntry, simLinksByExit;
+
+	/* Simulation signals by the traffic lights they show. */
+	TMap<ATrafficLight*, int> simSignalsByLight;
+
+	/* Signals of lights released by the last update, reused before adding new ones. */
+	TArray<int> freeSimSignals;
+
+	/* Turn links of crossings. */
+	TArray<FSimTurnLink> simTurnLinks;
+
+	/* Signal revision which simulation signals were taken from. */
+	uint32 simSignalRevision = 0;
+
+// ================================================================
+// ===                           STATS                          ===
+// ================================================================
+
+private:
+	/* Publishes vehicle tiers and spawn rates to the stats group. */
+	void updateTrafficStats(float deltaSeconds);
+
+	/* Vehicles registered and unregistered since last spawn rate update. */
+	int spawnStatCount = 0, despawnStatCount = 0;
+
+	/* Time since last spawn rate update. */
+	float spawnStatTimer = 0;
+
 // ================================================================
 // ===                        DEMONSTATION                      ===
 // ================================================================
@@ -28,6 +28,8 @@
 
 #include "VehicleAnimation.h"
 #include "UrbanVehicleAI.h"
+#include "DriverModel.h"
+#include "ObstacleSensorComponent.h"
 #include "RoadSegment.h"
 #include "CoreMinimal.h"
 #include "WheeledVehicle.h"
@@ -90,6 +92,8 @@ class URBANTRAFFIC_API AVehicleBase : public AWheeledVehicle
 	DECLARE_DELEGATE_OneParam(FHandBrakeDelegate, bool);
 	DECLARE_DELEGATE_OneParam(FSideLightDelegate, SideLightState);
 
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDestinationReached, AVehicleBase*, Vehicle);
+
 public:
 	AVehicleBase();
 	virtual void PostInitializeComponents() override;
@@ -177,6 +181,21 @@ public:
 	/* TEMPORARY: Checks if a segment can be spawn a new vehicle. */
 	bool isSpawnableAt(URoadSegment* segment, bool invert);
 
+	/* Gets lane key (exit port or next node), lane index and remaining length to the key node. */
+	bool getLanePosition(URoadNode* &laneNode, int &lane, float &remainLength);
+
+	/* Gets the traffic manager which this vehicle is placed in. */
+	AUrbanTraffic* getTrafficManager();
+
+	/* Gets container of the halogen lights. */
+	USceneComponent* getLightContainer();
+
+	/* Seeds the random stream, same seed repeats same decisions of this vehicle. */
+	void setRandomSeed(int32 seed);
+
+	/* Gets random stream used for all traffic decisions of this vehicle. */
+	FRandomStream& getRandomStream();
+
 	/* Previous travelled node. */
 	URoadNode* prevNode;
 
@@ -187,6 +206,9 @@ private:
 	/* Pointer to the traffic manager. */
 	AUrbanTraffic* trafficManager;
 
+	/* Random stream of this vehicle, seeded by the traffic manager. */
+	FRandomStream randomStream;
+
 // ================================================================
 // ===                         VEHICLE AI                       ===
 // ================================================================
@@ -196,16 +218,47 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
 	float MaxSpeedLimit = 50;
 
+	/* Longitudinal control model used in AI controlled mode. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	LongitudinalModelType LongitudinalModel = LongitudinalModelType::Sensor;
+
+	/* Obstacle sensors trace asynchronously, AI reads results of previous frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	bool AsyncSensors = false;
+
+	/* Where obstacle sensors find other traffic: physics scene, or boxes known by the traffic manager. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	SensorBackendType SensorBackend = SensorBackendType::Physics;
+
+	/* Shape of obstacle sensor queries: ray fans, or one sweep per sensor. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	SensorShapeType SensorShape = SensorShapeType::RayFan;
+
+	/* Sensor updates extrapolated from the previous hit while the hit vehicle keeps its relative pose, 0 always traces. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI", meta = (ClampMin = "0", ClampMax = "60"))
+	int SensorCoherenceFrames = 0;
+
+	/* Car-following parameters of this vehicle type, used by Intelligent Driver Model. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "AI")
+	FDriverModelParams DriverModel;
+
 	/* Bounding for generates obstacle sensors. */
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly)
 	UBoxComponent* Bounding;
 
+	/* Called when the vehicle reaches the destination of RequestVehicleRoute, it keeps driving randomly afterwards. */
+	UPROPERTY(BlueprintAssignable, Category = "AI")
+	FOnDestinationReached OnDestinationReached;
+
 	/* Sets autonomous driving mode. Only valid when bind with VehicleControllerInterface. */
 	void setAutoMode(bool isAuto);
 
 	/* Checks whether autonomus driving mode. */
 	bool isAutoMode();
 
+	/* Gets bound auto controller, null in manual mode. */
+	IVehicleControllerInterface* getAutoController();
+
 private:
 	/* Vehicle AI controller. */
 	IVehicleControllerInterface* autoController;
@@ -237,6 +290,10 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetLightState(bool bLightState);
 
+	/* Gets halogen light state. */
+	UFUNCTION(BlueprintCallable)
+	bool GetLightState();
+
 	/* Sets side light state. */
 	UFUNCTION(BlueprintCallable)
 	void SetSideLightState(SideLightState SideState);
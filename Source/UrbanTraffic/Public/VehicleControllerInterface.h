@@ -32,6 +32,7 @@
 
 class AUrbanTraffic;
 class AVehicleBase;
+class URoadTurn;
 
 UINTERFACE(BlueprintType)
 class URBANTRAFFIC_API UVehicleControllerInterface : public UInterface
@@ -85,11 +86,45 @@ private:
 	/* The obstacle sensor when turn left. */
 	UObstacleSensorComponent* leftSensor;
 
-	UObstacleSensorComponent* laneSensor;
+	/* The obstacle sensors on left and right lanes, when switch lane. */
+	UObstacleSensorComponent *leftLaneSensor, *rightLaneSensor;
 
 	/* Vehicle control parameters. */
 	float maxSpeed, speedLimit;
 
+	/* Speed (km/h) the driver model accelerates to, updated every frame and seeded by bindVehicle. */
+	float desiredSpeed = 0;
+
+	/* Checks whether the Intelligent Driver Model controls the throttle. */
+	bool isDriverModelActive();
+
+	/* Checks if the vehicle is blocked ahead, by head sensor or the leading vehicle. */
+	bool isHeadBlocked();
+
+	/* Gets distance to the obstacle ahead, by head sensor or the leading vehicle. */
+	float getHeadDistance();
+
+	/* Gets distance to the nearest head sensor hit which is not a lane ordered vehicle, false when none. */
+	bool getObstacleDistance(float &distance);
+
+	/* Updates reservation of the upcoming turn. Returns false when the vehicle must stop at the stop line. */
+	bool updateReservation(float &stopDistance);
+
+	/* Checks signal of the upcoming turn from the road graph. Returns false when the vehicle must stop at the stop line. */
+	bool updateSignal(float &stopDistance);
+
+	/* Sets turn of the next crossing, releases slot of the previous one. */
+	void setUpcomingTurn(URoadTurn* turn);
+
+	/* Turn of the next or current crossing. */
+	URoadTurn* upcomingTurn = nullptr;
+
+	/* Is the slot of the upcoming turn granted. */
+	bool reservationGranted = false;
+
+	/* Has the vehicle passed the stop line of the upcoming turn. */
+	bool crossEntered = false;
+
 	/* When the car begin move backward, keep that direction for at least 1 second.
 	This behaviour makes the AI looks like human, and prevents dead position. */
 	float forceBackward = -1;
@@ -105,6 +140,30 @@ public:
 	/* Is the vehicle came from reversed direction. */
 	bool invertPath;
 
+	/* Gets lane key (exit port or next node), lane index and remaining length to the key node. */
+	bool getLanePosition(URoadNode* &laneNode, int &lane, float &remainLength);
+
+	/* Gets lane key the vehicle is ordered by after leaving the current one, null when the path ends. */
+	URoadNode* getNextLaneNode(URoadNode* laneNode);
+
+	/* Gets speed (km/h) the driver model accelerates to. */
+	float getDesiredSpeed();
+
+	/* Gets the entry port where the next turn will be chosen. */
+	URoadNodePort* getPlanningPort();
+
+	/* Sets destination, the route will be delivered later by setPlannedRoute. */
+	void setRouteDestination(FVector destination);
+
+	/* Sets planned turns leading to the destination. */
+	void setPlannedRoute(const TArray<URoadTurn*> &turns);
+
+	/* Checks whether the vehicle is following a planned route. */
+	bool hasPlannedRoute();
+
+	/* Sets routing zone of the destination, turns are looked up from crossing tables. */
+	void setDestinationZone(int zone);
+
 private:
 	/* Switchs to new lane. Called when next target is not equals current target. */
 	void switchLane(int targetLane, float distance = 3000);
@@ -115,6 +174,30 @@ private:
 	/* Internal check for switch to right lane. */
 	bool canSwitchRight();
 
+	/* Takes planned turn for a port, or null to choose randomly. */
+	URoadTurn* popPlannedTurn(URoadNodePort* port);
+
+	/* Ends the route, listeners are notified when the next target is set. */
+	void reachDestination();
+
+	/* Is the destination reached and not notified yet. */
+	bool destinationReached = false;
+
+	/* Planned turns to be taken at next crossings. */
+	TArray<URoadTurn*> plannedTurns;
+
+	/* Destination of planned route. */
+	FVector routeDestination;
+
+	/* Is the vehicle heading to the destination. */
+	bool hasDestination = false;
+
+	/* Requests a new route after the vehicle left the planned one. */
+	bool replanRoute = false;
+
+	/* Routing zone of the destination, -1 when not routed by tables. */
+	int destinationZone = -1;
+
 	/* Scheduled path nodes to be followed. */
 	TArray<URoadNode*> roadNodes;
 
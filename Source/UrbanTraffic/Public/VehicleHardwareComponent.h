@@ -25,7 +25,7 @@
 #pragma once
 
 #include "ObstacleSensorComponent.h"
-#include "Tools/SimpleSerial.h"
+#include "Tools/SerialWriter.h"
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
 #include "VehicleHardwareComponent.generated.h"
@@ -64,6 +64,7 @@ class URBANTRAFFIC_API UVehicleHardwareComponent : public UActorComponent
 public:
 	UVehicleHardwareComponent();
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
 	UFUNCTION(BlueprintCallable)
@@ -100,8 +101,8 @@ private:
 	/* The collection of vehicle sensors. */
 	TArray<UObstacleSensorComponent*> sensors;
 
-	/* Arduino serial handler. */
-	SimpleSerial arduino;
+	/* Arduino serial writer, owns the port on its own thread. */
+	TUniquePtr<FSerialWriter> arduino;
 
 	/* Serialization of control signal to be sent. */
 	uint8_t controlData[8] = { '$', '#', 0, 0, 0, 0, 0, '\r' };
@@ -0,0 +1,101 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2020 Thinh Pham.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+
+/**
+ * Oriented boxes in structure-of-arrays layout, for the ray kernel.
+ */
+struct URBANTRAFFIC_API FVirtualBoxArray
+{
+	TArray<float> centerX, centerY, centerZ;
+	TArray<float> axisXX, axisXY, axisXZ;
+	TArray<float> axisYX, axisYY, axisYZ;
+	TArray<float> axisZX, axisZY, axisZZ;
+	TArray<float> extentX, extentY, extentZ;
+	TArray<AActor*> actors;
+
+	/* Clears all arrays but keeps their memory. */
+	void reset();
+
+	/* Appends a box, returns its index. */
+	int add(AActor* actor, FVector center, FQuat rotation, FVector extent);
+
+	/* Appends a copy of a box from another array. */
+	void addFrom(const FVirtualBoxArray &other, int index);
+
+	/* Number of boxes. */
+	int num() const { return actors.Num(); }
+
+	/* Computes hit distance of a ray against every box, or a value over length when missed.
+	Padding grows boxes horizontally, which turns the ray into a sweep of that half width. */
+	void intersectRay(FVector origin, FVector direction, float length, float padding, float* distances) const;
+};
+
+/**
+ * Traffic vehicles and stop lines as a spatially bucketed box list,
+ * for sensors which do not need the physics scene.
+ */
+struct URBANTRAFFIC_API FVirtualSensorScene
+{
+	/* Removes all boxes and sets size of the grid cells. */
+	void reset(float newCellSize);
+
+	/* Adds an oriented box owned by an actor. */
+	void addBox(AActor* actor, FVector center, FQuat rotation, FVector extent);
+
+	/* Traces a fan of rays, ignores boxes of an actor. Outputs distance and hit actor per ray,
+	distance equals ray length when missed. Returns true if any ray hits. */
+	bool traceRays(const TArray<FVector> &starts, const TArray<FVector> &ends, const AActor* ignored,
+		TArray<float> &distances, TArray<AActor*> &hitActors, float padding = 0);
+
+	/* Number of boxes. */
+	int num() const { return boxes.num(); }
+
+private:
+	/* All boxes of the scene. */
+	FVirtualBoxArray boxes;
+
+	/* Boxes near the traced fan, gathered for the kernel. */
+	FVirtualBoxArray candidates;
+
+	/* Box indices of each grid cell. */
+	TMap<FIntPoint, TArray<int>> cells;
+
+	/* Size of grid cells, in centimeters. */
+	float cellSize = 2000;
+
+	/* Last trace which gathered each box, prevents duplicated candidates. */
+	TArray<uint32> boxStamps;
+
+	/* Current trace stamp. */
+	uint32 traceStamp = 0;
+
+	/* Scratch distances of a ray against candidates. */
+	TArray<float> rayDistances;
+};
@@ -39,6 +39,7 @@ public class UrbanTraffic : ModuleRules
 				"Engine",
 				"Slate",
 				"SlateCore",
+				"Json",
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
@@ -67,5 +68,13 @@ public class UrbanTraffic : ModuleRules
         PublicDefinitions.Add("IA_CAMERA_ZOOM=\"ZoomCamera\"");
         PublicDefinitions.Add("IA_CAMERA_UP=\"LookUp\"");
         PublicDefinitions.Add("IA_CAMERA_RIGHT=\"LookRight\"");
+
+        // Unreal Insights trace channel, TraceLog is available since 4.25
+        bool traceLog = Target.Version.MajorVersion > 4 || Target.Version.MinorVersion >= 25;
+        if (traceLog)
+        {
+            PrivateDependencyModuleNames.Add("TraceLog");
+        }
+        PublicDefinitions.Add("URBANTRAFFIC_TRACE=" + (traceLog ? "1" : "0"));
     }
 }